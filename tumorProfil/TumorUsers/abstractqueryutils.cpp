@@ -124,10 +124,13 @@ bool AbstractQueryUtils::updateUserMasterKeys(int userId, const QString& userPas
 {
     AbstractQueryUtils::removeAllMasterKeys(userId);
 
+    // derive the key once for all master keys
+    SessionKeyContext context(userPassword, salt);
+
     QMap<QString, QString>::iterator it;
     for(it=userKeys.begin(); it != userKeys.end(); ++it)
     {
-        AbstractQueryUtils::addMasterKey(it.key(), userId, userPassword, salt,
+        AbstractQueryUtils::addMasterKey(it.key(), userId, context,
                                  it.value());
     }
 
@@ -327,14 +330,19 @@ QString AbstractQueryUtils::generateRandomString(int length)
 
 
 qlonglong AbstractQueryUtils::addMasterKey(const QString& name, qlonglong userid, const QString& password, const QString& salt, const QString& givenMasterKey)
+{
+    return addMasterKey(name, userid, SessionKeyContext(password, salt), givenMasterKey);
+}
+
+qlonglong AbstractQueryUtils::addMasterKey(const QString& name, qlonglong userid, const SessionKeyContext& context, const QString& givenMasterKey)
 {
     QString masterKey(givenMasterKey);
     if(masterKey.isEmpty())
         masterKey = generateRandomString(AESKEY_LENGTH);
 
-    QString encodedKey = AesUtils::encryptMasterKey(password, salt, masterKey);
+    QString encodedKey = context.encryptMasterKey(masterKey);
 
-    QString decoded = AesUtils::decryptMasterKey(password, salt, encodedKey);
+    QString decoded = context.decryptMasterKey(encodedKey);
 
     if(decoded.compare(masterKey) != 0)
         qDebug() << "Wrong encryption. Expected: " << masterKey << " Got: " << decoded;
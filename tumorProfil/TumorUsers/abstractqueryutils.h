@@ -5,6 +5,8 @@
 #include <QPointer>
 #include <QVariant>
 
+class SessionKeyContext;
+
 
 /**
  * @brief The UserDetails class is a container class for storing information
@@ -83,6 +85,8 @@ public:
 
     qlonglong addMasterKey(const QString& name, qlonglong userid, const QString& password, const QString& salt, const QString& masterKey = QString());
 
+    qlonglong addMasterKey(const QString& name, qlonglong userid, const SessionKeyContext& context, const QString& masterKey = QString());
+
     QVector<QVector<QVariant> > retrieveMasterKeys(qlonglong userId);
 
     bool removeUser(int userId, const QString& userName);
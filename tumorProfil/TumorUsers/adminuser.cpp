@@ -51,12 +51,11 @@ void AdminUser::loadKeys()
 {
     d->masterKeys.clear();
     QVector<QVector<QVariant> > result = UserQueryUtils::instance()->retrieveMasterKeys(ADMIN_ID);
+    SessionKeyContext context(d->password, d->adminSalt);
 
     foreach (QVector<QVariant> key, result)
     {
-        QString decryptedKey = AesUtils::decryptMasterKey(d->password,
-                                                            d->adminSalt,
-                                                            key.at(MasterKey::VALUE_FIELD).toString());
+        QString decryptedKey = context.decryptMasterKey(key.at(MasterKey::VALUE_FIELD).toString());
 
         MasterKey mKey(key.at(MasterKey::NAME_FIELD).toString(),
                        decryptedKey);
@@ -92,9 +92,12 @@ QString AesUtils::deriveKey(QString password, QString salt)
 
     memset(derived_key,0, AESKEY_LENGTH);
     byte purpose = 2;
-    const byte* passwordData = (byte*)password.toLocal8Bit().constData();
+    // keep the encoded data alive while it is used
+    const QByteArray localPassword = password.toLocal8Bit();
+    const byte* passwordData = (const byte*)localPassword.constData();
 
-    const byte* saltData = (byte*)salt.toLocal8Bit().constData();
+    const QByteArray localSalt = salt.toLocal8Bit();
+    const byte* saltData = (const byte*)localSalt.constData();
     PKCS5_PBKDF2_HMAC<SHA256> pbkdf;
 
     pbkdf.DeriveKey (derived_key,AESKEY_LENGTH,
@@ -112,19 +115,35 @@ QString AesUtils::deriveKey(QString password, QString salt)
 
 QString AesUtils::encryptMasterKey(QString password, QString filling, QString masterKey)
 {
+    return SessionKeyContext(password, filling).encryptMasterKey(masterKey);
+}
 
-    QString myAesKey = deriveKey(password, filling);
+QString AesUtils::decryptMasterKey(QString password, QString filling, QString masterHash)
+{
+    return SessionKeyContext(password, filling).decryptMasterKey(masterHash);
+}
 
-    qDebug() << "MyAESkey for encryption: " << myAesKey << " " << myAesKey.size();
-    return AesUtils::encrypt(masterKey, myAesKey);
+SessionKeyContext::SessionKeyContext()
+{
 }
 
-QString AesUtils::decryptMasterKey(QString password, QString filling, QString masterHash)
+SessionKeyContext::SessionKeyContext(const QString& password, const QString& salt)
+    : derivedKey(AesUtils::deriveKey(password, salt))
 {
+}
 
-    QString myAesKey = deriveKey(password, filling);
+bool SessionKeyContext::isNull() const
+{
+    return derivedKey.isNull();
+}
+
+QString SessionKeyContext::encryptMasterKey(const QString& masterKey) const
+{
+    return AesUtils::encrypt(masterKey, derivedKey);
+}
 
-    qDebug() << "MyAESkey for decryption: " << myAesKey << " " << myAesKey.size();
-    return AesUtils::decrypt(masterHash, myAesKey);
+QString SessionKeyContext::decryptMasterKey(const QString& masterHash) const
+{
+    return AesUtils::decrypt(masterHash, derivedKey);
 }
 
@@ -5,6 +5,8 @@
 
 #include <QString>
 
+class SessionKeyContext;
+
 class AesUtils
 {
 public:
@@ -19,7 +21,29 @@ public:
     static QString decrypt(QString message, QString aesKey);
 
 private:
+    friend class SessionKeyContext;
     static QString deriveKey(QString password, QString salt);
 };
 
+/**
+ * @brief The SessionKeyContext class holds the key derived from a user's password and salt.
+ *        Deriving the key (PBKDF2) is the expensive step, so derive it once per login
+ *        and encrypt or decrypt all master keys of the user with the same context.
+ */
+class SessionKeyContext
+{
+public:
+    SessionKeyContext();
+    SessionKeyContext(const QString& password, const QString& salt);
+
+    bool isNull() const;
+
+    QString encryptMasterKey(const QString& masterKey) const;
+
+    QString decryptMasterKey(const QString& masterHash) const;
+
+private:
+    QString derivedKey;
+};
+
 #endif // AESUTILS_H
@@ -15,6 +15,7 @@
 #include "ui/logininfowidget.h"
 #include "settings/databasesettings.h"
 #include "settings/mainsettings.h"
+#include "patientmanager.h"
 #include "authentication/accessmanagement.h"
 
 
@@ -115,10 +116,13 @@ bool UserInformation::logOut()
     {
         return false;
     }
+    // queued writes are encrypted with the keys of this session
+    PatientManager::instance()->flush();
     d->userName.clear();
     d->password.clear();
     d->decryptionKey.clear();
     d->permissions.clear();
+    TumorQueryUtils::instance()->clearSessionKey();
     d->isLoggedIn = false;
     LoginInfoWidget::instance()->logOutUpdate();
     emit signalLoginStateChanged();
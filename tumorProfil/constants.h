@@ -38,6 +38,7 @@
 
 #define DB_ENCRYPTED "DBEncrypted"
 #define DB_ABOUT_TO_BE_ENCRYPTED "DBAboutToBeEncrypted"
+#define DB_BLIND_INDEX_COMPLETE "PatientBlindIndexComplete"
 
 #endif // CONSTANTS_H
 
@@ -20,6 +20,7 @@
  * ============================================================ */
 
 #include <QDebug>
+#include <QMutexLocker>
 
 #include "databaseconstants.h"
 #include "disease.h"
@@ -186,3 +187,15 @@ void Disease::setHistoryToProperties(const DiseaseHistory& history)
 {
     diseaseProperties.setProperty(DiseasePropertyName::diseaseHistory(), history.toXml());
 }
+
+void Disease::invalidateDerivedData() const
+{
+    derived.clear();
+}
+
+void DiseaseDerivedData::clear()
+{
+    QMutexLocker lock(&mutex);
+    completeness.clear();
+    combinedValues.clear();
+}
@@ -26,7 +26,11 @@
 
 #include <QList>
 #include <QDate>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
 #include <QSharedPointer>
+#include <QVariant>
 
 // Local includes
 
@@ -34,6 +38,29 @@
 #include "pathology.h"
 #include "tnm.h"
 
+class ResultCompleteness;
+
+/**
+  Data derived from the pathologies of a disease, computed on demand.
+  It is not copied with the disease, because a copy may be modified independently.
+  Access is guarded by the mutex; do not hold it while computing.
+  */
+class DiseaseDerivedData
+{
+public:
+
+    DiseaseDerivedData() {}
+    DiseaseDerivedData(const DiseaseDerivedData&) {}
+    DiseaseDerivedData& operator=(const DiseaseDerivedData&) { clear(); return *this; }
+
+    void clear();
+
+    QMutex mutex;
+    QSharedPointer<const ResultCompleteness> completeness;
+    /// Results of CombinedValue::combine, see CombinedValue::cacheKey()
+    QHash<int, QPair<QVariant, Property> >   combinedValues;
+};
+
 class Disease
 {
 public:
@@ -98,6 +125,14 @@ public:
 
     DiseaseHistory historyFromProperties() const;
     void setHistoryToProperties(const DiseaseHistory& history);
+
+    /**
+      Data derived from the pathologies, computed on demand.
+      Call invalidateDerivedData() when the pathologies were changed.
+      */
+    mutable DiseaseDerivedData derived;
+
+    void invalidateDerivedData() const;
 };
 
 #endif // DISEASE_H
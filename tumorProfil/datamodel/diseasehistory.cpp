@@ -39,6 +39,7 @@
 #include "diseasehistory.h"
 #include "xmlstreamutils.h"
 #include "xmltextintmapper.h"
+#include "tracing.h"
 
 class DiseaseHistory::Private : public QSharedData
 {
@@ -784,6 +785,7 @@ static QString fromNumber(int i)
 
 DiseaseHistory DiseaseHistory::fromEvents(const QList<Event>& events)
 {
+    TRACE_SPAN("DiseaseHistory::fromEvents");
     DiseaseHistory h;
 
     if (events.isEmpty())
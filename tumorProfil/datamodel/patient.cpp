@@ -25,6 +25,7 @@
 #include "authentication//userinformation.h"
 #include "TumorUsers/aesutils.h"
 #include "constants.h"
+#include "tracing.h"
 
 Patient::Patient()
     : gender(UnknownGender),
@@ -123,6 +124,7 @@ bool Patient::encrypt()
 
 bool Patient::decrypt()
 {
+    TRACE_SPAN("Patient::decrypt");
     if(!UserInformation::instance()->isEncryptionEnabled())
     {
         // We still need to get the date from encrypted date
@@ -8,6 +8,7 @@
 #include <QApplication>
 #include <QMessageBox>
 #include <QSqlQuery>
+#include <QtConcurrent/QtConcurrentMap>
 
 #include "TumorUsers/aesutils.h"
 #include "databaseaccess.h"
@@ -19,6 +20,9 @@
 
 #define DATABASE_CONNECTION_NAME "TumorUserConnection"
 
+// From this number of master keys on, they are decrypted concurrently
+#define CONCURRENT_DECRYPTION_THRESHOLD 16
+
 QPointer<TumorQueryUtils> TumorQueryUtils::internalPtr = QPointer<TumorQueryUtils>();
 
 
@@ -30,6 +34,45 @@ public:
     {
     }
     DatabaseAccess *usersAccess;
+
+    // The key derived at the last login, kept for re-authentication of the same user.
+    // The stored password hash identifies the password which was verified against it.
+    QString           sessionUserName;
+    QString           sessionSalt;
+    QByteArray        sessionPasswordHash;
+    SessionKeyContext sessionKey;
+
+    SessionKeyContext sessionKeyFor(const QString& userName, const QString& salt,
+                                    const QByteArray& passwordHash, const QString& password)
+    {
+        if (sessionKey.isNull() || userName != sessionUserName
+                || salt != sessionSalt || passwordHash != sessionPasswordHash)
+        {
+            sessionKey          = SessionKeyContext(password, salt);
+            sessionUserName     = userName;
+            sessionSalt         = salt;
+            sessionPasswordHash = passwordHash;
+        }
+        return sessionKey;
+    }
+};
+
+class MasterKeyDecryption
+{
+public:
+    typedef QString result_type;
+
+    MasterKeyDecryption(const SessionKeyContext& context)
+        : context(context)
+    {
+    }
+
+    QString operator()(const QString& masterHash) const
+    {
+        return context.decryptMasterKey(masterHash);
+    }
+
+    SessionKeyContext context;
 };
 
 TumorQueryUtils* TumorQueryUtils::instance()
@@ -135,16 +178,48 @@ UserDetails TumorQueryUtils::retrieveUser(const QString& name, const QString& pa
         details.userSalt = salt;
         QVector<QVector<QVariant> > keys = retrieveMasterKeys(data.first().at(USERID_INDEX).toInt());
 
-        foreach(QVector<QVariant> key, keys)
+        // Derive once, not per master key
+        SessionKeyContext context = d->sessionKeyFor(details.userName, salt,
+                                                     data.first().at(PASSWORD_HASH_INDEX).toByteArray(),
+                                                     password);
+        QStringList masterHashes;
+        foreach(const QVector<QVariant>& key, keys)
+        {
+            masterHashes << key.at(KEY_CONTENT_INDEX).toString();
+        }
+        QStringList decryptedKeys = decryptMasterKeys(context, masterHashes);
+        for (int i=0; i<keys.size(); i++)
         {
-            QString decryptedKey = AesUtils::decryptMasterKey(password, salt, key.at(KEY_CONTENT_INDEX).toString());
-            details.decryptionKeys.insert(key.at(KEY_NAME_INDEX).toString(), decryptedKey);
+            details.decryptionKeys.insert(keys.at(i).at(KEY_NAME_INDEX).toString(), decryptedKeys.at(i));
         }
     }
 
     return details;
 }
 
+QStringList TumorQueryUtils::decryptMasterKeys(const SessionKeyContext& context, const QStringList& masterHashes)
+{
+    if (masterHashes.size() >= CONCURRENT_DECRYPTION_THRESHOLD)
+    {
+        return QtConcurrent::blockingMapped<QStringList>(masterHashes, MasterKeyDecryption(context));
+    }
+    QStringList decrypted;
+    MasterKeyDecryption decryption(context);
+    foreach (const QString& masterHash, masterHashes)
+    {
+        decrypted << decryption(masterHash);
+    }
+    return decrypted;
+}
+
+void TumorQueryUtils::clearSessionKey()
+{
+    d->sessionKey = SessionKeyContext();
+    d->sessionUserName.clear();
+    d->sessionSalt.clear();
+    d->sessionPasswordHash.clear();
+}
+
 bool TumorQueryUtils::verifyPassword(const QString &password , const QVector<QVector<QVariant> > &result)
 {
     QString saltedPass(password + result.first().at(PASSWORD_SALT_INDEX).toString());
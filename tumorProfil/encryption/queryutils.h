@@ -3,11 +3,13 @@
 #include <QObject>
 
 #include <QMap>
+#include <QStringList>
 #include "databaseparameters.h"
 #include "TumorUsers/abstractqueryutils.h"
 
 
 class QSqlDatabase;
+class SessionKeyContext;
 
 
 class TumorQueryUtils : public AbstractQueryUtils
@@ -33,6 +35,12 @@ public:
 
     UserDetails retrieveUser(const QString& name, const QString& password);
 
+    /// Decrypts the master keys with the context, concurrently if there are many
+    static QStringList decryptMasterKeys(const SessionKeyContext& context, const QStringList& masterHashes);
+
+    /// Forgets the key derived at the last retrieveUser
+    void clearSessionKey();
+
     bool verifyPassword(const QString& password , const QVector<QVector<QVariant> >& result);
 
     virtual QueryState executeSql(const QString& queryString, QMap<QString,
@@ -41,8 +41,12 @@
 // Local includes
 
 #include "databaseaccess.h"
+#include "databaseexport.h"
+#include "databasemigrator.h"
+#include "databaseprofiler.h"
 #include "analysisgenerator.h"
 #include "csvconverter.h"
+#include "exportspec.h"
 #include "databaseparameters.h"
 #include "ihcscore.h"
 #include <iostream>
@@ -59,11 +63,47 @@
 #include "settings/mainsettings.h"
 #include "encryption/authenticationwindow.h"
 #include "authentication//userinformation.h"
+#include "securityjournal.h"
+#include "tracing.h"
 
 
+static int securityJournalTool(const QString& journalPath, int patientId, const QString& restoreDir)
+{
+    SecurityJournal journal(journalPath);
+    int chunks, entryCount;
+    const bool ok = journal.verify(&chunks, &entryCount);
+    std::cout << entryCount << " Einträge in " << chunks << " Blöcken" << (ok ? "" : ", Datei beschädigt") << std::endl;
+
+    QDir dir(restoreDir);
+    if (!restoreDir.isEmpty() && !dir.exists() && !QDir().mkpath(restoreDir))
+    {
+        std::cerr << "Verzeichnis kann nicht angelegt werden: " << restoreDir.toLocal8Bit().constData() << std::endl;
+        return 1;
+    }
+
+    foreach (const SecurityJournalEntry& entry, journal.entries(patientId))
+    {
+        std::cout << entry.patientId << '\t' << entry.time.toString(Qt::ISODate).toLocal8Bit().constData()
+                  << '\t' << entry.type.toLocal8Bit().constData()
+                  << '\t' << entry.fileName().toLocal8Bit().constData() << std::endl;
+        if (!restoreDir.isEmpty())
+        {
+            QFile f(dir.filePath(entry.fileName()));
+            if (!f.open(QIODevice::WriteOnly | QIODevice::Text))
+            {
+                std::cerr << "Datei kann nicht geschrieben werden: " << f.fileName().toLocal8Bit().constData() << std::endl;
+                return 1;
+            }
+            f.write(entry.value.toUtf8());
+        }
+    }
+    return ok ? 0 : 1;
+}
+
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
+    Tracing::enableFromEnvironment();
 
     QCoreApplication::setOrganizationName("Innere Klinik (Tumorforschung)");
     QCoreApplication::setApplicationName("Tumorprofil");
@@ -82,9 +122,45 @@ int main(int argc, char *argv[])
     parser.addOption(historyReadOption);
     QCommandLineOption reportOption("report", QObject::tr("Öffne Fenster zur Datenabfrage"));
     parser.addOption(reportOption);
+    QCommandLineOption exportSpecOption("export-spec", QObject::tr("Erzeuge die in der Datei spezifizierten Exporte und beende"), QObject::tr("Datei"));
+    parser.addOption(exportSpecOption);
+    QCommandLineOption exportDatabaseOption("export-database", QObject::tr("Exportiere die gesamte Datenbank in die Datei (CSV bei Endung .csv, sonst spaltenweise binär) und beende"), QObject::tr("Datei"));
+    parser.addOption(exportDatabaseOption);
+    QCommandLineOption migrateOption("migrate-from", QObject::tr("Übertrage die SQLite-Datenbank in die konfigurierte, leere Datenbank und beende"), QObject::tr("Datei"));
+    parser.addOption(migrateOption);
+    QCommandLineOption sqlProfileOption("sql-profile", QObject::tr("Schreibe beim Beenden eine SQL-Statistik als JSON in die Datei"), QObject::tr("Datei"));
+    parser.addOption(sqlProfileOption);
+    QCommandLineOption sqlSlowOption("sql-slow", QObject::tr("Protokolliere SQL-Anfragen, die länger als die angegebene Zeit dauern"), QObject::tr("ms"));
+    parser.addOption(sqlSlowOption);
+    QCommandLineOption traceOption("trace", QObject::tr("Schreibe beim Beenden eine Ablaufverfolgung (Chrome Trace-Format) in die Datei"), QObject::tr("Datei"));
+    parser.addOption(traceOption);
+    QCommandLineOption journalOption("journal", QObject::tr("Prüfe das Sicherungsjournal und liste die Einträge auf, dann beende"), QObject::tr("Datei"));
+    parser.addOption(journalOption);
+    QCommandLineOption journalPatientOption("journal-patient", QObject::tr("Nur Einträge des Patienten mit dieser ID (mit --journal)"), QObject::tr("ID"));
+    parser.addOption(journalPatientOption);
+    QCommandLineOption journalRestoreOption("journal-restore", QObject::tr("Schreibe die Einträge als einzelne Dateien in das Verzeichnis (mit --journal)"), QObject::tr("Verzeichnis"));
+    parser.addOption(journalRestoreOption);
 
     parser.process(app);
 
+    if (parser.isSet(sqlProfileOption))
+    {
+        DatabaseProfiler::instance()->setDumpFile(parser.value(sqlProfileOption));
+    }
+    if (parser.isSet(sqlSlowOption))
+    {
+        DatabaseProfiler::instance()->setSlowQueryThreshold(parser.value(sqlSlowOption).toInt());
+    }
+    if (parser.isSet(traceOption))
+    {
+        Tracing::enable(parser.value(traceOption));
+    }
+    if (parser.isSet(journalOption))
+    {
+        const int patientId = parser.isSet(journalPatientOption) ? parser.value(journalPatientOption).toInt() : -1;
+        return securityJournalTool(parser.value(journalOption), patientId, parser.value(journalRestoreOption));
+    }
+
     DatabaseParameters params;
     params.readFromConfig();
     if(params.isMySQL())
@@ -99,11 +175,39 @@ int main(int argc, char *argv[])
         DatabaseAccess::setParameters(params);
     }
 
+    if (parser.isSet(migrateOption))
+    {
+        // before initialize(), which would create the indices in the target
+        DatabaseMigrator migrator;
+        int total = 0;
+        QObject::connect(&migrator, &DatabaseMigrator::progressStarted, [&total](int max) { total = max; });
+        QObject::connect(&migrator, &DatabaseMigrator::progressValue, [&total](int value)
+        {
+            std::cout << "\r" << (total ? qint64(value) * 100 / total : 100) << " %" << std::flush;
+        });
+        const bool success = migrator.migrate(DatabaseParameters::parametersForSQLite(parser.value(migrateOption)),
+                                              DatabaseAccess::parameters());
+        std::cout << std::endl;
+        if (!success)
+        {
+            std::cerr << migrator.lastError().toLocal8Bit().constData() << std::endl;
+        }
+        return success ? 0 : 1;
+    }
+
     if (!PatientManager::instance()->initialize())
     {
         return 1;
     }
 
+    if (parser.isSet(exportDatabaseOption))
+    {
+        // streams from the database, PatientManager is not loaded
+        const QString filePath = parser.value(exportDatabaseOption);
+        DatabaseExport exporter;
+        return exporter.run(filePath, DatabaseExport::formatForFile(filePath)) ? 0 : 1;
+    }
+
     {
         QFutureWatcher<void> watcher;
         QProgressDialog progressDialog;
@@ -116,6 +220,16 @@ int main(int argc, char *argv[])
         progressDialog.exec();
     }
 
+    if (parser.isSet(exportSpecOption))
+    {
+        ExportSpecRunner runner;
+        if (!runner.run(ExportSpec::load(parser.value(exportSpecOption)), PatientManager::instance()->patients()))
+        {
+            return 1;
+        }
+        return 0;
+    }
+
     /*
     AnalysisGenerator generator;
     generator.ros1Project();
@@ -20,39 +20,111 @@
  * ============================================================ */
 
 #include "actionableresultchecker.h"
+
+#include <algorithm>
+
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QStringList>
+#include <QThread>
+#include <QtConcurrent/QtConcurrent>
+
 #include "combinedvalue.h"
 #include "dataaggregator.h"
 #include "disease.h"
 #include "pathology.h"
 
-ActionableResultChecker::ActionableResultChecker(const Patient::Ptr& p, Flags flags)
-    : p(p), flags(flags)
+Q_STATIC_ASSERT(PathologyPropertyInfo::LastProperty < 64);
+
+static inline ActionableCombinations::Mask bit(int property)
 {
-    if (!p->hasDisease())
+    return ActionableCombinations::Mask(1) << property;
+}
+
+static QVector<PathologyPropertyInfo> createPropertyInfos()
+{
+    QVector<PathologyPropertyInfo> infos(PathologyPropertyInfo::LastProperty + 1);
+    for (int i=PathologyPropertyInfo::FirstProperty; i<=PathologyPropertyInfo::LastProperty; i++)
     {
-        return;
+        infos[i] = PathologyPropertyInfo::info(PathologyPropertyInfo::Property(i));
     }
-    fillFields(p->firstDisease());
+    return infos;
 }
 
-void ActionableResultChecker::checkFields(const Disease& disease,
-                                          QList<PathologyPropertyInfo> &actionableFields,
-                                          QList<PathologyPropertyInfo> fieldsToCheck,
-                                          bool valueToCheck)
+/// The infos of all properties, indexed by property. Created only once, info() is not cheap.
+static const QVector<PathologyPropertyInfo>& propertyInfos()
 {
-    foreach (const PathologyPropertyInfo& field, fieldsToCheck)
+    static const QVector<PathologyPropertyInfo> infos = createPropertyInfos();
+    return infos;
+}
+
+QString ActionableCombinations::label(int i) const
+{
+    QStringList titles;
+    foreach (const PathologyPropertyInfo& info, combination(i))
     {
-        foreach (const Property& prop, fields(field, disease))
+        titles << info.plainTextLabel();
+    }
+    if (titles.isEmpty())
+    {
+        titles << "Kein relevanter Befund";
+    }
+    return titles.join(", ");
+}
+
+QMap<AggregatedDatumInfo, QVariant> ActionableCombinations::values(int i) const
+{
+    return DataAggregator::booleanValues(m_counts[i].positive, m_counts[i].negative);
+}
+
+ActionableCombinations::Mask ActionableCombinations::maskFor(const QList<PathologyPropertyInfo>& combination)
+{
+    Mask mask = 0;
+    foreach (const PathologyPropertyInfo& info, combination)
+    {
+        mask |= bit(info.property);
+    }
+    return mask;
+}
+
+QList<PathologyPropertyInfo> ActionableCombinations::combinationFor(Mask mask)
+{
+    QList<PathologyPropertyInfo> combination;
+    for (int i=PathologyPropertyInfo::FirstProperty; mask && i<=PathologyPropertyInfo::LastProperty; i++)
+    {
+        if (mask & bit(i))
         {
-            ValueTypeCategoryInfo valueType(field);
-            bool isPositive = DataAggregator::isPositive(field, valueType.toMedicalValue(prop));
-            if (isPositive == valueToCheck)
-            {
-                actionableFields << field;
-                break;
-            }
+            combination << propertyInfos()[i];
+            mask &= ~bit(i);
         }
     }
+    return combination;
+}
+
+bool ActionableCombinations::lessThan(Mask a, Mask b)
+{
+    const uint sizeA = qPopulationCount(a);
+    const uint sizeB = qPopulationCount(b);
+    if (sizeA != sizeB)
+    {
+        return sizeA < sizeB;
+    }
+    // Comparing the sorted property lists, the first difference is at the lowest differing bit
+    const Mask difference = a ^ b;
+    return a & difference & (~difference + 1);
+}
+
+ActionableResultChecker::ActionableResultChecker(const Patient::Ptr& p, Flags flags)
+    : p(p), flags(flags),
+      positiveFields(0), negativeFields(0),
+      evaluatedFields(0), presentFields(0), matchingFields(0)
+{
+    if (!p->hasDisease())
+    {
+        return;
+    }
+    fillFields(p->firstDisease());
 }
 
 QList<Property> ActionableResultChecker::fields(const PathologyPropertyInfo& info,
@@ -72,20 +144,15 @@ QList<Property> ActionableResultChecker::fields(const PathologyPropertyInfo& inf
     return disease.pathologyProperties(info.id);
 }
 
-void ActionableResultChecker::fillFields(const Disease &disease)
+static ActionableCombinations::Mask generalPositiveFields(ActionableResultChecker::Flags flags)
 {
-    positiveFields << PathologyPropertyInfo::Comb_cMetActivation
-                   << PathologyPropertyInfo::Comb_HER2;
-
-    if (flags & IncludePTEN)
-    {
-        negativeFields << PathologyPropertyInfo::IHC_PTEN;
-    }
+    ActionableCombinations::Mask fields = bit(PathologyPropertyInfo::Comb_cMetActivation)
+                                        | bit(PathologyPropertyInfo::Comb_HER2);
 
     QList<PathologyPropertyInfo> alwaysActionable = PathologyPropertyInfo::allMutations() + PathologyPropertyInfo::allFish();
     foreach (const PathologyPropertyInfo& info, alwaysActionable)
     {
-        if (!(flags & IncludeRAS))
+        if (!(flags & ActionableResultChecker::IncludeRAS))
         {
             if (info.property == PathologyPropertyInfo::Mut_KRAS_2 ||
                 info.property == PathologyPropertyInfo::Mut_KRAS_3 ||
@@ -96,14 +163,43 @@ void ActionableResultChecker::fillFields(const Disease &disease)
                 continue;
             }
         }
-        if (!(flags & IncludeP53))
+        if (!(flags & ActionableResultChecker::IncludeP53))
         {
             if (info.property == PathologyPropertyInfo::Mut_TP53)
             {
                 continue;
             }
         }
-        positiveFields << info.property;
+        fields |= bit(info.property);
+    }
+    return fields;
+}
+
+static ActionableCombinations::Mask receptorStatusFields()
+{
+    return bit(PathologyPropertyInfo::IHC_ER)
+         | bit(PathologyPropertyInfo::IHC_PR)
+         | bit(PathologyPropertyInfo::Comb_HER2);
+}
+
+void ActionableResultChecker::fillFields(const Disease &disease)
+{
+    // computed once per set of flags
+    static QHash<int, Mask> cache;
+    static QMutex cacheMutex;
+    {
+        QMutexLocker lock(&cacheMutex);
+        QHash<int, Mask>::const_iterator it = cache.constFind(flags);
+        if (it == cache.constEnd())
+        {
+            it = cache.insert(flags, generalPositiveFields(flags));
+        }
+        positiveFields = it.value();
+    }
+
+    if (flags & IncludePTEN)
+    {
+        negativeFields |= bit(PathologyPropertyInfo::IHC_PTEN);
     }
 
     switch (disease.entity())
@@ -118,141 +214,249 @@ void ActionableResultChecker::fillFields(const Disease &disease)
     case Pathology::Breast:
         if (flags & IncludeReceptorStatus)
         {
-            positiveFields << PathologyPropertyInfo::IHC_ER
-                           << PathologyPropertyInfo::IHC_PR
-                           << PathologyPropertyInfo::Comb_HER2;
+            positiveFields |= receptorStatusFields();
         }
     default:
         break;
     }
 }
 
-QList<PathologyPropertyInfo> ActionableResultChecker::actionableResults()
+ActionableResultChecker::Mask ActionableResultChecker::candidateFields(Flags flags)
 {
-    QList<PathologyPropertyInfo> actionableFields;
-    if (!p->hasDisease())
+    Mask fields = generalPositiveFields(flags);
+    if (flags & IncludeReceptorStatus)
     {
-        return actionableFields;
+        fields |= receptorStatusFields();
     }
-    const Disease& disease = p->firstDisease();
-    checkFields(disease, actionableFields, positiveFields, true);
-    checkFields(disease, actionableFields, negativeFields, false);
-    qSort(actionableFields);
-    return actionableFields;
+    if (flags & IncludePTEN)
+    {
+        fields |= bit(PathologyPropertyInfo::IHC_PTEN);
+    }
+    return fields;
 }
 
-QVariant ActionableResultChecker::hasResults(const QList<PathologyPropertyInfo>& combination)
+void ActionableResultChecker::evaluate(Mask fieldsToEvaluate)
 {
-    if (!p->hasDisease())
+    fieldsToEvaluate &= ~evaluatedFields;
+    if (!fieldsToEvaluate || !p->hasDisease())
     {
-        return false;
-    }
-    if (combination.isEmpty())
-    {
-        // return true if patient has no actionable results
-        return actionableResults().isEmpty();
+        return;
     }
+    evaluatedFields |= fieldsToEvaluate;
 
     const Disease& disease = p->firstDisease();
-    int hasFields = 0;
-    int matches   = 0;
-    foreach (const PathologyPropertyInfo& field, combination)
+    for (int i=PathologyPropertyInfo::FirstProperty; fieldsToEvaluate && i<=PathologyPropertyInfo::LastProperty; i++)
     {
-        bool valueToCheck = positiveFields.contains(field);
-        bool hasField = false;
-        bool match   = false;
+        const Mask fieldBit = bit(i);
+        if (!(fieldsToEvaluate & fieldBit))
+        {
+            continue;
+        }
+        fieldsToEvaluate &= ~fieldBit;
+
+        const PathologyPropertyInfo& field = propertyInfos()[i];
+        const bool valueToCheck = positiveFields & fieldBit;
+        ValueTypeCategoryInfo valueType(field);
         foreach (const Property& prop, fields(field, disease))
         {
-            hasField = true;
-            ValueTypeCategoryInfo valueType(field);
+            presentFields |= fieldBit;
             bool isPositive = DataAggregator::isPositive(field, valueType.toMedicalValue(prop));
             if (isPositive == valueToCheck)
             {
-                match = true;
+                matchingFields |= fieldBit;
                 break;
             }
         }
-        if (hasField)
-            hasFields++;
-        if (match)
-            matches++;
     }
+}
+
+ActionableResultChecker::Mask ActionableResultChecker::actionableResultsMask()
+{
+    const Mask candidates = positiveFields | negativeFields;
+    evaluate(candidates);
+    return matchingFields & candidates;
+}
+
+QList<PathologyPropertyInfo> ActionableResultChecker::actionableResults()
+{
+    return ActionableCombinations::combinationFor(actionableResultsMask());
+}
+
+QVariant ActionableResultChecker::hasResults(const QList<PathologyPropertyInfo>& combination)
+{
+    return hasResults(ActionableCombinations::maskFor(combination));
+}
+
+QVariant ActionableResultChecker::hasResults(Mask combination)
+{
+    if (!p->hasDisease())
+    {
+        return false;
+    }
+    if (!combination)
+    {
+        // return true if patient has no actionable results
+        return actionableResultsMask() == 0;
+    }
+
+    evaluate(combination);
     // None of the fields in the combination were found: Return null
     // Less strict: If we have at least one field, we count for the total
     //if (!hasFields)
     // More strict: Count for total only of all fields are available
-    if (hasFields < combination.size())
+    if (combination & ~presentFields)
     {
         return QVariant();
     }
-    // If at least one of the fields is found, we return a value
-    return matches == combination.size();
+    return (combination & ~matchingFields) == 0;
 }
 
-static bool operator<(const QList<PathologyPropertyInfo>& a,
-                      const QList<PathologyPropertyInfo>& b)
+/**
+  The result of one patient for all combinations.
+  Patients with the same masks are counted together.
+  */
+class PatientResultMasks
 {
-    if (a.size() == b.size())
+public:
+
+    PatientResultMasks()
+        : hasDisease(false), actionable(0), present(0), matching(0)
+    {
+    }
+
+    bool operator==(const PatientResultMasks& other) const
+    {
+        return hasDisease == other.hasDisease && actionable == other.actionable
+                && present == other.present && matching == other.matching;
+    }
+
+    /// 1 for true, 0 for false, -1 for null; see ActionableResultChecker::hasResults
+    int result(ActionableCombinations::Mask combination) const
     {
-        const int size = a.size();
-        for (int i=0; i<size; i++)
+        if (!hasDisease)
         {
-            if (a[i] == b[i])
-            {
-                continue;
-            }
-            return a[i] < b[i];
+            return 0;
+        }
+        if (!combination)
+        {
+            return actionable ? 0 : 1;
         }
+        if (combination & ~present)
+        {
+            return -1;
+        }
+        return (combination & ~matching) ? 0 : 1;
     }
-    return a.size() < b.size();
+
+    bool hasDisease;
+    ActionableCombinations::Mask actionable;
+    ActionableCombinations::Mask present;
+    ActionableCombinations::Mask matching;
+};
+
+inline uint qHash(const PatientResultMasks& masks)
+{
+    return qHash(masks.actionable) ^ qHash(masks.present) ^ (qHash(masks.matching) << 1) ^ uint(masks.hasDisease);
 }
 
-QMap< QList<PathologyPropertyInfo>, DataAggregator* > ActionableResultChecker::actionableCombinations(const QList<Patient::Ptr>& patients, Flags flags)
+typedef QHash<PatientResultMasks, int> PatientResultTable;
+
+class ActionableResultsEvaluator
 {
-    QMap< QList<PathologyPropertyInfo>, DataAggregator* > actionableCombinations;
+public:
 
-    // Find out which combinations of actionable results exist
-    foreach (const Patient::Ptr p, patients)
+    typedef PatientResultTable result_type;
+
+    ActionableResultsEvaluator(ActionableResultChecker::Flags flags)
+        : flags(flags), candidates(ActionableResultChecker::candidateFields(flags))
     {
-        ActionableResultChecker checker(p, flags);
-        QList<PathologyPropertyInfo> combination = checker.actionableResults();
-        if (!actionableCombinations.contains(combination))
+    }
+
+    /// Evaluates a chunk of patients into a table local to the calling thread
+    PatientResultTable operator()(const QList<Patient::Ptr>& patients) const
+    {
+        PatientResultTable table;
+        foreach (const Patient::Ptr& p, patients)
         {
-            actionableCombinations.insert(combination, new DataAggregator(DataAggregation::Boolean));
+            ActionableResultChecker checker(p, flags);
+            PatientResultMasks masks;
+            masks.hasDisease = p->hasDisease();
+            masks.actionable = checker.actionableResultsMask();
+            // the combinations of other patients consist of candidate fields
+            checker.evaluate(candidates);
+            masks.present    = checker.presentFields;
+            masks.matching   = checker.matchingFields;
+            table[masks]++;
         }
+        return table;
+    }
+
+    const ActionableResultChecker::Flags flags;
+    const ActionableResultChecker::Mask  candidates;
+};
+
+static void mergeResultTables(PatientResultTable& result, const PatientResultTable& table)
+{
+    for (PatientResultTable::const_iterator it = table.constBegin(); it != table.constEnd(); ++it)
+    {
+        result[it.key()] += it.value();
+    }
+}
+
+ActionableCombinations ActionableResultChecker::actionableCombinations(const QList<Patient::Ptr>& patients, Flags flags)
+{
+    const int chunkSize = qMax(256, patients.size() / (4 * QThread::idealThreadCount()) + 1);
+    QList< QList<Patient::Ptr> > chunks;
+    for (int i=0; i<patients.size(); i+=chunkSize)
+    {
+        chunks << patients.mid(i, chunkSize);
     }
+    const PatientResultTable table =
+            QtConcurrent::blockingMappedReduced<PatientResultTable>(chunks, ActionableResultsEvaluator(flags),
+                                                                    mergeResultTables, QtConcurrent::UnorderedReduce);
+
+    // Find out which combinations of actionable results exist
+    QSet<Mask> seen;
+    for (PatientResultTable::const_iterator it = table.constBegin(); it != table.constEnd(); ++it)
+    {
+        seen << it.key().actionable;
+    }
+    ActionableCombinations combinations;
+    combinations.m_masks = seen.toList().toVector();
+    std::sort(combinations.m_masks.begin(), combinations.m_masks.end(), ActionableCombinations::lessThan);
+    combinations.m_counts.resize(combinations.m_masks.size());
+
     // Aggregate info
-    QMap< QList<PathologyPropertyInfo>,  DataAggregator* >::const_iterator it;
-    foreach (const Patient::Ptr p, patients)
+    for (PatientResultTable::const_iterator it = table.constBegin(); it != table.constEnd(); ++it)
     {
-        ActionableResultChecker checker(p, flags);
+        const int patientCount = it.value();
         // Extra measure: If a patient has a combination of two results, he may fit into three combinations etc.
-        // Give the patient to the last in the list (which has the largest number of properties, see operator< above)
-        QList<DataAggregator*> positiveAggregators;
-        for (it = actionableCombinations.begin(); it != actionableCombinations.end(); ++it)
+        // Give the patient to the last in the list (which has the largest number of properties, see lessThan)
+        int lastPositive = -1;
+        for (int i=0; i<combinations.m_masks.size(); i++)
         {
-            QVariant value = checker.hasResults(it.key());
-            DataAggregator* aggregator = it.value();
-            if (value.toBool())
+            switch (it.key().result(combinations.m_masks[i]))
             {
-                positiveAggregators << aggregator;
-            }
-            else
-            {
-                *aggregator << value;
+            case 1:
+                if (lastPositive != -1)
+                {
+                    // exclusive for double mutants
+                    combinations.m_counts[lastPositive].negative += patientCount;
+                }
+                lastPositive = i;
+                break;
+            case 0:
+                combinations.m_counts[i].negative += patientCount;
+                break;
+            default:
+                // null values are not counted
+                break;
             }
         }
-        if (!positiveAggregators.isEmpty())
+        if (lastPositive != -1)
         {
-            *positiveAggregators.takeLast() << true;
-            foreach (DataAggregator* aggregator, positiveAggregators)
-            {
-                // exclusive for double mutants
-                *aggregator << false;
-                // inclusive for double mutants
-                //*aggregator << true;
-            }
+            combinations.m_counts[lastPositive].positive += patientCount;
         }
     }
-    return actionableCombinations;
+    return combinations;
 }
@@ -23,12 +23,61 @@
 #define ACTIONABLERESULTCHECKER_H
 
 #include <QFlags>
+#include <QMap>
+#include <QVector>
 
 #include <pathologypropertyinfo.h>
 
 #include "patient.h"
 
-class DataAggregator;
+class AggregatedDatumInfo;
+
+/**
+  The aggregated actionable results of a list of patients, see ActionableResultChecker::actionableCombinations.
+  A combination of actionable properties is a bit mask, with bit i set for PathologyPropertyInfo::Property i.
+  Combinations are ordered by number of properties, then by property, as when sorting
+  QList<PathologyPropertyInfo>s by size and content.
+  */
+class ActionableCombinations
+{
+public:
+
+    typedef quint64 Mask;
+
+    class Counts
+    {
+    public:
+
+        Counts() : positive(0), negative(0) {}
+        int total() const { return positive + negative; }
+
+        int positive;
+        int negative;
+    };
+
+    int size() const { return m_masks.size(); }
+    bool isEmpty() const { return m_masks.isEmpty(); }
+
+    Mask mask(int i) const { return m_masks[i]; }
+    const Counts& counts(int i) const { return m_counts[i]; }
+    QList<PathologyPropertyInfo> combination(int i) const { return combinationFor(m_masks[i]); }
+    /// The property labels, or "Kein relevanter Befund" for the empty combination
+    QString label(int i) const;
+    /// The values of a Boolean DataAggregator fed with the counts
+    QMap<AggregatedDatumInfo, QVariant> values(int i) const;
+
+    static Mask maskFor(const QList<PathologyPropertyInfo>& combination);
+    static QList<PathologyPropertyInfo> combinationFor(Mask mask);
+    /// The order of combinations described above
+    static bool lessThan(Mask a, Mask b);
+
+private:
+
+    friend class ActionableResultChecker;
+
+    QVector<Mask>   m_masks;
+    QVector<Counts> m_counts;
+};
 
 class ActionableResultChecker
 {
@@ -44,31 +93,44 @@ public:
     };
     Q_DECLARE_FLAGS(Flags, Flag)
 
+    typedef ActionableCombinations::Mask Mask;
+
     ActionableResultChecker(const Patient::Ptr& p, Flags flags = NoFlags);
 
     QList<PathologyPropertyInfo> actionableResults();
+    Mask actionableResultsMask();
     QVariant hasResults(const QList<PathologyPropertyInfo>& combination);
+    QVariant hasResults(Mask combination);
 
-    // Returns a complex data structure of aggregated actionable results of the given patients.
-    // For all seen combinations of actionable properties (as keys in the map), an aggregator is created
-    // which counts the patients presenting with this combination.
-    // Note that you must delete the DataAggregator objects after usage.
-    static QMap< QList<PathologyPropertyInfo>, DataAggregator* > actionableCombinations(const QList<Patient::Ptr>& patients, Flags flags);
+    /**
+      Returns the aggregated actionable results of the given patients.
+      For all seen combinations of actionable properties, counts the patients presenting with this combination.
+      Patients are evaluated in parallel, each property only once per patient.
+      */
+    static ActionableCombinations actionableCombinations(const QList<Patient::Ptr>& patients, Flags flags);
 
 protected:
 
+    friend class ActionableResultsEvaluator;
+
     void fillFields(const Disease& disease);
-    void checkFields(const Disease& disease,
-                     QList<PathologyPropertyInfo> &actionableFields,
-                     QList<PathologyPropertyInfo> fieldsToCheck,
-                     bool valueToCheck);
+    /// Evaluates the given fields, if not done before
+    void evaluate(Mask fieldsToEvaluate);
     QList<Property> fields(const PathologyPropertyInfo& info, const Disease& disease);
 
+    /// All fields which can be actionable with the given flags, for any entity
+    static Mask candidateFields(Flags flags);
 
     Patient::Ptr const p;
     Flags flags;
-    QList<PathologyPropertyInfo> positiveFields;
-    QList<PathologyPropertyInfo> negativeFields;
+    // fields which are actionable if positive, or if negative
+    Mask positiveFields;
+    Mask negativeFields;
+    // evaluated fields with at least one value, and with a value as expected:
+    // positive for positiveFields, negative for all others
+    Mask evaluatedFields;
+    Mask presentFields;
+    Mask matchingFields;
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(ActionableResultChecker::Flags)
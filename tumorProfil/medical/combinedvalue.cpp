@@ -23,8 +23,10 @@
 
 #include <QDebug>
 #include <QLocale>
+#include <QMutexLocker>
 #include <QRegExp>
 #include <QVector>
+#include <QtConcurrent/QtConcurrent>
 
 // Local includes
 
@@ -182,6 +184,78 @@ void CombinedValue::listOfMutationsResult(const Disease& disease, const QList<Pa
 }
 
 void CombinedValue::combine(const Disease& disease)
+{
+    const int key = cacheKey(info.property, missingValueBehavior);
+    {
+        QMutexLocker lock(&disease.derived.mutex);
+        QHash<int, QPair<QVariant, Property> >::const_iterator it = disease.derived.combinedValues.constFind(key);
+        if (it != disease.derived.combinedValues.constEnd())
+        {
+            resultValue         = it->first;
+            determiningProperty = it->second;
+            return;
+        }
+    }
+
+    // not under the lock: some combined values combine others
+    compute(disease);
+
+    QMutexLocker lock(&disease.derived.mutex);
+    disease.derived.combinedValues.insert(key, qMakePair(resultValue, determiningProperty));
+}
+
+namespace
+{
+
+class CombineAllFunctor
+{
+public:
+
+    CombineAllFunctor(const QList<PathologyPropertyInfo>& infos, CombinedValue::MissingValueBehavior behavior)
+        : infos(infos), behavior(behavior)
+    {
+    }
+
+    void operator()(const Patient::Ptr& p) const
+    {
+        foreach (const Disease& disease, p->diseases)
+        {
+            foreach (const PathologyPropertyInfo& info, infos)
+            {
+                CombinedValue combinedValue(info);
+                combinedValue.setMissingValueBehavior(behavior);
+                combinedValue.combine(disease);
+            }
+        }
+    }
+
+    const QList<PathologyPropertyInfo>        infos;
+    const CombinedValue::MissingValueBehavior behavior;
+};
+
+}
+
+void CombinedValue::combineAll(const QList<Patient::Ptr>& patients, const QList<PathologyPropertyInfo>& infos,
+                               MissingValueBehavior behavior)
+{
+    QList<PathologyPropertyInfo> combinedInfos;
+    foreach (const PathologyPropertyInfo& info, infos)
+    {
+        if (info.isCombined())
+        {
+            combinedInfos << info;
+        }
+    }
+    if (combinedInfos.isEmpty() || patients.isEmpty())
+    {
+        return;
+    }
+    // Each patient is handled by one thread; the diseases are shared with the caller, not copied
+    QList<Patient::Ptr> list = patients;
+    QtConcurrent::blockingMap(list, CombineAllFunctor(combinedInfos, behavior));
+}
+
+void CombinedValue::compute(const Disease& disease)
 {
     resultValue = QVariant();
     determiningProperty = Property();
@@ -24,6 +24,7 @@
 
 #include "pathologypropertyinfo.h"
 #include "disease.h"
+#include "patient.h"
 #include "property.h"
 
 class CombinedValue
@@ -45,6 +46,10 @@ public:
 
     void setMissingValueBehavior(MissingValueBehavior behavior);
 
+    /**
+      Combines the values of the disease. The result is cached per disease, info and missing value behavior,
+      until the pathologies change (Disease::invalidateDerivedData()).
+      */
     void combine(const Disease& disease);
     Property result() const;
     // If result is positive, contains - if there is such - the property that determined the positiveness.
@@ -59,8 +64,23 @@ public:
     // additionally retrieves the property
     QVariant fishResult(const Disease& disease);
 
+    /**
+      Combines the given infos for all diseases of the patients in one parallel pass,
+      so that later calls to combine() are served from the cache. Infos which are not combined are ignored.
+      */
+    static void combineAll(const QList<Patient::Ptr>& patients, const QList<PathologyPropertyInfo>& infos,
+                           MissingValueBehavior behavior = StrictMissingValueBehavior);
+
+    /// The key of a result in DiseaseDerivedData::combinedValues
+    static int cacheKey(PathologyPropertyInfo::Property property, MissingValueBehavior behavior)
+    {
+        return (int(property) << 1) | int(behavior);
+    }
+
 protected:
 
+    void compute(const Disease& disease);
+
     void listOfMutationsResult(const Disease& disease, const QList<PathologyPropertyInfo::Property>& propIds, const QList<PathologyPropertyInfo::Property>& criticalIds);
 
     QVariant resultValue;
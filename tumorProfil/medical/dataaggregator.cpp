@@ -451,20 +451,25 @@ QVariant DataAggregator::aggregate(const AggregatedDatumInfo& datumInfo,
             break;
         }
     }
-    switch (datumInfo.valueType)
+    return countValue(datumInfo.valueType, aggregate, total);
+}
+
+QVariant DataAggregator::countValue(AggregatedDatumInfo::ValueType valueType, int count, int total)
+{
+    switch (valueType)
     {
     case AggregatedDatumInfo::AbsoluteValue:
-        return aggregate;
+        return count;
     case AggregatedDatumInfo::PercentageValue:
-        return double(aggregate)/double(total);
+        return double(count)/double(total);
     case AggregatedDatumInfo::ConfidenceUpper:
     case AggregatedDatumInfo::ConfidenceLower:
     {
         ConfidenceInterval ci;
-        ci.setEvents(aggregate);
+        ci.setEvents(count);
         ci.setObservations(total);
         QPair<double,double> ciValues = ci.binomial();
-        return (datumInfo.valueType == AggregatedDatumInfo::ConfidenceLower) ? ciValues.first : ciValues.second;
+        return (valueType == AggregatedDatumInfo::ConfidenceLower) ? ciValues.first : ciValues.second;
     }
     case AggregatedDatumInfo::InvalidValue:
         break;
@@ -472,6 +477,36 @@ QVariant DataAggregator::aggregate(const AggregatedDatumInfo& datumInfo,
     return QVariant();
 }
 
+QMap<AggregatedDatumInfo, QVariant> DataAggregator::booleanValues(int positive, int negative)
+{
+    QMap<AggregatedDatumInfo, QVariant> result;
+    const int total = positive + negative;
+    foreach (const AggregatedDatumInfo& info, AggregatedDatumInfo::fieldsFromNature(DataAggregation::Boolean))
+    {
+        if (!total)
+        {
+            result[info] = QVariant();
+            continue;
+        }
+        switch (info.field)
+        {
+        case AggregatedDatumInfo::Count:
+            result[info] = total;
+            break;
+        case AggregatedDatumInfo::Positive:
+            result[info] = countValue(info.valueType, positive, total);
+            break;
+        case AggregatedDatumInfo::Negative:
+            result[info] = countValue(info.valueType, negative, total);
+            break;
+        default:
+            result[info] = QVariant();
+            break;
+        }
+    }
+    return result;
+}
+
 bool DataAggregator::isCountedAs(const Property& prop, const AggregatedDatumInfo& datumInfo) const
 {
     if (!prop.isValid())
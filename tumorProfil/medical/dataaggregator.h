@@ -107,8 +107,13 @@ public:
 
     static bool isPositive(const PathologyPropertyInfo& info,
                            const QVariant& medicalValue);
+    /// Returns the values() of a Boolean aggregator fed with the given number of true and false values
+    static QMap<AggregatedDatumInfo, QVariant> booleanValues(int positive, int negative);
+
 protected:
 
+    static QVariant countValue(AggregatedDatumInfo::ValueType valueType, int count, int total);
+
     QVariant aggregate(const AggregatedDatumInfo& datumInfo,
                        const QVariantList& values) const;
 
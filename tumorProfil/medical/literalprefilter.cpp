@@ -0,0 +1,288 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "literalprefilter.h"
+
+// Qt includes
+
+#include <QQueue>
+
+LiteralPrefilter::LiteralPrefilter()
+    : m_literalCount(0)
+{
+    // root node
+    m_nodes.resize(1);
+}
+
+int LiteralPrefilter::addLiteral(const QString& literal)
+{
+    int state = 0;
+    foreach (const QChar& c, literal)
+    {
+        const ushort u = c.unicode();
+        QHash<ushort, int>::const_iterator it = m_nodes[state].next.constFind(u);
+        if (it == m_nodes[state].next.constEnd())
+        {
+            m_nodes.append(Node());
+            const int newState = m_nodes.size() - 1;
+            m_nodes[state].next.insert(u, newState);
+            state = newState;
+        }
+        else
+        {
+            state = it.value();
+        }
+    }
+    const int index = m_literalCount++;
+    m_nodes[state].outputs << index;
+    return index;
+}
+
+void LiteralPrefilter::build()
+{
+    // Breadth-first: the failure link of a node is the longest proper suffix which is also in the trie
+    QQueue<int> queue;
+    foreach (int child, m_nodes[0].next)
+    {
+        m_nodes[child].fail = 0;
+        queue.enqueue(child);
+    }
+
+    while (!queue.isEmpty())
+    {
+        const int state = queue.dequeue();
+        QHash<ushort, int>::const_iterator it;
+        for (it = m_nodes[state].next.constBegin(); it != m_nodes[state].next.constEnd(); ++it)
+        {
+            const ushort u    = it.key();
+            const int   child = it.value();
+            int fail = m_nodes[state].fail;
+            while (fail && !m_nodes[fail].next.contains(u))
+            {
+                fail = m_nodes[fail].fail;
+            }
+            fail = m_nodes[fail].next.value(u, 0);
+            m_nodes[child].fail = (fail == child) ? 0 : fail;
+            m_nodes[child].outputs += m_nodes[m_nodes[child].fail].outputs;
+            queue.enqueue(child);
+        }
+    }
+}
+
+QBitArray LiteralPrefilter::scan(const QString& text) const
+{
+    QBitArray present(m_literalCount);
+    if (!m_literalCount)
+    {
+        return present;
+    }
+
+    int state = 0;
+    const QChar* data = text.constData();
+    const int size = text.size();
+    for (int i=0; i<size; i++)
+    {
+        const ushort u = data[i].unicode();
+        while (state && !m_nodes[state].next.contains(u))
+        {
+            state = m_nodes[state].fail;
+        }
+        state = m_nodes[state].next.value(u, 0);
+        foreach (int index, m_nodes[state].outputs)
+        {
+            present.setBit(index);
+        }
+    }
+    return present;
+}
+
+static void skipQuantifier(const QString& pattern, int& i)
+{
+    const int size = pattern.size();
+    if (i >= size)
+    {
+        return;
+    }
+    const QChar q = pattern[i];
+    if (q == '?' || q == '*' || q == '+')
+    {
+        i++;
+    }
+    else if (q == '{')
+    {
+        int end = pattern.indexOf('}', i);
+        i = (end == -1) ? size : end + 1;
+    }
+    else
+    {
+        return;
+    }
+    // lazy or possessive modifier
+    if (i < size && (pattern[i] == '?' || pattern[i] == '+'))
+    {
+        i++;
+    }
+}
+
+static void endRun(QString& current, QString& best)
+{
+    if (current.size() > best.size())
+    {
+        best = current;
+    }
+    current.clear();
+}
+
+QString LiteralPrefilter::requiredLiteral(const QString& pattern, int minimumLength)
+{
+    // Options changing the meaning of literals
+    if (pattern.contains("(?i") || pattern.contains("(?x") || pattern.contains("\\Q"))
+    {
+        return QString();
+    }
+
+    QString best, current;
+    int depth = 0;
+    int i = 0;
+    const int size = pattern.size();
+
+    while (i < size)
+    {
+        const QChar c = pattern[i];
+        QChar literal;
+
+        if (c == '\\')
+        {
+            if (i+1 >= size)
+            {
+                break;
+            }
+            const QChar e = pattern[i+1];
+            i += 2;
+            if (e.isLetterOrNumber())
+            {
+                // character classes (\s, \d, \w), assertions, back references, \p{..}, \x{..}, \k<..>
+                if (i < size && (pattern[i] == '{' || pattern[i] == '<') && QString("pPxgk").contains(e))
+                {
+                    int end = pattern.indexOf(pattern[i] == '{' ? '}' : '>', i);
+                    i = (end == -1) ? size : end + 1;
+                }
+                endRun(current, best);
+                skipQuantifier(pattern, i);
+                continue;
+            }
+            literal = e;
+        }
+        else if (c == '(')
+        {
+            depth++;
+            endRun(current, best);
+            i++;
+            continue;
+        }
+        else if (c == ')')
+        {
+            depth--;
+            endRun(current, best);
+            i++;
+            skipQuantifier(pattern, i);
+            continue;
+        }
+        else if (c == '[')
+        {
+            endRun(current, best);
+            i++;
+            // a ']' directly at the beginning is part of the class
+            if (i < size && pattern[i] == '^')
+            {
+                i++;
+            }
+            if (i < size && pattern[i] == ']')
+            {
+                i++;
+            }
+            while (i < size && pattern[i] != ']')
+            {
+                i += (pattern[i] == '\\') ? 2 : 1;
+            }
+            i++;
+            skipQuantifier(pattern, i);
+            continue;
+        }
+        else if (c == '|')
+        {
+            if (depth == 0)
+            {
+                // no string is required by all alternatives
+                return QString();
+            }
+            i++;
+            continue;
+        }
+        else if (c == '.' || c == '^' || c == '$')
+        {
+            endRun(current, best);
+            i++;
+            skipQuantifier(pattern, i);
+            continue;
+        }
+        else if (c == '*' || c == '+' || c == '?' || c == '{')
+        {
+            endRun(current, best);
+            skipQuantifier(pattern, i);
+            continue;
+        }
+        else
+        {
+            literal = c;
+            i++;
+        }
+
+        if (depth > 0)
+        {
+            skipQuantifier(pattern, i);
+            continue;
+        }
+
+        // A quantified literal is optional, or ends the run
+        if (i < size)
+        {
+            const QChar q = pattern[i];
+            if (q == '?' || q == '*' || q == '{')
+            {
+                endRun(current, best);
+                skipQuantifier(pattern, i);
+                continue;
+            }
+            if (q == '+')
+            {
+                current += literal;
+                endRun(current, best);
+                skipQuantifier(pattern, i);
+                continue;
+            }
+        }
+        current += literal;
+    }
+    endRun(current, best);
+
+    return best.size() >= minimumLength ? best : QString();
+}
@@ -0,0 +1,74 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef LITERALPREFILTER_H
+#define LITERALPREFILTER_H
+
+// Qt includes
+
+#include <QBitArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+/**
+  Finds which of a set of literal strings occur in a text, in a single pass (Aho-Corasick).
+  Used to skip regular expressions which cannot match because a string required by them is absent.
+  */
+class LiteralPrefilter
+{
+public:
+
+    LiteralPrefilter();
+
+    /// Adds a literal and returns its index in the result of scan(). Call build() afterwards.
+    int addLiteral(const QString& literal);
+    void build();
+
+    int literalCount() const { return m_literalCount; }
+    bool isEmpty() const { return m_literalCount == 0; }
+
+    /// Returns a bit array of size literalCount(), a bit is set if the literal occurs in text
+    QBitArray scan(const QString& text) const;
+
+    /**
+      Returns a string which is contained in every match of the given regular expression pattern,
+      or a null string if no such string of at least minimumLength can be determined.
+      Only literals outside of groups are considered. A top-level alternation yields no literal.
+      */
+    static QString requiredLiteral(const QString& pattern, int minimumLength = 3);
+
+private:
+
+    class Node
+    {
+    public:
+        Node() : fail(0) {}
+        QHash<ushort, int> next;
+        int                fail;
+        QVector<int>       outputs;
+    };
+
+    QVector<Node> m_nodes;
+    int           m_literalCount;
+};
+
+#endif // LITERALPREFILTER_H
@@ -21,17 +21,28 @@
 
 #include "pathologyparser.h"
 
+#include <cstring>
+
 #include <boost/icl/interval_set.hpp>
 
 #include <QDebug>
+#include <QBitArray>
+#include <QDateTime>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QTextStream>
 #include <QRegularExpression>
+#include <QSharedPointer>
+#include <QtConcurrent/QtConcurrentMap>
 
 #include "ihcscore.h"
+#include "literalprefilter.h"
 #include "pathologypropertyinfo.h"
 #include "patientmanager.h"
+#include "tracing.h"
 
 PatientParseResults::PatientParseResults()
 {
@@ -88,16 +99,93 @@ public:
         RegExpPDL1HScoreOld
     };
 
-    QList<QRegularExpression>& expressions(RegExpVariant var)
-    { return regexps[var]; }
+    const QList<QRegularExpression> expressions(RegExpVariant var) const
+    { return regexps.value(var); }
+
+    /// Returns the literals required by the regexps which are present in text, see candidates()
+    QBitArray scan(const QString& text) const
+    { return prefilter.scan(text); }
+
+    /**
+      Returns the regexps of the given variant which can possibly match the scanned text:
+      Those whose required literal was found, and those for which no literal is known.
+      */
+    QList<QRegularExpression> candidates(RegExpVariant var, const QBitArray& present) const;
 
-    void load();
+    /**
+      Returns the shared, compiled regexps. Thread-safe.
+      They are loaded on first use and reloaded if the source file has changed since.
+      */
+    static QSharedPointer<const RegExpContainer> instance();
 
 private:
+    void load(const QString& fileName);
+
+    static QString sourceFile();
+    static QString sourceVersion(const QString& fileName);
+
     QMap<RegExpVariant, QList<QRegularExpression> > regexps;
+    // For each regexp, the index of its required literal in the prefilter, or -1
+    QMap<RegExpVariant, QList<int> > literalIndexes;
+    LiteralPrefilter prefilter;
 };
 
-void RegExpContainer::load()
+QList<QRegularExpression> RegExpContainer::candidates(RegExpVariant var, const QBitArray& present) const
+{
+    const QList<QRegularExpression> all = regexps.value(var);
+    const QList<int> indexes = literalIndexes.value(var);
+    QList<QRegularExpression> candidates;
+    for (int i=0; i<all.size(); i++)
+    {
+        const int index = indexes.at(i);
+        if (index == -1 || present.testBit(index))
+        {
+            candidates << all.at(i);
+        }
+    }
+    return candidates;
+}
+
+QString RegExpContainer::sourceFile()
+{
+    // allow override with updated regexps in the current dir
+    QString fileName = QDir::currentPath() + "/pathology-regexps";
+    if (!QFile::exists(fileName))
+    {
+        fileName = ":/regexps/pathology-regexps";
+    }
+    return fileName;
+}
+
+QString RegExpContainer::sourceVersion(const QString& fileName)
+{
+    // The resource is compiled in and never changes. An override file is identified by its modification.
+    QFileInfo info(fileName);
+    return fileName + '|' + QString::number(info.size()) + '|' + QString::number(info.lastModified().toMSecsSinceEpoch());
+}
+
+QSharedPointer<const RegExpContainer> RegExpContainer::instance()
+{
+    static QMutex mutex;
+    static QSharedPointer<const RegExpContainer> container;
+    static QString version;
+
+    const QString fileName = sourceFile();
+    const QString currentVersion = sourceVersion(fileName);
+
+    QMutexLocker lock(&mutex);
+    if (!container || version != currentVersion)
+    {
+        // Parsers still holding the previous set keep it alive until they are done
+        QSharedPointer<RegExpContainer> newContainer(new RegExpContainer);
+        newContainer->load(fileName);
+        container = newContainer;
+        version   = currentVersion;
+    }
+    return container;
+}
+
+void RegExpContainer::load(const QString& fileName)
 {
     QMap<QString, RegExpVariant> keywords;
     keywords.insert("patient-id", RegExpPatientId);
@@ -114,12 +202,7 @@ void RegExpContainer::load()
     keywords.insert("", RegExpPDL1HScore);
     keywords.insert("", RegExpPDL1HScoreOld);
 
-    // allow override with updated regexps in the current dir
-    QFile file(QDir::currentPath() + "/pathology-regexps");
-    if (!file.exists())
-    {
-        file.setFileName(":/regexps/pathology-regexps");
-    }
+    QFile file(fileName);
     if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
     {
         qDebug() << "Failed to open regexp file" << file.fileName() <<" - Parsing will not work!";
@@ -146,15 +229,79 @@ void RegExpContainer::load()
             {
                 re.setPatternOptions(re.patternOptions() | QRegularExpression::DotMatchesEverythingOption);
             }
+            // compile once here, not on first use in each thread
+            re.optimize();
             regexps[currentVariant] << re;
+
+            const QString literal = LiteralPrefilter::requiredLiteral(line);
+            literalIndexes[currentVariant] << (literal.isNull() ? -1 : prefilter.addLiteral(literal));
         }
         else
         {
             qDebug() << "Regexp loading: failed to parse line" << line;
         }
     }
+    prefilter.build();
 }
 
+/**
+  Reads lines from a QString, or directly from ISO 8859-1 encoded bytes,
+  for example a memory-mapped file. Only the current line is decoded.
+  */
+class PathologyTextReader
+{
+public:
+
+    PathologyTextReader(const QString& text)
+        : text(&text), data(0), size(text.size()), pos(0)
+    {
+    }
+
+    PathologyTextReader(const char* latin1Data, qint64 size)
+        : text(0), data(latin1Data), size(size), pos(0)
+    {
+    }
+
+    /// Returns a null string at the end
+    QString readLine()
+    {
+        if (pos >= size)
+        {
+            return QString();
+        }
+        qint64 end;
+        QString line;
+        if (text)
+        {
+            end = text->indexOf('\n', int(pos));
+            if (end == -1)
+            {
+                end = size;
+            }
+            line = text->mid(int(pos), int(end - pos));
+        }
+        else
+        {
+            const char* found = static_cast<const char*>(memchr(data + pos, '\n', size - pos));
+            end = found ? (found - data) : size;
+            line = QString::fromLatin1(data + pos, int(end - pos));
+        }
+        pos = end + 1;
+        if (line.endsWith('\r'))
+        {
+            line.chop(1);
+        }
+        return line;
+    }
+
+private:
+
+    const QString* text;
+    const char*    data;
+    qint64         size;
+    qint64         pos;
+};
+
 class PathologyParser::PathologyParserPriv
 {
 public:
@@ -170,14 +317,14 @@ public:
     Property& propertyForExon(QList<Property>& properties, const QString& protein, int exon);
     PathologyPropertyInfo::Property textToFISHProperty(const QString& protein);
 
-    RegExpContainer regExpContainer;
+    // shared by all parsers, see RegExpContainer::instance()
+    QSharedPointer<const RegExpContainer> regExps;
     QList<PatientParseResults> results;
 };
 
 PathologyParser::PathologyParser()
     : d(new PathologyParserPriv)
 {
-    d->regExpContainer.load();
 }
 
 PathologyParser::~PathologyParser()
@@ -197,14 +344,26 @@ void PathologyParser::clear()
 
 QList<PatientParseResults> PathologyParser::parseFile(const QString& fileName)
 {
+    TRACE_SPAN("PathologyParser::parseFile");
     QFile file(fileName);
     if (!file.open(QFile::ReadOnly))
     {
         qDebug() << "Failed to open file" << fileName;
+        return d->results;
     }
-    QTextStream stream(&file);
-    stream.setCodec("ISO 8859-1");
-    splitPerPatient(stream);
+
+    // The text file is ISO 8859-1; lines are decoded from the mapped file one by one
+    QByteArray buffer;
+    const char* data = file.size() ? reinterpret_cast<const char*>(file.map(0, file.size())) : 0;
+    qint64 size = file.size();
+    if (!data)
+    {
+        buffer = file.readAll();
+        data   = buffer.constData();
+        size   = buffer.size();
+    }
+    PathologyTextReader reader(data, size);
+    splitPerPatient(reader);
     parsePerPatient();
 
     return d->results;
@@ -212,23 +371,26 @@ QList<PatientParseResults> PathologyParser::parseFile(const QString& fileName)
 
 QList<PatientParseResults> PathologyParser::parse(const QString& s)
 {
-    QString text(s);
-    QTextStream stream(&text, QIODevice::ReadOnly);
-    splitPerPatient(stream);
+    TRACE_SPAN("PathologyParser::parse");
+    PathologyTextReader reader(s);
+    splitPerPatient(reader);
     parsePerPatient();
 
     return d->results;
 }
 
-void PathologyParser::splitPerPatient(QTextStream& stream)
+void PathologyParser::splitPerPatient(PathologyTextReader& stream)
 {
+    // Pick up the current regexps once per parse; a changed file is reloaded
+    d->regExps = RegExpContainer::instance();
+
     // First tour of parsing: Split into per-patient chunks.
     // We assume that the RegExps is exact (^...$)
     QString line, nextLine, patientText;
     PatientParseResults* currentResults = 0;
     while ( !(line = stream.readLine()).isNull() )
     {
-        foreach (const QRegularExpression& re, d->regExpContainer.expressions(RegExpContainer::RegExpPatientId))
+        foreach (const QRegularExpression& re, d->regExps->expressions(RegExpContainer::RegExpPatientId))
         {
             QRegularExpressionMatch match = re.match(line, 0, QRegularExpression::PartialPreferFirstMatch);
             // patient id is multi-line
@@ -255,18 +417,30 @@ void PathologyParser::splitPerPatient(QTextStream& stream)
     d->appendPatientText(currentResults, patientText);
 }
 
+class PathologyParser::ParseTextFunctor
+{
+public:
+    ParseTextFunctor(PathologyParser* parser) : parser(parser) {}
+    typedef void result_type;
+    void operator()(PatientParseResults& results) const
+    {
+        parser->parseText(results);
+    }
+    PathologyParser* const parser;
+};
+
 void PathologyParser::parsePerPatient()
 {
     // The text is now broken into per-patient chunks, stored in results.
     // for each patient, parse their results, Properties and metadata are stored in results.
-    for (int i=0; i<d->results.size(); ++i)
-    {
-        parseText(d->results[i]);
-    }
+    // Chunks are independent and the regexps are only read, so parse them in parallel.
+    // The list is modified in place, so the order of the input is kept.
+    QtConcurrent::blockingMap(d->results, ParseTextFunctor(this));
 }
 
 void PathologyParser::parseText(PatientParseResults& results)
 {
+    TRACE_SPAN("PathologyParser::parseText");
     boost::icl::interval_set<int> excerpts;
     results.resultsDate = QDate();
     results.referenceNumbers.clear();
@@ -275,15 +449,19 @@ void PathologyParser::parseText(PatientParseResults& results)
 
     // There is junk at the page break of the PDFs. This may be placed just inside any content, confusing the analysis.
     // So remove it here once and forever (regexp will be very specific)
-    foreach (const QRegularExpression& re, d->regExpContainer.expressions(RegExpContainer::RegExpPageBreakJunk))
+    foreach (const QRegularExpression& re, d->regExps->expressions(RegExpContainer::RegExpPageBreakJunk))
     {
         results.text.remove(re);
     }
 
+    // Most regexps require a literal text which is absent in most reports.
+    // Find all these literals in one pass and skip regexps which cannot match.
+    const QBitArray present = d->regExps->scan(results.text);
+
     // we perform global matches with the (very specific) regular expressions
 
     // Look for id strings, fill finding date (earliest) and R/E numbers
-    foreach (const QRegularExpression& re, d->regExpContainer.expressions(RegExpContainer::RegExpPatientId))
+    foreach (const QRegularExpression& re, d->regExps->candidates(RegExpContainer::RegExpPatientId, present))
     {
         QRegularExpressionMatchIterator it = re.globalMatch(results.text);
         while (it.hasNext())
@@ -302,7 +480,7 @@ void PathologyParser::parseText(PatientParseResults& results)
             excerpts += boost::icl::interval<int>::right_open(match.capturedStart(), match.capturedEnd());
         }
     }
-    foreach (const QRegularExpression& re, d->regExpContainer.expressions(RegExpContainer::RegExpIHC))
+    foreach (const QRegularExpression& re, d->regExps->candidates(RegExpContainer::RegExpIHC, present))
     {
         QRegularExpressionMatchIterator it = re.globalMatch(results.text);
         while (it.hasNext())
@@ -337,7 +515,7 @@ void PathologyParser::parseText(PatientParseResults& results)
             excerpts += boost::icl::interval<int>::right_open(match.capturedStart(), match.capturedEnd());
         }
     }
-    foreach (const QRegularExpression& re, d->regExpContainer.expressions(RegExpContainer::RegExpIHCHScore))
+    foreach (const QRegularExpression& re, d->regExps->candidates(RegExpContainer::RegExpIHCHScore, present))
     {
         QRegularExpressionMatchIterator it = re.globalMatch(results.text);
         while (it.hasNext())
@@ -367,7 +545,7 @@ void PathologyParser::parseText(PatientParseResults& results)
             excerpts += boost::icl::interval<int>::right_open(match.capturedStart(), match.capturedEnd());
         }
     }
-    foreach (const QRegularExpression& re, d->regExpContainer.expressions(RegExpContainer::RegExpIHCMSI))
+    foreach (const QRegularExpression& re, d->regExps->candidates(RegExpContainer::RegExpIHCMSI, present))
     {
         QRegularExpressionMatchIterator it = re.globalMatch(results.text);
         while (it.hasNext())
@@ -398,7 +576,8 @@ void PathologyParser::parseText(PatientParseResults& results)
             excerpts += boost::icl::interval<int>::right_open(match.capturedStart(), match.capturedEnd());
         }
     }
-    foreach (const QRegularExpression& re, d->regExpContainer.expressions(RegExpContainer::RegExpNGSTableHeader))
+    const QList<QRegularExpression> ngsRowExpressions = d->regExps->candidates(RegExpContainer::RegExpNGSTableRow, present);
+    foreach (const QRegularExpression& re, d->regExps->candidates(RegExpContainer::RegExpNGSTableHeader, present))
     {
         QRegularExpressionMatchIterator it = re.globalMatch(results.text);
         while (it.hasNext())
@@ -422,7 +601,7 @@ void PathologyParser::parseText(PatientParseResults& results)
             foreach (const QString& line, results.text.mid(begin, end-begin).split('\n', QString::SkipEmptyParts))
             {
                 QRegularExpressionMatch match2;
-                foreach (const QRegularExpression& re, d->regExpContainer.expressions(RegExpContainer::RegExpNGSTableRow))
+                foreach (const QRegularExpression& re, ngsRowExpressions)
                 {
                     match2 = re.match(line);
                     if (match2.hasMatch())
@@ -455,7 +634,7 @@ void PathologyParser::parseText(PatientParseResults& results)
             excerpts += boost::icl::interval<int>::right_open(match.capturedStart(), end);
         }
     }
-    foreach (const QRegularExpression& re, d->regExpContainer.expressions(RegExpContainer::RegExpFISH))
+    foreach (const QRegularExpression& re, d->regExps->candidates(RegExpContainer::RegExpFISH, present))
     {
         QRegularExpressionMatchIterator it = re.globalMatch(results.text);
         while (it.hasNext())
@@ -474,7 +653,7 @@ void PathologyParser::parseText(PatientParseResults& results)
             excerpts += boost::icl::interval<int>::right_open(match.capturedStart(), match.capturedEnd());
         }
     }
-    foreach (const QRegularExpression& re, d->regExpContainer.expressions(RegExpContainer::RegExpIgnore))
+    foreach (const QRegularExpression& re, d->regExps->candidates(RegExpContainer::RegExpIgnore, present))
     {
         QRegularExpressionMatchIterator it = re.globalMatch(results.text);
         while (it.hasNext())
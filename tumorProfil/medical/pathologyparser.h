@@ -25,7 +25,7 @@
 #include "patient.h"
 #include "property.h"
 
-class QTextStream;
+class PathologyTextReader;
 
 class PatientParseResults
 {
@@ -55,6 +55,7 @@ public:
     ~PathologyParser();
 
     /// Parses the given string / the text file. Current results are returned for convenience, or are available from results().
+    /// Patients are parsed in parallel; results are in the order of the input.
     QList<PatientParseResults> parse(const QString& s);
     QList<PatientParseResults> parseFile(const QString& fileName);
     /// Returns results from previous calls to parse()
@@ -65,11 +66,12 @@ public:
 
 private:
 
-    void splitPerPatient(QTextStream& s);
+    void splitPerPatient(PathologyTextReader& reader);
     void parsePerPatient();
     void parseText(PatientParseResults& results);
     QList<Property> parseNGSText(const QString& protein, const QString& text);
 
+    class ParseTextFunctor;
     class PathologyParserPriv;
     PathologyParserPriv* const d;
 };
@@ -24,244 +24,236 @@
 // Qt includes
 
 #include <QDebug>
+#include <QHash>
+#include <QMutexLocker>
 
 #include "ihcscore.h"
 
-ResultCompletenessChecker::ResultCompletenessChecker(const Patient::Ptr& p)
-    : p(p)
+Q_STATIC_ASSERT(PathologyPropertyInfo::LastProperty < 64);
+
+typedef ResultCompleteness::Mask Mask;
+
+static inline Mask bit(PathologyPropertyInfo::Property property)
 {
+    return ResultCompleteness::mask(property);
 }
 
-ResultCompletenessChecker::CompletenessResult ResultCompletenessChecker::isIHCComplete(QList<PathologyPropertyInfo>* missingProperties)
+static QHash<QString, int> createPropertyIds()
 {
-    const Disease& disease = p->firstDisease();
-    QDate profileDate;
-    if (disease.hasProfilePathology())
+    QHash<QString, int> ids;
+    for (int i=PathologyPropertyInfo::FirstProperty; i<=PathologyPropertyInfo::LastProperty; i++)
+    {
+        ids[PathologyPropertyInfo::info(PathologyPropertyInfo::Property(i)).id] = i;
+    }
+    return ids;
+}
+
+/// Maps the property id strings to PathologyPropertyInfo::Property, created only once
+static const QHash<QString, int>& propertyIds()
+{
+    static const QHash<QString, int> ids = createPropertyIds();
+    return ids;
+}
+
+static Mask presentProperties(const Pathology& pathology)
+{
+    const QHash<QString, int>& ids = propertyIds();
+    Mask present = 0;
+    foreach (const Property& prop, pathology.properties)
+    {
+        QHash<QString, int>::const_iterator it = ids.constFind(prop.property);
+        if (it != ids.constEnd())
+        {
+            present |= Mask(1) << it.value();
+        }
+    }
+    return present;
+}
+
+static QVariant medicalValue(const Disease& disease, PathologyPropertyInfo::Property property)
+{
+    PathologyPropertyInfo field(property);
+    Property prop = disease.pathologyProperty(field.id);
+    if (!prop.isValid())
+    {
+        return QVariant();
+    }
+    return ValueTypeCategoryInfo(field).toMedicalValue(prop);
+}
+
+/// Sets the result from the required and present properties
+static void checkRequired(ResultCompleteness::CategoryState& state, Mask present)
+{
+    state.missing = state.required & ~present;
+    if (!state.missing)
+    {
+        state.result = ResultCompletenessChecker::Complete;
+    }
+    else if (state.missing == state.required)
     {
-        const Pathology& p = disease.firstProfilePathology();
-        profileDate = p.date;
+        state.result = ResultCompletenessChecker::Absent;
     }
-    QList<PathologyPropertyInfo> requiredFields;
+    else
+    {
+        state.result = ResultCompletenessChecker::Incomplete;
+    }
+}
+
+static void computeIHC(ResultCompleteness::CategoryState& state, const Disease& disease,
+                       const QDate& profileDate, Mask present)
+{
     switch (disease.entity())
     {
     case Pathology::PulmonaryAdeno:
     case Pathology::PulmonaryBronchoalveloar:
     case Pathology::PulmonaryAdenosquamous:
-        requiredFields << PathologyPropertyInfo::IHC_pAKT
-                       << PathologyPropertyInfo::IHC_ALK
-                       << PathologyPropertyInfo::IHC_pERK
-                       << PathologyPropertyInfo::IHC_HER2_DAKO
-                       << PathologyPropertyInfo::IHC_PTEN;
+        state.required = bit(PathologyPropertyInfo::IHC_pAKT)
+                       | bit(PathologyPropertyInfo::IHC_ALK)
+                       | bit(PathologyPropertyInfo::IHC_pERK)
+                       | bit(PathologyPropertyInfo::IHC_HER2_DAKO)
+                       | bit(PathologyPropertyInfo::IHC_PTEN);
         break;
     case Pathology::PulmonarySquamous:
-        requiredFields << PathologyPropertyInfo::IHC_pAKT
-                       << PathologyPropertyInfo::IHC_pERK
-                       << PathologyPropertyInfo::IHC_PTEN;
+        state.required = bit(PathologyPropertyInfo::IHC_pAKT)
+                       | bit(PathologyPropertyInfo::IHC_pERK)
+                       | bit(PathologyPropertyInfo::IHC_PTEN);
         break;
     case Pathology::ColorectalAdeno:
-        requiredFields << PathologyPropertyInfo::IHC_pAKT
-                       << PathologyPropertyInfo::IHC_pP70S6K
-                       << PathologyPropertyInfo::IHC_pERK
-                       << PathologyPropertyInfo::IHC_PTEN;
-        break;
     case Pathology::Breast:
-        requiredFields << PathologyPropertyInfo::IHC_pAKT
-                       << PathologyPropertyInfo::IHC_pP70S6K
-                       << PathologyPropertyInfo::IHC_pERK
-                       << PathologyPropertyInfo::IHC_PTEN;
+        state.required = bit(PathologyPropertyInfo::IHC_pAKT)
+                       | bit(PathologyPropertyInfo::IHC_pP70S6K)
+                       | bit(PathologyPropertyInfo::IHC_pERK)
+                       | bit(PathologyPropertyInfo::IHC_PTEN);
         break;
     default:
-        return Undefined;
+        return;
     }
     // cMET, PIK3CA-amplification 04/2013
-    if (profileDate >= QDate(2013, 5, 1))
-    {
-        switch (disease.entity())
-        {
-        case Pathology::PulmonaryAdeno:
-        case Pathology::PulmonaryBronchoalveloar:
-        case Pathology::PulmonaryAdenosquamous:
-            requiredFields << PathologyPropertyInfo::IHC_cMET;
-            break;
-        case Pathology::ColorectalAdeno:
-            requiredFields << PathologyPropertyInfo::IHC_cMET;
-            break;
-        default:
-            break;
-        }
-    }
-
-    bool complete = true;
-    QList<PathologyPropertyInfo> missing, partial, returnList;
-    foreach (const PathologyPropertyInfo& field, requiredFields)
-    {
-        ValueTypeCategoryInfo categoryInfo(field);
-
-        bool hasField = disease.hasPathologyProperty(field.id);
-        if (!hasField)
-        {
-            complete = false;
-            missing << field;
-        }
-        // Comment out HERE to switch requiring complete two-dim score
-        /*else if (categoryInfo.isTwoDimScored())
-        {
-            Property prop = disease.pathologyProperty(field.id);
-            IHCScore score = categoryInfo.toIHCScore(prop);
-            if (!score.isValid())
-            {
-                complete = false;
-                partial << field;
-            }
-        }*/
-    }
-
-    returnList = missing;
-    if (!partial.isEmpty())
+    switch (disease.entity())
     {
-        // we can only return one list, so join
-        if (missing.isEmpty())
+    case Pathology::PulmonaryAdeno:
+    case Pathology::PulmonaryBronchoalveloar:
+    case Pathology::PulmonaryAdenosquamous:
+    case Pathology::ColorectalAdeno:
+        if (profileDate >= QDate(2013, 5, 1))
         {
-            returnList = missing + partial;
-            partial.clear();
+            state.required |= bit(PathologyPropertyInfo::IHC_cMET);
         }
         else
         {
-            returnList = partial;
+            state.optional |= bit(PathologyPropertyInfo::IHC_cMET);
         }
+        break;
+    default:
+        break;
     }
-
-    if (missingProperties)
-    {
-        *missingProperties = returnList;
-    }
-
-    if (complete)
-    {
-        return Complete;
-    }
-    else if (missing.isEmpty() && partial.isEmpty())
-    {
-        return PartialResult;
-    }
-    else if (requiredFields.size() == missing.size())
-    {
-        return Absent;
-    }
-    else
-    {
-        return Incomplete;
-    }
+    // Requiring a complete two-dimensional score (PartialResult) is currently switched off
+    checkRequired(state, present);
 }
 
-ResultCompletenessChecker::CompletenessResult completenessCascade(const Disease& disease,
-    const QList<PathologyPropertyInfo> requiredFields, QList<PathologyPropertyInfo>* missingProperties)
+/**
+  The fields are required in order until the first mutation is found.
+  Only the first missing field is reported.
+  */
+static void completenessCascade(ResultCompleteness::CategoryState& state, const Disease& disease,
+                                const QList<PathologyPropertyInfo::Property>& fields, Mask present)
 {
     bool hasAny = false;
-    foreach (const PathologyPropertyInfo& field, requiredFields)
+    bool stopped = false;
+    foreach (PathologyPropertyInfo::Property property, fields)
     {
-        Property prop = disease.pathologyProperty(field.id);
-        if (prop.isValid())
+        if (stopped)
+        {
+            state.optional |= bit(property);
+            continue;
+        }
+        state.required |= bit(property);
+        if (present & bit(property))
         {
             hasAny = true;
             // in case of a mutation, the algorithm stops
-            if (ValueTypeCategoryInfo(field).toValue(prop.value).toBool())
+            PathologyPropertyInfo field(property);
+            if (ValueTypeCategoryInfo(field).toValue(disease.pathologyProperty(field.id).value).toBool())
             {
-                break;
+                stopped = true;
             }
             // else check next
         }
         else
         {
-            if (missingProperties)
-            {
-                *missingProperties << field;
-            }
-            return hasAny ? ResultCompletenessChecker::Absent : ResultCompletenessChecker::Incomplete;
+            state.missing = bit(property);
+            state.result  = hasAny ? ResultCompletenessChecker::Absent : ResultCompletenessChecker::Incomplete;
+            stopped = true;
         }
     }
-    return ResultCompletenessChecker::Complete;
-}
-
-QVariant checkCompleteness(const Disease& disease, PathologyPropertyInfo::Property property,
-                           bool& complete, QList<PathologyPropertyInfo>* missingProperties)
-{
-    PathologyPropertyInfo field(property);
-    Property prop = disease.pathologyProperty(field.id);
-    if (!prop.isValid())
+    if (!state.missing)
     {
-        complete = false;
-        if (missingProperties)
-        {
-            *missingProperties << field;
-        }
-        return QVariant();
+        state.result = ResultCompletenessChecker::Complete;
     }
-    return ValueTypeCategoryInfo(field).toMedicalValue(prop);
 }
 
-ResultCompletenessChecker::CompletenessResult ResultCompletenessChecker::isMutComplete(QList<PathologyPropertyInfo>* missingProperties)
+static void computeMutations(ResultCompleteness::CategoryState& state, const Disease& disease,
+                             const QDate& profileDate, Mask present)
 {
-    const Disease& disease = p->firstDisease();
-
-    QDate profileDate;
-    if (disease.hasProfilePathology())
-    {
-        const Pathology& p = disease.firstProfilePathology();
-        profileDate = p.date;
-    }
+    QList<PathologyPropertyInfo::Property> pulmonaryCascade;
+    pulmonaryCascade << PathologyPropertyInfo::Mut_KRAS_2
+                     << PathologyPropertyInfo::Mut_EGFR_19_21
+                     << PathologyPropertyInfo::Mut_PIK3CA_10_21
+                     << PathologyPropertyInfo::Mut_BRAF_15;
 
-    QList<PathologyPropertyInfo> requiredFields;
     switch (disease.entity())
     {
     case Pathology::PulmonaryAdeno:
     case Pathology::PulmonaryBronchoalveloar:
     case Pathology::PulmonaryAdenosquamous:
-        requiredFields << PathologyPropertyInfo::Mut_KRAS_2
-                       << PathologyPropertyInfo::Mut_EGFR_19_21
-                       << PathologyPropertyInfo::Mut_PIK3CA_10_21
-                       << PathologyPropertyInfo::Mut_BRAF_15;
-        return completenessCascade(disease, requiredFields, missingProperties);
+        completenessCascade(state, disease, pulmonaryCascade, present);
         break;
     case Pathology::PulmonarySquamous:
-        return OnlyOptional;
+        foreach (PathologyPropertyInfo::Property property, pulmonaryCascade)
+        {
+            state.optional |= bit(property);
+        }
+        state.result = ResultCompletenessChecker::OnlyOptional;
         break;
     case Pathology::ColorectalAdeno:
     {
-        bool complete = true;
-        QVariant kras = checkCompleteness(disease, PathologyPropertyInfo::Mut_KRAS_2, complete, missingProperties);
-        checkCompleteness(disease, PathologyPropertyInfo::Mut_PIK3CA_10_21, complete, missingProperties);
+        state.required = bit(PathologyPropertyInfo::Mut_KRAS_2)
+                       | bit(PathologyPropertyInfo::Mut_PIK3CA_10_21);
+        Mask wildTypeFields = bit(PathologyPropertyInfo::Mut_BRAF_15)
+                            | bit(PathologyPropertyInfo::Mut_KRAS_3);
+        if (profileDate >= QDate(2013, 8, 1))
+        {
+            wildTypeFields |= bit(PathologyPropertyInfo::Mut_KRAS_4)
+                            | bit(PathologyPropertyInfo::Mut_NRAS_2_4);
+        }
         // kras Wildtyp?
+        QVariant kras = medicalValue(disease, PathologyPropertyInfo::Mut_KRAS_2);
         if (kras.isValid() && !kras.toBool())
         {
-            checkCompleteness(disease, PathologyPropertyInfo::Mut_BRAF_15, complete, missingProperties);
-            checkCompleteness(disease, PathologyPropertyInfo::Mut_KRAS_3, complete, missingProperties);
-            if (profileDate >= QDate(2013, 8, 1))
-            {
-                checkCompleteness(disease, PathologyPropertyInfo::Mut_KRAS_4, complete, missingProperties);
-                checkCompleteness(disease, PathologyPropertyInfo::Mut_NRAS_2_4, complete, missingProperties);
-            }
+            state.required |= wildTypeFields;
+        }
+        else
+        {
+            state.optional |= wildTypeFields;
         }
-        return complete ? Complete : Incomplete;
+        state.missing = state.required & ~present;
+        state.result  = state.missing ? ResultCompletenessChecker::Incomplete : ResultCompletenessChecker::Complete;
+        break;
     }
     case Pathology::Breast:
-    {
-        bool complete = true;
-        checkCompleteness(disease, PathologyPropertyInfo::Mut_PIK3CA_10_21, complete, missingProperties);
-        return complete ? Complete : Incomplete;
-    }
+        state.required = bit(PathologyPropertyInfo::Mut_PIK3CA_10_21);
+        state.missing  = state.required & ~present;
+        state.result   = state.missing ? ResultCompletenessChecker::Incomplete : ResultCompletenessChecker::Complete;
+        break;
     default:
         break;
     }
-    return Undefined;
 }
 
-ResultCompletenessChecker::CompletenessResult ResultCompletenessChecker::isFishComplete(QList<PathologyPropertyInfo>* missingProperties)
+static void computeFish(ResultCompleteness::CategoryState& state, const Disease& disease, Mask present)
 {
-    const Disease& disease = p->firstDisease();
     bool checkHer2 = false;
     bool checkAlk = false;
-    bool checkPik3 = false;
     switch (disease.entity())
     {
     case Pathology::PulmonaryAdeno:
@@ -271,39 +263,148 @@ ResultCompletenessChecker::CompletenessResult ResultCompletenessChecker::isFishC
     case Pathology::Breast:
         checkHer2 = true;
         break;
-    case Pathology::PulmonarySquamous:
-        checkPik3 = true;
-        break;
     default:
-        break;
+        return;
     }
 
-    if (!checkHer2 && !checkAlk)
+    if (checkHer2)
     {
-        return Undefined;
+        // FISH is needed for a DAKO score of 2+
+        if (medicalValue(disease, PathologyPropertyInfo::IHC_HER2_DAKO).toInt() == 2)
+        {
+            state.required |= bit(PathologyPropertyInfo::Fish_HER2);
+        }
+        else
+        {
+            state.optional |= bit(PathologyPropertyInfo::Fish_HER2);
+        }
     }
+    if (checkAlk)
+    {
+        if (medicalValue(disease, PathologyPropertyInfo::IHC_ALK).toInt() != 0)
+        {
+            state.required |= bit(PathologyPropertyInfo::Fish_ALK);
+        }
+        else
+        {
+            state.optional |= bit(PathologyPropertyInfo::Fish_ALK);
+        }
+    }
+    state.missing = state.required & ~present;
+    state.result  = state.missing ? ResultCompletenessChecker::Incomplete : ResultCompletenessChecker::Complete;
+}
 
-    bool complete = true, discardValue;
-    if (checkHer2)
+ResultCompleteness ResultCompleteness::compute(const Disease& disease)
+{
+    ResultCompleteness completeness;
+    foreach (const Pathology& pathology, disease.pathologies)
+    {
+        completeness.present |= presentProperties(pathology);
+    }
+
+    QDate profileDate;
+    if (disease.hasProfilePathology())
+    {
+        profileDate = disease.firstProfilePathology().date;
+    }
+
+    computeIHC(completeness.categories[ResultCompletenessChecker::IHCCategory], disease, profileDate, completeness.present);
+    computeMutations(completeness.categories[ResultCompletenessChecker::MutationCategory], disease, profileDate, completeness.present);
+    computeFish(completeness.categories[ResultCompletenessChecker::FishCategory], disease, completeness.present);
+    return completeness;
+}
+
+QList<PathologyPropertyInfo> ResultCompleteness::properties(Mask mask)
+{
+    QList<PathologyPropertyInfo> infos;
+    for (int i=PathologyPropertyInfo::FirstProperty; mask && i<=PathologyPropertyInfo::LastProperty; i++)
     {
-        QVariant dakoscore = checkCompleteness(disease, PathologyPropertyInfo::IHC_HER2_DAKO, discardValue, 0);
-        if (dakoscore.toInt() == 2)
+        const Mask propertyBit = Mask(1) << i;
+        if (mask & propertyBit)
         {
-            checkCompleteness(disease, PathologyPropertyInfo::Fish_HER2, complete, missingProperties);
+            infos << PathologyPropertyInfo::info(PathologyPropertyInfo::Property(i));
+            mask &= ~propertyBit;
         }
     }
-    if (checkAlk)
+    return infos;
+}
+
+ResultCompletenessChecker::ResultCompletenessChecker(const Patient::Ptr& p)
+    : p(p)
+{
+}
+
+const ResultCompleteness& ResultCompletenessChecker::completeness()
+{
+    const Disease& disease = p->firstDisease();
     {
-        QVariant score = checkCompleteness(disease, PathologyPropertyInfo::IHC_ALK, discardValue, 0);
-        if (score.toInt() != 0)
+        QMutexLocker lock(&disease.derived.mutex);
+        if (disease.derived.completeness)
         {
-            checkCompleteness(disease, PathologyPropertyInfo::Fish_ALK, complete, missingProperties);
+            m_completeness = disease.derived.completeness;
+            return *m_completeness;
         }
     }
-    if (checkPik3)
+    m_completeness = QSharedPointer<const ResultCompleteness>(new ResultCompleteness(ResultCompleteness::compute(disease)));
+    QMutexLocker lock(&disease.derived.mutex);
+    disease.derived.completeness = m_completeness;
+    return *m_completeness;
+}
+
+ResultCompletenessChecker::CompletenessResult ResultCompletenessChecker::isComplete(Category category,
+                                                                                    QList<PathologyPropertyInfo>* missingProperties)
+{
+    const ResultCompleteness::CategoryState& state = completeness().state(category);
+    if (missingProperties)
+    {
+        *missingProperties = ResultCompleteness::properties(state.missing);
+    }
+    return state.result;
+}
+
+ResultCompletenessChecker::CompletenessResult ResultCompletenessChecker::isIHCComplete(QList<PathologyPropertyInfo>* missingProperties)
+{
+    return isComplete(IHCCategory, missingProperties);
+}
+
+ResultCompletenessChecker::CompletenessResult ResultCompletenessChecker::isMutComplete(QList<PathologyPropertyInfo>* missingProperties)
+{
+    return isComplete(MutationCategory, missingProperties);
+}
+
+ResultCompletenessChecker::CompletenessResult ResultCompletenessChecker::isFishComplete(QList<PathologyPropertyInfo>* missingProperties)
+{
+    return isComplete(FishCategory, missingProperties);
+}
+
+QMap<PathologyPropertyInfo::Property, int> ResultCompletenessChecker::missingProperties(const QList<Patient::Ptr>& patients,
+                                                                                       Category category)
+{
+    // Patients with the same missing properties are counted together
+    QHash<Mask, int> missingMasks;
+    foreach (const Patient::Ptr& p, patients)
     {
-        QVariant score = checkCompleteness(disease, PathologyPropertyInfo::Fish_PIK3CA, complete, 0);
+        if (!p->hasDisease())
+        {
+            continue;
+        }
+        ResultCompletenessChecker checker(p);
+        const ResultCompleteness::CategoryState& state = checker.completeness().state(category);
+        if (state.result == Undefined)
+        {
+            continue;
+        }
+        missingMasks[state.missing]++;
     }
 
-    return complete ? Complete : Incomplete;
+    QMap<PathologyPropertyInfo::Property, int> counts;
+    for (QHash<Mask, int>::const_iterator it = missingMasks.constBegin(); it != missingMasks.constEnd(); ++it)
+    {
+        for (Mask mask = it.key(); mask; mask &= mask - 1)
+        {
+            const PathologyPropertyInfo::Property property = PathologyPropertyInfo::Property(qCountTrailingZeroBits(mask));
+            counts[property] += it.value();
+        }
+    }
+    return counts;
 }
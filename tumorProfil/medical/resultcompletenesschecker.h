@@ -22,9 +22,13 @@
 #ifndef RESULTCOMPLETENESSCHECKER_H
 #define RESULTCOMPLETENESSCHECKER_H
 
+#include <QMap>
+
 #include <patient.h>
 #include <pathologypropertyinfo.h>
 
+class ResultCompleteness;
+
 class ResultCompletenessChecker
 {
 public:
@@ -40,13 +44,82 @@ public:
         PartialResult
     };
 
+    enum Category
+    {
+        IHCCategory,
+        MutationCategory,
+        FishCategory,
+        NumberOfCategories
+    };
+
     CompletenessResult isIHCComplete(QList<PathologyPropertyInfo>* missingProperties);
     CompletenessResult isMutComplete(QList<PathologyPropertyInfo>* missingProperties);
     CompletenessResult isFishComplete(QList<PathologyPropertyInfo>* missingProperties);
+    CompletenessResult isComplete(Category category, QList<PathologyPropertyInfo>* missingProperties);
+
+    /**
+      Returns the completeness of the patient's first disease.
+      It is computed once and cached on the disease until its pathology data changes,
+      see Disease::invalidateDerivedData().
+      */
+    const ResultCompleteness& completeness();
+
+    /**
+      Cohort-wide report: For each property, the number of patients for which it is missing
+      in the given category. Patients with an undefined category are not counted.
+      */
+    static QMap<PathologyPropertyInfo::Property, int> missingProperties(const QList<Patient::Ptr>& patients,
+                                                                        Category category);
 
 protected:
 
     Patient::Ptr const p;
+    // keeps the cached completeness alive while it is referenced
+    QSharedPointer<const ResultCompleteness> m_completeness;
+};
+
+/**
+  The completeness of the pathology results of a disease.
+  Properties are stored as bit masks, with bit i set for PathologyPropertyInfo::Property i.
+  Which properties are required depends on the entity, the date of the profile pathology
+  and on some results (e.g. KRAS wild-type in colorectal cancer requires further mutations).
+  Properties which are relevant for the entity, but not required given the results, are optional.
+  */
+class ResultCompleteness
+{
+public:
+
+    typedef quint64 Mask;
+
+    class CategoryState
+    {
+    public:
+
+        CategoryState()
+            : result(ResultCompletenessChecker::Undefined), required(0), optional(0), missing(0)
+        {
+        }
+
+        ResultCompletenessChecker::CompletenessResult result;
+        Mask required;
+        Mask optional;
+        Mask missing;
+    };
+
+    ResultCompleteness() : present(0) {}
+
+    /// Computes the completeness of the given disease
+    static ResultCompleteness compute(const Disease& disease);
+
+    /// The properties with a set bit, in order of their Property value
+    static QList<PathologyPropertyInfo> properties(Mask mask);
+    static Mask mask(PathologyPropertyInfo::Property property) { return Mask(1) << property; }
+
+    const CategoryState& state(ResultCompletenessChecker::Category category) const { return categories[category]; }
+
+    /// Properties with a value in any pathology of the disease
+    Mask          present;
+    CategoryState categories[ResultCompletenessChecker::NumberOfCategories];
 };
 
 #endif // RESULTCOMPLETENESSCHECKER_H
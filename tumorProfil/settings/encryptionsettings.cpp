@@ -14,6 +14,7 @@
 #include "databaseaccess.h"
 #include "patientdb.h"
 #include "authentication/userinformation.h"
+#include "patientmanager.h"
 
 namespace
 {
@@ -182,6 +183,8 @@ void EncryptionSettings::setupUi()
 
 void EncryptionSettings::encryptDecryptAll(EncryptionSettings::EncryptAction action)
 {
+    // queued writes must not overwrite the converted patients
+    PatientManager::instance()->flush();
 
     if(DatabaseAccess().db()->setting(DB_ABOUT_TO_BE_ENCRYPTED) == QLatin1String("1"))
     {
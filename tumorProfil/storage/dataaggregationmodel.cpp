@@ -32,6 +32,7 @@
 #include "actionableresultchecker.h"
 #include "dataaggregator.h"
 #include "patientpropertymodel.h"
+#include "tracing.h"
 
 class DataAggregationModel::DataAggregationModelPriv
 {
@@ -49,7 +50,7 @@ public:
     QList<AggregatedDatumInfo> rows;
     QList< QMap<AggregatedDatumInfo, QVariant> > columns;
     QStringList extraColumnTitles;
-    QList< QList<PathologyPropertyInfo> > extraCombinations; // corresponding to extraColumnTitles
+    ActionableCombinations extraCombinations; // corresponding to extraColumnTitles
 
     QTimer* recomputeTimer;
 
@@ -148,6 +149,7 @@ void DataAggregationModel::resetData()
 
 void DataAggregationModel::computeData()
 {
+    TRACE_SPAN("DataAggregationModel::computeData");
     QSet<AggregatedDatumInfo> rowFields;
     QList< QMap<AggregatedDatumInfo, QVariant> > cols;
     QList<AggregatedDatumInfo> rows;
@@ -214,31 +216,19 @@ void DataAggregationModel::computeData()
         patientList << PatientModel::retrievePatient(index);
     }
 
-    QMap< QList<PathologyPropertyInfo>, DataAggregator* > actionableCombinations = ActionableResultChecker::actionableCombinations(patientList, d->actionableResultsFlags);
+    ActionableCombinations actionableCombinations = ActionableResultChecker::actionableCombinations(patientList, d->actionableResultsFlags);
 
-    // Read information from DataAggregators, add extra columns
-    QMap< QList<PathologyPropertyInfo>,  DataAggregator* >::const_iterator it;
-    for (it = actionableCombinations.begin(); it != actionableCombinations.end(); ++it)
+    // Read aggregated counts, add extra columns
+    for (int i=0; i<actionableCombinations.size(); ++i)
     {
-        QMap<AggregatedDatumInfo,QVariant> map = it.value()->values();
-        for (QMap<AggregatedDatumInfo,QVariant>::const_iterator it2=map.begin(); it2 != map.end(); ++it2)
+        QMap<AggregatedDatumInfo,QVariant> map = actionableCombinations.values(i);
+        for (QMap<AggregatedDatumInfo,QVariant>::const_iterator it=map.begin(); it != map.end(); ++it)
         {
-            rowFields << it2.key();
+            rowFields << it.key();
         }
         cols << map;
-        QStringList titles;
-        foreach (const PathologyPropertyInfo& info, it.key())
-        {
-            titles << info.plainTextLabel();
-        }
-        if (titles.isEmpty())
-        {
-            titles << "Kein relevanter Befund";
-        }
-        extraColumnTitles << titles.join(", ");
-
+        extraColumnTitles << actionableCombinations.label(i);
     }
-    qDeleteAll(actionableCombinations);
 
     // Apply changes to model
 
@@ -251,7 +241,7 @@ void DataAggregationModel::computeData()
     d->columns = cols;
     d->rows = rows;
     d->extraColumnTitles = extraColumnTitles;
-    d->extraCombinations = actionableCombinations.keys();
+    d->extraCombinations = actionableCombinations;
     layoutChanged();
 }
 
@@ -418,7 +408,7 @@ QList<QModelIndex> DataAggregationModel::sourceModelReferenceIndexes(const QMode
             Patient::Ptr p = PatientModel::retrievePatient(index);
 
             ActionableResultChecker checker(p, d->actionableResultsFlags);
-            if (checker.hasResults(d->extraCombinations[extraColumn]).toBool())
+            if (checker.hasResults(d->extraCombinations.mask(extraColumn)).toBool())
             {
                 results << index;
             }
@@ -26,12 +26,14 @@
 // Qt includes
 
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QMutex>
 #include <QSqlDatabase>
 
 // Local includes
 
 #include "databasecorebackend.h"
+#include "databaseprofiler.h"
 #include "patientdb.h"
 #include "schemaupdater.h"
 
@@ -102,7 +104,14 @@ void DatabaseAccessPriv::checkBackend()
 
 void DatabaseAccessPriv::constructorLock()
 {
-    lock.mutex.lock();
+    // Only contended acquisitions are timed
+    if (!lock.mutex.tryLock())
+    {
+        QElapsedTimer timer;
+        timer.start();
+        lock.mutex.lock();
+        DatabaseProfiler::instance()->recordLockWait(timer.nsecsElapsed());
+    }
     lock.lockCount++;
 }
 
@@ -35,6 +35,7 @@
 #include <QApplication>
 #include <QCoreApplication>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QHash>
 #include <QMap>
@@ -42,12 +43,14 @@
 #include <QSqlDatabase>
 #include <QSqlDriver>
 #include <QSqlError>
+#include <QSqlQuery>
 #include <QSqlRecord>
 #include <QThread>
 #include <QTime>
 
 // Local includes
 
+#include "databaseprofiler.h"
 #include "schemaupdater.h"
 #include "dbactiontype.h"
 #include "authentication/userinformation.h"
@@ -188,11 +191,20 @@ bool DatabaseCoreBackendPrivate::open(QSqlDatabase& db)
 
     if (parameters.isSQLite())
     {
+        sqliteTuning = SQLiteTuning(connectOptions);
+        connectOptions = sqliteTuning.driverOptions();
+
         QStringList toAdd;
-        // enable shared cache, especially useful with SQLite >= 3.5.0
-        toAdd << "QSQLITE_ENABLE_SHARED_CACHE";
-        // We do our own waiting.
-        toAdd << "QSQLITE_BUSY_TIMEOUT=0";
+        if (!sqliteTuning.enabled)
+        {
+            // enable shared cache, especially useful with SQLite >= 3.5.0
+            toAdd << "QSQLITE_ENABLE_SHARED_CACHE";
+        }
+        // Without shared cache, each thread has a private connection. In WAL mode,
+        // the background thread reading the database does not block saving in the UI thread.
+        // SQLite waits for locks held by other processes. Within this process,
+        // we wait for transactions of other threads ourselves, see waitForTransactionsInOtherThreads.
+        toAdd << "QSQLITE_BUSY_TIMEOUT=" + QString::number(sqliteTuning.busyTimeout);
 
         if (!connectOptions.isEmpty())
         {
@@ -215,10 +227,22 @@ bool DatabaseCoreBackendPrivate::open(QSqlDatabase& db)
     {
         qDebug() << "Error while opening the database. Error was <" << db.lastError() << ">";
     }
+    else if (parameters.isSQLite())
+    {
+        QSqlQuery query(db);
+        foreach (const QString& pragma, sqliteTuning.pragmas())
+        {
+            if (!query.exec(pragma))
+            {
+                qWarning() << "Failed to set" << pragma << query.lastError();
+            }
+        }
+    }
 
     threadDatabases[thread]  = db;
     databasesValid[thread]   = 1;
     transactionCount[thread] = 0;
+    transactionAborted.remove(thread);
 
     return success;
 }
@@ -309,17 +333,15 @@ bool DatabaseCoreBackendPrivate::needToHandleWithErrorHandler(const SqlQuery& qu
 
 bool DatabaseCoreBackendPrivate::checkRetrySQLiteLockError(int retries)
 {
-    qDebug() << "Database is locked. Waited" << retries*10;
-    const int uiMaxRetries = 50;
-    const int maxRetries = 1000;
+    qDebug() << "Database is locked. Retry" << retries;
+    // With a busy timeout, SQLite has already waited that long for each attempt
+    const int uiMaxRetries = sqliteTuning.busyTimeout ? 2 : 50;
+    const int maxRetries   = sqliteTuning.busyTimeout ? 5 : 1000;
 
-    if (retries > qMax(uiMaxRetries, maxRetries))
+    if (retries > (isInUIThread() ? uiMaxRetries : maxRetries))
     {
-        if (retries > (isInUIThread() ? uiMaxRetries : maxRetries))
-        {
-            qWarning() << "Detected locked database file. There is an active transaction. Waited but giving up now.";
-            return false;
-        }
+        qWarning() << "Detected locked database file. There is an active transaction. Waited but giving up now.";
+        return false;
     }
 
     BusyWaiter waiter(this);
@@ -327,6 +349,60 @@ bool DatabaseCoreBackendPrivate::checkRetrySQLiteLockError(int retries)
     return true;
 }
 
+void DatabaseCoreBackendPrivate::countStatement(bool success)
+{
+    QThread* thread = QThread::currentThread();
+    statementCounts[thread]++;
+    if (!success)
+    {
+        failedStatementCounts[thread]++;
+    }
+}
+
+bool DatabaseCoreBackendPrivate::startTransaction(QSqlDatabase& db, QSqlError& error)
+{
+    if (parameters.isSQLite() && sqliteTuning.enabled)
+    {
+        // Take the write lock at once. A deferred transaction upgrading from read to write
+        // fails with SQLITE_BUSY without the busy handler being called.
+        QSqlQuery query(db);
+        if (query.exec("BEGIN IMMEDIATE"))
+        {
+            return true;
+        }
+        error = QSqlError(query.lastError().driverText(), query.lastError().databaseText(),
+                          QSqlError::TransactionError, query.lastError().nativeErrorCode());
+        return false;
+    }
+
+    if (db.transaction())
+    {
+        return true;
+    }
+    error = db.lastError();
+    return false;
+}
+
+void DatabaseCoreBackendPrivate::waitForTransactionsInOtherThreads(const QString& sql)
+{
+    // SQLite's busy handler would wait while we hold the DatabaseAccess lock,
+    // which the other thread needs to finish its transaction. Readers do not wait in WAL mode.
+    if (!parameters.isSQLite() || !sqliteTuning.busyTimeout)
+    {
+        return;
+    }
+    if (sqliteTuning.journalMode == "WAL" && sql.trimmed().startsWith("SELECT", Qt::CaseInsensitive))
+    {
+        return;
+    }
+    while (!transactionCount.value(QThread::currentThread()) && isInTransactionInOtherThread())
+    {
+        BusyWaiter waiter(this);
+        // woken by transactionFinished
+        waiter.wait(100);
+    }
+}
+
 void DatabaseCoreBackendPrivate::debugOutputFailedQuery(const QSqlQuery& query) const
 {
     qDebug() << "Failure executing query:\n"
@@ -414,9 +490,9 @@ DatabaseCoreBackendPrivate::BusyWaiter::BusyWaiter(DatabaseCoreBackendPrivate* d
 
 void DatabaseCoreBackendPrivate::transactionFinished()
 {
-    // wakes up any BusyWaiter waiting on the busyWaitCondVar.
+    // wakes up all BusyWaiters waiting on the busyWaitCondVar.
     // Possibly called under d->lock->mutex lock, so we do not lock the busyWaitMutex
-    busyWaitCondVar.wakeOne();
+    busyWaitCondVar.wakeAll();
 }
 
 DatabaseCoreBackendPrivate::ErrorLocker::ErrorLocker(DatabaseCoreBackendPrivate* d)
@@ -839,13 +915,16 @@ QList<QVariant> DatabaseCoreBackend::readToList(SqlQuery& query)
     QSqlRecord record = query.record();
     int count = record.count();
 
+    int rows = 0;
     while (query.next())
     {
         for (int i=0; i<count; ++i)
         {
             list << query.value(i);
         }
+        rows++;
     }
+    DatabaseProfiler::instance()->recordRows(query.lastQuery(), rows);
 
 #ifdef DATABASCOREBACKEND_DEBUG
     qDebug() << "Setting result value list ["<< list <<"]";
@@ -1359,8 +1438,11 @@ DatabaseCoreBackend::QueryState DatabaseCoreBackend::execDirectSql(const QString
         return DatabaseCoreBackend::SQLError;
     }
 
+    d->waitForTransactionsInOtherThreads(sql);
     SqlQuery query = getQuery();
 
+    QElapsedTimer timer;
+    timer.start();
     int retries = 0;
     forever
     {
@@ -1375,9 +1457,15 @@ DatabaseCoreBackend::QueryState DatabaseCoreBackend::execDirectSql(const QString
                 continue;
             }
             else
-                { return DatabaseCoreBackend::SQLError; }
+            {
+                DatabaseProfiler::instance()->recordQuery(sql, timer.nsecsElapsed(), retries);
+                d->countStatement(false);
+                return DatabaseCoreBackend::SQLError;
+            }
         }
     }
+    DatabaseProfiler::instance()->recordQuery(sql, timer.nsecsElapsed(), retries);
+    d->countStatement(true);
     return DatabaseCoreBackend::NoErrors;
 }
 
@@ -1390,6 +1478,10 @@ bool DatabaseCoreBackend::exec(SqlQuery& query)
         return false;
     }
 
+    d->waitForTransactionsInOtherThreads(query.lastQuery());
+
+    QElapsedTimer timer;
+    timer.start();
     int retries = 0;
     forever
     {
@@ -1408,9 +1500,15 @@ bool DatabaseCoreBackend::exec(SqlQuery& query)
                 continue;
             }
             else
-                { return false; }
+            {
+                DatabaseProfiler::instance()->recordQuery(query.lastQuery(), timer.nsecsElapsed(), retries);
+                d->countStatement(false);
+                return false;
+            }
         }
     }
+    DatabaseProfiler::instance()->recordQuery(query.lastQuery(), timer.nsecsElapsed(), retries);
+    d->countStatement(true);
     return true;
 }
 
@@ -1423,6 +1521,14 @@ bool DatabaseCoreBackend::execBatch(SqlQuery& query)
         return false;
     }
 
+    d->waitForTransactionsInOtherThreads(query.lastQuery());
+
+    // rows of a batch: the size of the bound value lists
+    const QList<QVariant> boundValues = query.boundValues().values();
+    const int rows = boundValues.isEmpty() ? 0 : boundValues.first().toList().size();
+
+    QElapsedTimer timer;
+    timer.start();
     int retries = 0;
     forever
     {
@@ -1437,15 +1543,23 @@ bool DatabaseCoreBackend::execBatch(SqlQuery& query)
                 continue;
             }
             else
-                { return false; }
+            {
+                DatabaseProfiler::instance()->recordBatch(query.lastQuery(), timer.nsecsElapsed(), retries, rows);
+                d->countStatement(false);
+                return false;
+            }
         }
     }
+    DatabaseProfiler::instance()->recordBatch(query.lastQuery(), timer.nsecsElapsed(), retries, rows);
+    d->countStatement(true);
     return true;
 }
 
 
 SqlQuery DatabaseCoreBackend::prepareQuery(const QString& sql)
 {
+    QElapsedTimer timer;
+    timer.start();
     int retries=0;
     forever
     {
@@ -1453,6 +1567,7 @@ SqlQuery DatabaseCoreBackend::prepareQuery(const QString& sql)
 
         if (query.prepare(sql))
         {
+            DatabaseProfiler::instance()->recordPrepare(sql, timer.nsecsElapsed(), retries);
             return query;
         }
         else
@@ -1465,6 +1580,7 @@ SqlQuery DatabaseCoreBackend::prepareQuery(const QString& sql)
             }
             else
             {
+                DatabaseProfiler::instance()->recordPrepare(sql, timer.nsecsElapsed(), retries);
                 return query;
             }
         }
@@ -1508,18 +1624,24 @@ DatabaseCoreBackend::QueryState DatabaseCoreBackend::beginTransaction()
     // Call databaseForThread before touching transaction count - open() will reset the count!
     QSqlDatabase db = d->databaseForThread();
 
+    if (!d->transactionCount.value(QThread::currentThread()))
+    {
+        d->waitForTransactionsInOtherThreads(QString());
+    }
+
     if (d->incrementTransactionCount())
     {
         int retries = 0;
         forever
         {
-            if (db.transaction())
+            QSqlError error;
+            if (d->startTransaction(db, error))
             {
                 break;
             }
             else
             {
-                if (transactionErrorHandling(db.lastError(), retries++))
+                if (transactionErrorHandling(error, retries++))
                 {
                     continue;
                 }
@@ -1549,11 +1671,24 @@ DatabaseCoreBackend::QueryState DatabaseCoreBackend::commitTransaction()
     if (d->decrementTransactionCount())
     {
         QSqlDatabase db = d->databaseForThread();
+
+        if (d->transactionAborted.take(QThread::currentThread()))
+        {
+            qDebug() << "A nested transaction was aborted. Starting rollback.";
+            db.rollback();
+            d->isInTransaction = false;
+            d->transactionFinished();
+            return DatabaseCoreBackend::SQLError;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
         int retries = 0;
         forever
         {
             if (db.commit())
             {
+                DatabaseProfiler::instance()->recordQuery("COMMIT", timer.nsecsElapsed(), retries);
                 break;
             }
             else
@@ -1568,6 +1703,8 @@ DatabaseCoreBackend::QueryState DatabaseCoreBackend::commitTransaction()
                 {
                     qDebug() << "Failed to commit transaction. Starting rollback.";
                     db.rollback();
+                    d->isInTransaction = false;
+                    d->transactionFinished();
 
                     if (lastError.type() == QSqlError::ConnectionError)
                     {
@@ -1585,6 +1722,18 @@ DatabaseCoreBackend::QueryState DatabaseCoreBackend::commitTransaction()
     return DatabaseCoreBackend::NoErrors;
 }
 
+int DatabaseCoreBackend::statementCount() const
+{
+    Q_D(const DatabaseCoreBackend);
+    return d->statementCounts.value(QThread::currentThread());
+}
+
+int DatabaseCoreBackend::failedStatementCount() const
+{
+    Q_D(const DatabaseCoreBackend);
+    return d->failedStatementCounts.value(QThread::currentThread());
+}
+
 bool DatabaseCoreBackend::isInTransaction() const
 {
     Q_D(const DatabaseCoreBackend);
@@ -1598,12 +1747,41 @@ void DatabaseCoreBackend::rollbackTransaction()
     d->databaseForThread().rollback();
 }
 
+void DatabaseCoreBackend::abortTransaction()
+{
+    Q_D(DatabaseCoreBackend);
+
+    if (d->decrementTransactionCount())
+    {
+        d->transactionAborted.remove(QThread::currentThread());
+        d->databaseForThread().rollback();
+        d->isInTransaction = false;
+        d->transactionFinished();
+    }
+    else
+    {
+        d->transactionAborted[QThread::currentThread()] = true;
+    }
+}
+
 QStringList DatabaseCoreBackend::tables()
 {
     Q_D(DatabaseCoreBackend);
     return d->databaseForThread().tables();
 }
 
+QStringList DatabaseCoreBackend::columns(const QString& table)
+{
+    Q_D(DatabaseCoreBackend);
+    QSqlRecord record = d->databaseForThread().record(table);
+    QStringList names;
+    for (int i=0; i<record.count(); i++)
+    {
+        names << record.fieldName(i);
+    }
+    return names;
+}
+
 QSqlError DatabaseCoreBackend::lastSQLError()
 {
     Q_D(DatabaseCoreBackend);
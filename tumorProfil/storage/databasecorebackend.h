@@ -392,6 +392,12 @@ public:
      * Rollback the current database transaction
      */
     void rollbackTransaction();
+    /**
+     * Ends the current database transaction as commitTransaction(), but rolls it back.
+     * If the transaction is nested, the outermost transaction is rolled back when it ends,
+     * and commitTransaction() returns SQLError.
+     */
+    void abortTransaction();
     /**
      * Returns if the database is in a different thread in a transaction.
      * Note that a transaction does not require holding DatabaseAccess.
@@ -400,11 +406,23 @@ public:
      */
     bool isInTransaction() const;
 
+    /**
+     * Returns the number of statements executed, and the number of statements which failed,
+     * by the current thread since the backend was created.
+     */
+    int statementCount() const;
+    int failedStatementCount() const;
+
     /**
      * Returns a list with the names of tables in the database.
      */
     QStringList tables();
 
+    /**
+     * Returns a list with the names of the columns of the given table.
+     */
+    QStringList columns(const QString& table);
+
     /**
      * Returns a description of the last error that occurred on this database.
      * Use DatabaseAccess::lastError for errors presented to the user.
@@ -34,6 +34,7 @@
 // Local includes
 
 #include "databaseparameters.h"
+#include "sqlitetuning.h"
 
 class DatabaseCoreBackendPrivate : public DatabaseErrorAnswer
 {
@@ -62,6 +63,9 @@ public:
     bool isSQLiteLockError(const SqlQuery& query) const;
     bool isSQLiteLockTransactionError(const QSqlError& lastError) const;
     bool checkRetrySQLiteLockError(int retries);
+    bool startTransaction(QSqlDatabase& db, QSqlError& error);
+    void countStatement(bool success);
+    void waitForTransactionsInOtherThreads(const QString& sql);
     bool isConnectionError(const SqlQuery& query) const;
     bool needToConsultUserForError(const SqlQuery& query) const;
     bool needToHandleWithErrorHandler(const SqlQuery& query) const;
@@ -86,15 +90,23 @@ public:
     QHash<QThread*, int>                      databasesValid;
     // for recursive transactions
     QHash<QThread*, int>                      transactionCount;
+    // a nested transaction was aborted, the outermost one is rolled back
+    QHash<QThread*, bool>                     transactionAborted;
 
     QHash<QThread*, QSqlError>                databaseErrors;
 
+    // executed and failed statements, used by DatabaseOperationGroup
+    QHash<QThread*, int>                      statementCounts;
+    QHash<QThread*, int>                      failedStatementCounts;
+
     bool                                      isInTransaction;
 
     QString                                   backendName;
 
     DatabaseParameters                        parameters;
 
+    SQLiteTuning                              sqliteTuning;
+
     DatabaseCoreBackend::Status               status;
 
     DatabaseLocking*                          lock;
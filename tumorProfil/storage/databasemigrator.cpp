@@ -0,0 +1,511 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#include "databasemigrator.h"
+
+// Qt includes
+
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QRegExp>
+#include <QScopedPointer>
+#include <QSqlField>
+#include <QSqlRecord>
+#include <QStringList>
+#include <QVector>
+
+// Local includes
+
+#include "databaseaccess.h"
+#include "databasecorebackend.h"
+#include "databaseinitializationobserver.h"
+#include "schemaupdater.h"
+#include "tracing.h"
+
+namespace
+{
+
+class MigrationObserver : public InitializationObserver
+{
+public:
+
+    virtual bool continueQuery() { return true; }
+    virtual void moreSchemaUpdateSteps(int) {}
+    virtual void schemaUpdateProgress(const QString& message, int) { qDebug() << message; }
+    virtual void finishedSchemaUpdate(UpdateResult) {}
+    virtual void error(const QString& errorMessage) { errors << errorMessage; }
+
+    QStringList errors;
+};
+
+/**
+  Sum of 64-bit FNV-1a hashes of the rows, independent of row order.
+  Values are normalized so that the types returned by different drivers compare equal.
+  */
+class TableChecksum
+{
+public:
+
+    TableChecksum()
+        : rows(0), sum(0), m_rowHash(offsetBasis)
+    {
+    }
+
+    void addValue(const QVariant& value, bool dateColumn)
+    {
+        hash(normalized(value, dateColumn));
+        hash(QByteArray(1, '\x1f'));
+    }
+
+    void finishRow()
+    {
+        sum += m_rowHash;
+        rows++;
+        m_rowHash = offsetBasis;
+    }
+
+    bool operator==(const TableChecksum& other) const
+    {
+        return rows == other.rows && sum == other.sum;
+    }
+
+    qint64  rows;
+    quint64 sum;
+
+private:
+
+    static const quint64 offsetBasis = Q_UINT64_C(14695981039346656037);
+
+    void hash(const QByteArray& data)
+    {
+        for (int i=0; i<data.size(); i++)
+        {
+            m_rowHash ^= uchar(data[i]);
+            m_rowHash *= Q_UINT64_C(1099511628211);
+        }
+    }
+
+    static QByteArray normalized(const QVariant& value, bool dateColumn)
+    {
+        if (value.isNull())
+        {
+            return QByteArray("\\N");
+        }
+        if (dateColumn)
+        {
+            // SQLite returns the stored text, MySQL a QDateTime
+            QDateTime dateTime;
+            if (value.type() == QVariant::Date || value.type() == QVariant::DateTime)
+            {
+                dateTime = value.toDateTime();
+            }
+            else
+            {
+                dateTime = QDateTime::fromString(value.toString().replace(' ', 'T'), Qt::ISODate);
+            }
+            if (dateTime.isValid())
+            {
+                return (dateTime.time() == QTime(0, 0) ? dateTime.date().toString(Qt::ISODate)
+                                                       : dateTime.toString(Qt::ISODate)).toUtf8();
+            }
+        }
+        switch (value.type())
+        {
+        case QVariant::Int:
+        case QVariant::UInt:
+        case QVariant::LongLong:
+        case QVariant::ULongLong:
+        case QVariant::Bool:
+            return QByteArray::number(value.toLongLong());
+        case QVariant::Double:
+            return QByteArray::number(value.toDouble(), 'g', 15);
+        case QVariant::ByteArray:
+            return value.toByteArray();
+        default:
+            return value.toString().toUtf8();
+        }
+    }
+
+    quint64 m_rowHash;
+};
+
+}
+
+class DatabaseMigrator::DatabaseMigratorPriv
+{
+public:
+
+    DatabaseMigratorPriv(DatabaseMigrator* q)
+        : rowsPerStatement(500),
+          rowsPerTransaction(20000),
+          verify(true),
+          source(0),
+          target(0),
+          copiedRows(0),
+          q(q)
+    {
+    }
+
+    bool fail(const QString& message)
+    {
+        qWarning() << "Migration:" << message;
+        lastError = message;
+        return false;
+    }
+
+    int maximumBoundValues() const
+    {
+        // SQLITE_MAX_VARIABLE_NUMBER in older versions, and the limit of the MySQL protocol
+        return targetParameters.isSQLite() ? 999 : 65535;
+    }
+
+    static QString insertStatement(const QString& table, const QStringList& columns, int rows)
+    {
+        const QString row = '(' + QString("?, ").repeated(columns.size() - 1) + "?)";
+        QString sql = "INSERT INTO " + table + " (" + columns.join(", ") + ") VALUES ";
+        sql.reserve(sql.size() + rows * (row.size() + 2));
+        for (int i=0; i<rows; i++)
+        {
+            if (i)
+            {
+                sql += ", ";
+            }
+            sql += row;
+        }
+        return sql + ';';
+    }
+
+    bool insertRows(SqlQuery& statement, const QVector<QVariant>& values)
+    {
+        for (int i=0; i<values.size(); i++)
+        {
+            statement.bindValue(i, values[i]);
+        }
+        return target->backend()->exec(statement);
+    }
+
+    /// The schema version is the target's own, it is not copied from the source
+    static QString rowFilter(const QString& table)
+    {
+        if (table.compare("Settings", Qt::CaseInsensitive) == 0)
+        {
+            return " WHERE keyword NOT IN ('DBVersion', 'DBVersionRequired')";
+        }
+        return QString();
+    }
+
+    bool copyTable(const QString& sourceTable, const QString& targetTable, TableChecksum* checksum, QVector<bool>* dateColumnsResult, QStringList* columnsResult);
+    bool readChecksum(const QString& table, const QStringList& columns, const QVector<bool>& dateColumns, TableChecksum* checksum);
+
+    int                 rowsPerStatement;
+    int                 rowsPerTransaction;
+    bool                verify;
+    QString             lastError;
+
+    DatabaseParameters  targetParameters;
+    DatabaseAccess*     source;
+    DatabaseAccess*     target;
+    int                 copiedRows;
+
+    DatabaseMigrator* const q;
+};
+
+bool DatabaseMigrator::DatabaseMigratorPriv::copyTable(const QString& sourceTable, const QString& targetTable,
+                                                        TableChecksum* checksum, QVector<bool>* dateColumnsResult,
+                                                        QStringList* columnsResult)
+{
+    TRACE_SPAN("DatabaseMigrator::copyTable");
+    DatabaseCoreBackend* from = source->backend();
+    DatabaseCoreBackend* to   = target->backend();
+
+    SqlQuery read = from->prepareQuery("SELECT * FROM " + sourceTable + rowFilter(sourceTable) + ';');
+    read.setForwardOnly(true);
+    if (!from->exec(read))
+    {
+        return fail("Cannot read table " + sourceTable + ": " + from->lastError());
+    }
+    const QSqlRecord record = read.record();
+    const int columnCount   = record.count();
+    QStringList columns;
+    for (int i=0; i<columnCount; i++)
+    {
+        columns << record.fieldName(i);
+    }
+
+    // The target's column types decide how dates are written and compared
+    SqlQuery probe = to->execQuery("SELECT " + columns.join(", ") + " FROM " + targetTable + " WHERE 1=0;");
+    if (!probe.isActive())
+    {
+        return fail("Table " + targetTable + " in the target does not have the columns " + columns.join(", "));
+    }
+    QVector<bool> dateColumns(columnCount);
+    for (int i=0; i<columnCount; i++)
+    {
+        const QVariant::Type type = probe.record().field(i).type();
+        dateColumns[i] = (type == QVariant::Date || type == QVariant::DateTime);
+    }
+
+    // The schema updater has written its settings, the source's are copied, except for the schema version
+    to->execSql("DELETE FROM " + targetTable + rowFilter(targetTable) + ';');
+
+    const int rowsPerInsert = qMax(1, qMin(rowsPerStatement, maximumBoundValues() / columnCount));
+    SqlQuery fullInsert = to->prepareQuery(insertStatement(targetTable, columns, rowsPerInsert));
+
+    QVector<QVariant> pending;
+    pending.reserve(rowsPerInsert * columnCount);
+    int pendingRows       = 0;
+    int rowsInTransaction = 0;
+
+    to->beginTransaction();
+    while (read.next())
+    {
+        for (int i=0; i<columnCount; i++)
+        {
+            QVariant value = read.value(i);
+            // an empty string is not a valid DATETIME
+            if (dateColumns[i] && !value.isNull() && value.toString().isEmpty())
+            {
+                value = QVariant(QVariant::String);
+            }
+            checksum->addValue(value, dateColumns[i]);
+            pending << value;
+        }
+        checksum->finishRow();
+
+        if (++pendingRows < rowsPerInsert)
+        {
+            continue;
+        }
+        if (!insertRows(fullInsert, pending))
+        {
+            to->rollbackTransaction();
+            return fail("Failed to insert into " + targetTable + ": " + to->lastError());
+        }
+        pending.clear();
+        pendingRows        = 0;
+        rowsInTransaction += rowsPerInsert;
+        copiedRows        += rowsPerInsert;
+        emit q->progressValue(copiedRows);
+
+        if (rowsInTransaction >= rowsPerTransaction)
+        {
+            if (to->commitTransaction() != DatabaseCoreBackend::NoErrors)
+            {
+                return fail("Failed to commit rows of " + targetTable + ": " + to->lastError());
+            }
+            to->beginTransaction();
+            rowsInTransaction = 0;
+        }
+    }
+
+    if (pendingRows)
+    {
+        SqlQuery lastInsert = to->prepareQuery(insertStatement(targetTable, columns, pendingRows));
+        if (!insertRows(lastInsert, pending))
+        {
+            to->rollbackTransaction();
+            return fail("Failed to insert into " + targetTable + ": " + to->lastError());
+        }
+        copiedRows += pendingRows;
+        emit q->progressValue(copiedRows);
+    }
+    if (to->commitTransaction() != DatabaseCoreBackend::NoErrors)
+    {
+        return fail("Failed to commit rows of " + targetTable + ": " + to->lastError());
+    }
+
+    *dateColumnsResult = dateColumns;
+    *columnsResult     = columns;
+    return true;
+}
+
+bool DatabaseMigrator::DatabaseMigratorPriv::readChecksum(const QString& table, const QStringList& columns,
+                                                          const QVector<bool>& dateColumns, TableChecksum* checksum)
+{
+    TRACE_SPAN("DatabaseMigrator::readChecksum");
+    DatabaseCoreBackend* to = target->backend();
+    SqlQuery read = to->prepareQuery("SELECT " + columns.join(", ") + " FROM " + table + rowFilter(table) + ';');
+    read.setForwardOnly(true);
+    if (!to->exec(read))
+    {
+        return fail("Cannot read back table " + table + ": " + to->lastError());
+    }
+    while (read.next())
+    {
+        for (int i=0; i<columns.size(); i++)
+        {
+            checksum->addValue(read.value(i), dateColumns[i]);
+        }
+        checksum->finishRow();
+    }
+    return true;
+}
+
+DatabaseMigrator::DatabaseMigrator(QObject* parent)
+    : QObject(parent),
+      d(new DatabaseMigratorPriv(this))
+{
+}
+
+DatabaseMigrator::~DatabaseMigrator()
+{
+    delete d;
+}
+
+void DatabaseMigrator::setRowsPerStatement(int rows)
+{
+    d->rowsPerStatement = qMax(1, rows);
+}
+
+void DatabaseMigrator::setRowsPerTransaction(int rows)
+{
+    d->rowsPerTransaction = qMax(1, rows);
+}
+
+void DatabaseMigrator::setVerify(bool verify)
+{
+    d->verify = verify;
+}
+
+QString DatabaseMigrator::lastError() const
+{
+    return d->lastError;
+}
+
+bool DatabaseMigrator::migrate(const DatabaseParameters& source, const DatabaseParameters& target)
+{
+    TRACE_SPAN("DatabaseMigrator::migrate");
+    QElapsedTimer timer;
+    timer.start();
+    d->lastError.clear();
+    d->copiedRows       = 0;
+    d->targetParameters = target;
+
+    MigrationObserver observer;
+    // The source is read as it is, without a schema update: it is not modified, and legacy schemas can be read
+    QScopedPointer<DatabaseAccess> sourceAccess(DatabaseAccess::createExternalAccess(source));
+    if (!sourceAccess)
+    {
+        return d->fail("Cannot open the source database");
+    }
+    QScopedPointer<DatabaseAccess> targetAccess(DatabaseAccess::createExternalAccess(target));
+    if (!targetAccess)
+    {
+        return d->fail("Cannot open the target database");
+    }
+    d->source = sourceAccess.data();
+    d->target = targetAccess.data();
+
+    if (targetAccess->backend()->tables().contains("Patients", Qt::CaseInsensitive))
+    {
+        return d->fail("The target database is not empty");
+    }
+
+    // Tables only; indices and triggers would slow down the bulk copy
+    SchemaUpdater updater(targetAccess.data());
+    updater.setObserver(&observer);
+    updater.setDeferIndices(true);
+    if (!targetAccess->backend()->initSchema(&updater))
+    {
+        return d->fail("Cannot create the schema in the target database. " + observer.errors.join(' '));
+    }
+
+    const QStringList targetTables = targetAccess->backend()->tables();
+    QStringList sourceTables, matchingTargetTables;
+    int totalRows = 0;
+    foreach (const QString& table, sourceAccess->backend()->tables())
+    {
+        if (table.startsWith("sqlite_"))
+        {
+            continue;
+        }
+        const int index = targetTables.indexOf(QRegExp(QRegExp::escape(table), Qt::CaseInsensitive));
+        if (index == -1)
+        {
+            qWarning() << "Migration: table" << table << "is not part of the schema, skipped";
+            continue;
+        }
+        QList<QVariant> count;
+        sourceAccess->backend()->execSql("SELECT COUNT(*) FROM " + table + DatabaseMigratorPriv::rowFilter(table) + ';', &count);
+        totalRows += count.value(0).toInt();
+        sourceTables << table;
+        matchingTargetTables << targetTables[index];
+    }
+    emit progressStarted(totalRows);
+
+    bool verified = true;
+    for (int i=0; i<sourceTables.size(); i++)
+    {
+        QElapsedTimer tableTimer;
+        tableTimer.start();
+        TableChecksum sourceChecksum;
+        QVector<bool> dateColumns;
+        QStringList columns;
+        if (!d->copyTable(sourceTables[i], matchingTargetTables[i], &sourceChecksum, &dateColumns, &columns))
+        {
+            return false;
+        }
+        qDebug() << "Migration: copied" << sourceChecksum.rows << "rows of" << sourceTables[i]
+                 << "in" << tableTimer.elapsed() << "ms";
+
+        TableChecksum targetChecksum;
+        if (d->verify)
+        {
+            if (!d->readChecksum(matchingTargetTables[i], columns, dateColumns, &targetChecksum))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            QList<QVariant> count;
+            targetAccess->backend()->execSql("SELECT COUNT(*) FROM " + matchingTargetTables[i]
+                                             + DatabaseMigratorPriv::rowFilter(matchingTargetTables[i]) + ';', &count);
+            targetChecksum.rows = count.value(0).toLongLong();
+            targetChecksum.sum  = sourceChecksum.sum;
+        }
+        if (!(targetChecksum == sourceChecksum))
+        {
+            qWarning() << "Migration: table" << sourceTables[i] << "differs: source" << sourceChecksum.rows
+                       << "rows, checksum" << sourceChecksum.sum << "; target" << targetChecksum.rows
+                       << "rows, checksum" << targetChecksum.sum;
+            verified = false;
+        }
+    }
+
+    QElapsedTimer indexTimer;
+    indexTimer.start();
+    if (!updater.createDeferredIndices())
+    {
+        return d->fail("Cannot create indices in the target database: " + targetAccess->backend()->lastError());
+    }
+    qDebug() << "Migration: created indices and triggers in" << indexTimer.elapsed() << "ms";
+
+    if (!verified)
+    {
+        return d->fail("The copied tables differ from the source");
+    }
+    qDebug() << "Migration: copied" << d->copiedRows << "rows of" << sourceTables.size() << "tables from"
+             << source.databaseName << "to" << target.databaseName << "in" << timer.elapsed() << "ms";
+    return true;
+}
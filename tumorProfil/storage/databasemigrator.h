@@ -0,0 +1,83 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#ifndef DATABASEMIGRATOR_H
+#define DATABASEMIGRATOR_H
+
+// Qt includes
+
+#include <QObject>
+#include <QString>
+
+// Local includes
+
+#include "databaseparameters.h"
+
+/**
+  Copies a database into a new, empty database of possibly another type,
+  typically an SQLite file into MySQL, replacing database_conversion/sqliteToMySql.py.
+
+  The target schema is created by SchemaUpdater, without indices and triggers.
+  Each table is then read with a forward-only query and written with multi-row INSERT statements,
+  committed in chunks of rows. Ids are copied, not reassigned.
+  Indices and triggers are created after all tables are copied.
+
+  For verification, each table's row count and an order-independent checksum
+  of its rows are compared between source and target.
+  */
+class DatabaseMigrator : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit DatabaseMigrator(QObject* parent = 0);
+    ~DatabaseMigrator();
+
+    /// Rows per INSERT statement, reduced if the driver limits bound parameters. Default 500.
+    void setRowsPerStatement(int rows);
+    /// Rows per transaction. Default 20000.
+    void setRowsPerTransaction(int rows);
+    /// Read back the target to compare checksums. Default true.
+    void setVerify(bool verify);
+
+    /**
+      Migrates all tables. The source schema is updated to the current version if necessary.
+      Fails if the target database already contains the TumorProfil tables.
+      */
+    bool migrate(const DatabaseParameters& source, const DatabaseParameters& target);
+
+    QString lastError() const;
+
+signals:
+
+    /// Reported in rows of all tables
+    void progressStarted(int max);
+    void progressValue(int value);
+
+private:
+
+    class DatabaseMigratorPriv;
+    DatabaseMigratorPriv* const d;
+};
+
+#endif // DATABASEMIGRATOR_H
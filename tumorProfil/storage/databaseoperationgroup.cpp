@@ -38,37 +38,51 @@ public:
 
     DatabaseOperationGroupPriv()
     {
-        access   = 0;
-        acquired = false;
-        maxTime  = 0;
+        access        = 0;
+        mode          = DatabaseOperationGroup::SQLiteOnly;
+        acquired      = false;
+        maxTime       = 0;
+        maxStatements = 0;
+        statements    = 0;
+        succeeded     = true;
     }
 
 public:
 
-    DatabaseAccess* access;
-    bool            acquired;
-    QTime           timeAcquired;
-    int             maxTime;
+    DatabaseAccess*              access;
+    DatabaseOperationGroup::Mode mode;
+    bool                         acquired;
+    QTime                        timeAcquired;
+    int                          maxTime;
+    int                          maxStatements;
+    // statement count of the backend when the transaction was begun
+    int                          statements;
+    bool                         succeeded;
 
 public:
 
     bool needsTransaction() const
     {
-        return DatabaseAccess::parameters().isSQLite();
+        return mode == DatabaseOperationGroup::AllBackends || DatabaseAccess::parameters().isSQLite();
     }
 
     void acquire()
     {
         if (access)
         {
-            acquired = access->backend()->beginTransaction();
+            acquire(access);
         }
         else
         {
             DatabaseAccess access;
-            acquired = access.backend()->beginTransaction();
+            acquire(&access);
         }
+    }
 
+    void acquire(DatabaseAccess* access)
+    {
+        acquired   = access->backend()->beginTransaction() == DatabaseCoreBackend::NoErrors;
+        statements = access->backend()->statementCount();
         timeAcquired.start();
     }
 
@@ -78,30 +92,70 @@ public:
         {
             if (access)
             {
-                access->backend()->commitTransaction();
+                release(access);
             }
             else
             {
                 DatabaseAccess access;
-                access.backend()->commitTransaction();
+                release(&access);
             }
         }
     }
+
+    void release(DatabaseAccess* access)
+    {
+        // on failure, the backend has rolled back
+        succeeded = access->backend()->commitTransaction() == DatabaseCoreBackend::NoErrors;
+        acquired  = false;
+    }
+
+    void rollback()
+    {
+        if (access)
+        {
+            rollback(access);
+        }
+        else
+        {
+            DatabaseAccess access;
+            rollback(&access);
+        }
+    }
+
+    void rollback(DatabaseAccess* access)
+    {
+        access->backend()->abortTransaction();
+        succeeded = false;
+        acquired  = false;
+    }
+
+    int statementsSinceAcquire() const
+    {
+        if (access)
+        {
+            return access->backend()->statementCount() - statements;
+        }
+        DatabaseAccess access;
+        return access.backend()->statementCount() - statements;
+    }
 };
 
-DatabaseOperationGroup::DatabaseOperationGroup()
+DatabaseOperationGroup::DatabaseOperationGroup(Mode mode)
     : d(new DatabaseOperationGroupPriv)
 {
+    d->mode = mode;
+
     if (d->needsTransaction())
     {
         d->acquire();
     }
 }
 
-DatabaseOperationGroup::DatabaseOperationGroup(DatabaseAccess* access)
+DatabaseOperationGroup::DatabaseOperationGroup(DatabaseAccess* access, Mode mode)
     : d(new DatabaseOperationGroupPriv)
 {
     d->access = access;
+    d->mode   = mode;
 
     if (d->needsTransaction())
     {
@@ -115,7 +169,7 @@ DatabaseOperationGroup::~DatabaseOperationGroup()
     delete d;
 }
 
-void DatabaseOperationGroup::lift()
+bool DatabaseOperationGroup::lift()
 {
     if (d->acquired)
     {
@@ -127,7 +181,29 @@ void DatabaseOperationGroup::lift()
         }
 
         d->acquire();
+        return d->succeeded;
     }
+    return true;
+}
+
+void DatabaseOperationGroup::rollback()
+{
+    if (d->acquired)
+    {
+        d->rollback();
+        d->acquire();
+    }
+}
+
+bool DatabaseOperationGroup::commit()
+{
+    d->release();
+    return d->succeeded;
+}
+
+bool DatabaseOperationGroup::lastCommitSucceeded() const
+{
+    return d->succeeded;
 }
 
 void DatabaseOperationGroup::setMaximumTime(int msecs)
@@ -135,16 +211,27 @@ void DatabaseOperationGroup::setMaximumTime(int msecs)
     d->maxTime = msecs;
 }
 
+void DatabaseOperationGroup::setMaximumStatements(int count)
+{
+    d->maxStatements = count;
+}
+
 void DatabaseOperationGroup::resetTime()
 {
     d->timeAcquired.start();
 }
 
-void DatabaseOperationGroup::allowLift()
+bool DatabaseOperationGroup::allowLift()
 {
-    if (d->maxTime && d->timeAcquired.elapsed() > d->maxTime)
+    if (!d->acquired)
+    {
+        return false;
+    }
+    if ((d->maxTime && d->timeAcquired.elapsed() > d->maxTime)
+        || (d->maxStatements && d->statementsSinceAcquire() >= d->maxStatements))
     {
         lift();
+        return true;
     }
+    return false;
 }
-
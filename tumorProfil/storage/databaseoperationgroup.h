@@ -39,34 +39,60 @@ public:
      * group them while holding a DatabaseOperationGroup.
      * For some database systems (SQLite), keeping a transaction across write operations
      * occurring in short time results in enormous speedup (800x).
-     * For system that do not need this optimization, this class is a no-op.
+     * For system that do not need this optimization, this class is a no-op,
+     * unless AllBackends is given: then many small saves share one commit also on MySQL
+     * (group commit), bounded by setMaximumTime and setMaximumStatements.
      */
 
+    enum Mode
+    {
+        /// Use a transaction only where needed for speed (SQLite)
+        SQLiteOnly,
+        /// Use a transaction with all database backends
+        AllBackends
+    };
+
     /**
      * Retrieve a DatabaseAccess object each time when constructing and destructing.
      */
-    DatabaseOperationGroup();
+    explicit DatabaseOperationGroup(Mode mode = SQLiteOnly);
     /**
      * Use an existing DatabaseAccess object, which must live as long as this object exists.
      */
-    DatabaseOperationGroup(DatabaseAccess* access);
+    DatabaseOperationGroup(DatabaseAccess* access, Mode mode = SQLiteOnly);
     ~DatabaseOperationGroup();
 
     /**
      * This will - if a transaction is held - commit the transaction and acquire a new one.
      * This may improve concurrent access.
+     * Returns false if the commit failed. Then the changes since the last commit were rolled back.
+     */
+    bool lift();
+
+    /**
+     * If a transaction is held, rolls back the changes since the last commit and acquires
+     * a new transaction. Use it when a statement failed, the group does not check this.
+     */
+    void rollback();
+
+    /**
+     * Commits the transaction, the group ends here. Returns false as lift().
      */
-    void lift();
+    bool commit();
+    bool lastCommitSucceeded() const;
 
     void setMaximumTime(int msecs);
+    /** The transaction will be lifted by allowLift() after this number of statements */
+    void setMaximumStatements(int count);
 
     /** Resets to 0 the time used by allowLift() */
     void resetTime();
     /**
      * Allows to lift(). The transaction will be lifted if the time set by setMaximumTime()
-     * has expired.
+     * has expired, or more statements than set by setMaximumStatements() were executed.
+     * Returns true if the transaction was lifted, see lastCommitSucceeded().
      */
-    void allowLift();
+    bool allowLift();
 
 private:
 
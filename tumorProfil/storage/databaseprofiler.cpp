@@ -0,0 +1,440 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "databaseprofiler.h"
+
+// C++ includes
+
+#include <algorithm>
+#include <cmath>
+
+// Qt includes
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+
+// Latencies are counted in logarithmic buckets, four per power of two, starting at 1 µs
+static const int bucketsPerDoubling = 4;
+static const int numberOfBuckets    = 25 * bucketsPerDoubling;
+
+// Statements with inlined values each have their own text; the cache of normalized texts is cleared at this size
+static const int maximumNormalizedStatements = 1000;
+
+static int bucketForTime(qint64 nsecs)
+{
+    const double usecs = nsecs / 1000.0;
+    if (usecs < 1)
+    {
+        return 0;
+    }
+    const int bucket = int(std::log2(usecs) * bucketsPerDoubling) + 1;
+    return qMin(bucket, numberOfBuckets - 1);
+}
+
+static double bucketUpperBoundMs(int bucket)
+{
+    return std::pow(2.0, double(bucket) / bucketsPerDoubling) / 1000.0;
+}
+
+class StatementStatistics
+{
+public:
+
+    StatementStatistics()
+        : calls(0), batches(0), prepares(0), retries(0), rows(0),
+          totalTime(0), maxTime(0), prepareTime(0),
+          histogram(numberOfBuckets, 0)
+    {
+    }
+
+    void addTime(qint64 nsecs)
+    {
+        calls++;
+        totalTime += nsecs;
+        maxTime    = qMax(maxTime, nsecs);
+        histogram[bucketForTime(nsecs)]++;
+    }
+
+    double percentileMs(double fraction) const
+    {
+        const qint64 rank = qint64(std::ceil(calls * fraction));
+        qint64 count = 0;
+        for (int i=0; i<histogram.size(); i++)
+        {
+            count += histogram[i];
+            if (count >= rank)
+            {
+                // never report more than the actual maximum
+                return qMin(bucketUpperBoundMs(i), maxTime / 1e6);
+            }
+        }
+        return maxTime / 1e6;
+    }
+
+    qint64           calls;
+    qint64           batches;
+    qint64           prepares;
+    qint64           retries;
+    qint64           rows;
+    qint64           totalTime;
+    qint64           maxTime;
+    qint64           prepareTime;
+    QVector<quint32> histogram;
+};
+
+class DatabaseProfiler::DatabaseProfilerPriv
+{
+public:
+
+    DatabaseProfilerPriv()
+        : slowThreshold(0),
+          lockWaits(0),
+          lockWaitTime(0),
+          lockWaitMax(0),
+          dumpRoutineAdded(false)
+    {
+    }
+
+    StatementStatistics& statistics(const QString& sql)
+    {
+        // The statement text of prepared queries repeats, normalize each only once
+        QHash<QString, QString>::const_iterator it = normalized.constFind(sql);
+        if (it == normalized.constEnd())
+        {
+            if (normalized.size() >= maximumNormalizedStatements)
+            {
+                normalized.clear();
+            }
+            it = normalized.insert(sql, DatabaseProfiler::normalize(sql));
+        }
+        return statements[it.value()];
+    }
+
+    void checkSlow(const QString& sql, qint64 nsecs, const char* what)
+    {
+        if (slowThreshold && nsecs > qint64(slowThreshold) * 1000000)
+        {
+            qWarning() << "Slow SQL" << what << double(nsecs / 1000) / 1000 << "ms:" << sql.simplified();
+        }
+    }
+
+    // checked without holding the mutex
+    QAtomicInt                          enabled;
+    mutable QMutex                      mutex;
+    QHash<QString, QString>             normalized;
+    QHash<QString, StatementStatistics> statements;
+    int                                 slowThreshold;
+    qint64                              lockWaits;
+    qint64                              lockWaitTime;
+    qint64                              lockWaitMax;
+    QString                             dumpFile;
+    bool                                dumpRoutineAdded;
+};
+
+class DatabaseProfilerCreator { public: DatabaseProfiler object; };
+Q_GLOBAL_STATIC(DatabaseProfilerCreator, creator)
+
+DatabaseProfiler* DatabaseProfiler::instance()
+{
+    return &creator()->object;
+}
+
+DatabaseProfiler::DatabaseProfiler()
+    : d(new DatabaseProfilerPriv)
+{
+    const int threshold = qgetenv("TUMORPROFIL_SQL_SLOW_MS").toInt();
+    if (threshold > 0)
+    {
+        setSlowQueryThreshold(threshold);
+    }
+    const QString file = QString::fromLocal8Bit(qgetenv("TUMORPROFIL_SQL_PROFILE"));
+    if (!file.isEmpty())
+    {
+        setDumpFile(file);
+    }
+}
+
+DatabaseProfiler::~DatabaseProfiler()
+{
+    delete d;
+}
+
+void DatabaseProfiler::setEnabled(bool enabled)
+{
+    d->enabled.storeRelease(enabled);
+}
+
+bool DatabaseProfiler::isEnabled() const
+{
+    return d->enabled.loadAcquire();
+}
+
+void DatabaseProfiler::recordQuery(const QString& sql, qint64 nsecs, int retries)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    QMutexLocker lock(&d->mutex);
+    StatementStatistics& s = d->statistics(sql);
+    s.addTime(nsecs);
+    s.retries += retries;
+    d->checkSlow(sql, nsecs, "query");
+}
+
+void DatabaseProfiler::recordBatch(const QString& sql, qint64 nsecs, int retries, int rows)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    QMutexLocker lock(&d->mutex);
+    StatementStatistics& s = d->statistics(sql);
+    s.addTime(nsecs);
+    s.batches++;
+    s.retries += retries;
+    s.rows    += rows;
+    d->checkSlow(sql, nsecs, "batch");
+}
+
+void DatabaseProfiler::recordPrepare(const QString& sql, qint64 nsecs, int retries)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    QMutexLocker lock(&d->mutex);
+    StatementStatistics& s = d->statistics(sql);
+    s.prepares++;
+    s.prepareTime += nsecs;
+    s.retries     += retries;
+    d->checkSlow(sql, nsecs, "prepare");
+}
+
+void DatabaseProfiler::recordRows(const QString& sql, int rows)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    QMutexLocker lock(&d->mutex);
+    d->statistics(sql).rows += rows;
+}
+
+void DatabaseProfiler::recordLockWait(qint64 nsecs)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    QMutexLocker lock(&d->mutex);
+    d->lockWaits++;
+    d->lockWaitTime += nsecs;
+    d->lockWaitMax   = qMax(d->lockWaitMax, nsecs);
+}
+
+void DatabaseProfiler::setSlowQueryThreshold(int msecs)
+{
+    QMutexLocker lock(&d->mutex);
+    d->slowThreshold = qMax(0, msecs);
+    if (d->slowThreshold)
+    {
+        setEnabled(true);
+    }
+}
+
+int DatabaseProfiler::slowQueryThreshold() const
+{
+    QMutexLocker lock(&d->mutex);
+    return d->slowThreshold;
+}
+
+static void dumpAtExit()
+{
+    DatabaseProfiler* profiler = DatabaseProfiler::instance();
+    profiler->dump(QString());
+}
+
+void DatabaseProfiler::setDumpFile(const QString& filePath)
+{
+    QMutexLocker lock(&d->mutex);
+    d->dumpFile = filePath;
+    if (filePath.isEmpty())
+    {
+        return;
+    }
+    setEnabled(true);
+    if (!d->dumpRoutineAdded)
+    {
+        qAddPostRoutine(dumpAtExit);
+        d->dumpRoutineAdded = true;
+    }
+}
+
+static bool statementLessThan(const QJsonValue& a, const QJsonValue& b)
+{
+    // most expensive first
+    return a.toObject().value("totalMs").toDouble() > b.toObject().value("totalMs").toDouble();
+}
+
+QByteArray DatabaseProfiler::toJson() const
+{
+    QMutexLocker lock(&d->mutex);
+
+    QJsonArray statements;
+    QHash<QString, StatementStatistics>::const_iterator it;
+    for (it = d->statements.constBegin(); it != d->statements.constEnd(); ++it)
+    {
+        const StatementStatistics& s = it.value();
+        QJsonObject o;
+        o.insert("sql", it.key());
+        o.insert("calls", double(s.calls));
+        o.insert("batches", double(s.batches));
+        o.insert("rows", double(s.rows));
+        o.insert("retries", double(s.retries));
+        o.insert("totalMs", s.totalTime / 1e6);
+        o.insert("meanMs", s.calls ? s.totalTime / 1e6 / s.calls : 0.0);
+        o.insert("p99Ms", s.calls ? s.percentileMs(0.99) : 0.0);
+        o.insert("maxMs", s.maxTime / 1e6);
+        o.insert("prepares", double(s.prepares));
+        o.insert("prepareMs", s.prepareTime / 1e6);
+        statements.append(o);
+    }
+    QList<QJsonValue> sorted;
+    foreach (const QJsonValue& v, statements)
+    {
+        sorted << v;
+    }
+    std::sort(sorted.begin(), sorted.end(), statementLessThan);
+    QJsonArray sortedStatements;
+    foreach (const QJsonValue& v, sorted)
+    {
+        sortedStatements.append(v);
+    }
+
+    QJsonObject lockWait;
+    lockWait.insert("count", double(d->lockWaits));
+    lockWait.insert("totalMs", d->lockWaitTime / 1e6);
+    lockWait.insert("maxMs", d->lockWaitMax / 1e6);
+
+    QJsonObject root;
+    root.insert("statements", sortedStatements);
+    root.insert("lockWait", lockWait);
+    root.insert("slowQueryThresholdMs", d->slowThreshold);
+
+    return QJsonDocument(root).toJson();
+}
+
+bool DatabaseProfiler::dump(const QString& filePath) const
+{
+    QString path = filePath;
+    if (path.isEmpty())
+    {
+        QMutexLocker lock(&d->mutex);
+        path = d->dumpFile;
+    }
+    if (path.isEmpty())
+    {
+        return false;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "Failed to write SQL profile to" << path << file.errorString();
+        return false;
+    }
+    file.write(toJson());
+    return true;
+}
+
+void DatabaseProfiler::reset()
+{
+    QMutexLocker lock(&d->mutex);
+    d->normalized.clear();
+    d->statements.clear();
+    d->lockWaits    = 0;
+    d->lockWaitTime = 0;
+    d->lockWaitMax  = 0;
+}
+
+QString DatabaseProfiler::normalize(const QString& sql)
+{
+    // Replaces string and numeric literals by ?, collapses whitespace
+    QString result;
+    result.reserve(sql.size());
+    const int size = sql.size();
+    bool pendingSpace = false;
+    for (int i=0; i<size; i++)
+    {
+        const QChar c = sql[i];
+        if (c.isSpace())
+        {
+            pendingSpace = !result.isEmpty();
+            continue;
+        }
+        if (pendingSpace)
+        {
+            result += ' ';
+            pendingSpace = false;
+        }
+
+        if (c == '\'')
+        {
+            // skip to the closing quote, '' is an escaped quote
+            for (i++; i<size; i++)
+            {
+                if (sql[i] == '\'')
+                {
+                    if (i+1 < size && sql[i+1] == '\'')
+                    {
+                        i++;
+                        continue;
+                    }
+                    break;
+                }
+            }
+            result += '?';
+        }
+        else if (c.isDigit() && (result.isEmpty() || !(result.at(result.size()-1).isLetterOrNumber() || result.at(result.size()-1) == '_')))
+        {
+            while (i+1 < size && (sql[i+1].isDigit() || sql[i+1] == '.'))
+            {
+                i++;
+            }
+            result += '?';
+        }
+        else
+        {
+            result += c;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,82 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef DATABASEPROFILER_H
+#define DATABASEPROFILER_H
+
+// Qt includes
+
+#include <QByteArray>
+#include <QString>
+
+/**
+  Collects execution statistics of all SQL statements run through DatabaseCoreBackend,
+  grouped by the normalized statement (literals replaced by ?, whitespace collapsed):
+  calls, total, mean, maximum and 99th percentile time, rows returned, retries and prepare time.
+  Additionally, the time spent waiting for the DatabaseAccess lock is recorded.
+
+  Recording is off by default, then the record methods return at once without locking.
+  It is switched on by setEnabled(), by setting a dump file (environment variable
+  TUMORPROFIL_SQL_PROFILE or --sql-profile), or a slow query threshold (TUMORPROFIL_SQL_SLOW_MS or --sql-slow).
+  Statistics can be written as JSON on demand, and at exit if a dump file is set.
+  Statements slower than the threshold are logged immediately.
+
+  All methods are thread-safe.
+  */
+class DatabaseProfiler
+{
+public:
+
+    static DatabaseProfiler* instance();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+    void recordQuery(const QString& sql, qint64 nsecs, int retries);
+    void recordBatch(const QString& sql, qint64 nsecs, int retries, int rows);
+    void recordPrepare(const QString& sql, qint64 nsecs, int retries);
+    void recordRows(const QString& sql, int rows);
+    void recordLockWait(qint64 nsecs);
+
+    /// Statements taking longer are logged with qWarning. 0 disables the log. A threshold enables recording.
+    void setSlowQueryThreshold(int msecs);
+    int slowQueryThreshold() const;
+
+    /// If set, the statistics are written to this file when the application exits. A file enables recording.
+    void setDumpFile(const QString& filePath);
+
+    QByteArray toJson() const;
+    bool dump(const QString& filePath) const;
+    void reset();
+
+    static QString normalize(const QString& sql);
+
+private:
+
+    DatabaseProfiler();
+    ~DatabaseProfiler();
+    friend class DatabaseProfilerCreator;
+
+    class DatabaseProfilerPriv;
+    DatabaseProfilerPriv* const d;
+};
+
+#endif // DATABASEPROFILER_H
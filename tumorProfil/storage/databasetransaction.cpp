@@ -29,23 +29,40 @@
 #include "databasecorebackend.h"
 
 DatabaseTransaction::DatabaseTransaction()
-    : m_access(0)
+    : m_access(0),
+      m_backend(0),
+      m_finished(false)
 {
     DatabaseAccess access;
     access.backend()->beginTransaction();
 }
 
 DatabaseTransaction::DatabaseTransaction(DatabaseAccess* access)
-    : m_access(access)
+    : m_access(access),
+      m_backend(0),
+      m_finished(false)
 {
     m_access->backend()->beginTransaction();
 }
 
+DatabaseTransaction::DatabaseTransaction(DatabaseCoreBackend* backend)
+    : m_access(0),
+      m_backend(backend),
+      m_finished(false)
+{
+    m_backend->beginTransaction();
+}
+
 DatabaseTransaction::~DatabaseTransaction()
 {
-    if (m_access)
+    if (m_finished)
+    {
+        return;
+    }
+
+    if (m_access || m_backend)
     {
-        m_access->backend()->commitTransaction();
+        backend()->commitTransaction();
     }
     else
     {
@@ -54,3 +71,47 @@ DatabaseTransaction::~DatabaseTransaction()
     }
 }
 
+bool DatabaseTransaction::commit()
+{
+    if (m_finished)
+    {
+        return false;
+    }
+
+    DatabaseCoreBackend::QueryState state;
+    if (m_access || m_backend)
+    {
+        state = backend()->commitTransaction();
+    }
+    else
+    {
+        DatabaseAccess access;
+        state = access.backend()->commitTransaction();
+    }
+    m_finished = true;
+    return state == DatabaseCoreBackend::NoErrors;
+}
+
+void DatabaseTransaction::rollback()
+{
+    if (m_finished)
+    {
+        return;
+    }
+
+    if (m_access || m_backend)
+    {
+        backend()->abortTransaction();
+    }
+    else
+    {
+        DatabaseAccess access;
+        access.backend()->abortTransaction();
+    }
+    m_finished = true;
+}
+
+DatabaseCoreBackend* DatabaseTransaction::backend() const
+{
+    return m_backend ? m_backend : m_access->backend();
+}
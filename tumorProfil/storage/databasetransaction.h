@@ -25,6 +25,7 @@
 #define DATABASETRANSACTION_H
 
 class DatabaseAccess;
+class DatabaseCoreBackend;
 
 class DatabaseTransaction
 {
@@ -44,11 +45,32 @@ public:
      * Use an existing DatabaseAccess object, which must live as long as this object exists.
      */
     DatabaseTransaction(DatabaseAccess* access);
+    /**
+     * Use the given backend, which must live as long as this object exists.
+     */
+    DatabaseTransaction(DatabaseCoreBackend* backend);
     ~DatabaseTransaction();
 
+    /**
+     * Commits the transaction now. Returns false if the commit failed, or a nested
+     * transaction was rolled back; then the transaction was rolled back.
+     */
+    bool commit();
+
+    /**
+     * Rolls back the transaction. It is not committed when this object is destroyed.
+     */
+    void rollback();
+
+private:
+
+    DatabaseCoreBackend* backend() const;
+
 private:
 
-    DatabaseAccess* m_access;
+    DatabaseAccess*      m_access;
+    DatabaseCoreBackend* m_backend;
+    bool                 m_finished;
 };
 
 #endif // DATABASETRANSACTION_H
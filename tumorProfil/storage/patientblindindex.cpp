@@ -0,0 +1,149 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#include "patientblindindex.h"
+
+// Qt includes
+
+#include <QMessageAuthenticationCode>
+
+// Local includes
+
+#include "authentication/userinformation.h"
+#include "constants.h"
+
+// The index columns store the first 16 bytes of the HMAC, hex-encoded
+static const int blindIndexBytes = 16;
+
+static QString keyName(PatientBlindIndex::Field field)
+{
+    switch (field)
+    {
+    case PatientBlindIndex::Surname:
+    case PatientBlindIndex::SurnamePrefix:
+        return SQL_PATIENT_SURNAME;
+    case PatientBlindIndex::FirstName:
+        return SQL_PATIENT_NAME;
+    case PatientBlindIndex::DateOfBirth:
+        return SQL_PATIENT_DATEOFBIRTH;
+    }
+    return QString();
+}
+
+static QByteArray label(PatientBlindIndex::Field field)
+{
+    switch (field)
+    {
+    case PatientBlindIndex::Surname:
+        return "TumorProfil blind index surname";
+    case PatientBlindIndex::SurnamePrefix:
+        return "TumorProfil blind index surname prefix";
+    case PatientBlindIndex::FirstName:
+        return "TumorProfil blind index first name";
+    case PatientBlindIndex::DateOfBirth:
+        return "TumorProfil blind index date of birth";
+    }
+    return QByteArray();
+}
+
+/**
+  The HMAC key of a field. Each field, and the prefix bucket, gets its own key,
+  so that equal values in different fields do not have equal blind indices.
+  */
+static QByteArray hmacKey(PatientBlindIndex::Field field)
+{
+    UserInformation* user = UserInformation::instance();
+    QByteArray secret;
+    if (!user->isEncryptionEnabled())
+    {
+        secret = "TumorProfil unencrypted";
+    }
+    else
+    {
+        const QString key = user->isLoggedIn() ? user->retrieveKey(keyName(field)) : QString();
+        if (key.isEmpty())
+        {
+            return QByteArray();
+        }
+        secret = key.toUtf8();
+    }
+    return QMessageAuthenticationCode::hash(label(field), secret, QCryptographicHash::Sha256);
+}
+
+QString PatientBlindIndex::normalize(const QString& value)
+{
+    return value.simplified().toCaseFolded();
+}
+
+QString PatientBlindIndex::compute(Field field, const QString& value)
+{
+    QString normalized = normalize(value);
+    if (normalized.isEmpty())
+    {
+        return QString();
+    }
+    if (field == SurnamePrefix)
+    {
+        normalized.truncate(PrefixLength);
+    }
+
+    const QByteArray key = hmacKey(field);
+    if (key.isEmpty())
+    {
+        return QString();
+    }
+    const QByteArray mac = QMessageAuthenticationCode::hash(normalized.toUtf8(), key, QCryptographicHash::Sha256);
+    return QString::fromLatin1(mac.left(blindIndexBytes).toHex());
+}
+
+QString PatientBlindIndex::compute(const QDate& dateOfBirth)
+{
+    if (!dateOfBirth.isValid())
+    {
+        return QString();
+    }
+    return compute(DateOfBirth, dateOfBirth.toString(Qt::ISODate));
+}
+
+bool PatientBlindIndex::isAvailable()
+{
+    return !hmacKey(Surname).isEmpty()
+            && !hmacKey(FirstName).isEmpty()
+            && !hmacKey(DateOfBirth).isEmpty();
+}
+
+QVariantList PatientBlindIndex::columnValues(const Patient& p)
+{
+    QVariantList values;
+    values << compute(Surname, p.surname)
+           << compute(FirstName, p.firstName)
+           << compute(p.dateOfBirth)
+           << compute(SurnamePrefix, p.surname);
+    return values;
+}
+
+bool PatientBlindIndex::isComplete(const Patient& p, const QVariantList& columnValues)
+{
+    return (normalize(p.surname).isEmpty() || !columnValues[0].isNull())
+            && (normalize(p.firstName).isEmpty() || !columnValues[1].isNull())
+            && (!p.dateOfBirth.isValid() || !columnValues[2].isNull());
+}
@@ -0,0 +1,92 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#ifndef PATIENTBLINDINDEX_H
+#define PATIENTBLINDINDEX_H
+
+// Qt includes
+
+#include <QDate>
+#include <QString>
+#include <QVariant>
+
+// Local includes
+
+#include "patient.h"
+
+/**
+  Blind index of the encrypted patient identity fields.
+
+  The columns firstName, surname and dateOfBirth of the Patients table are encrypted,
+  so the database cannot compare them. For each of them, a keyed hash (HMAC-SHA256)
+  of the normalized plain value is stored in an additional, indexed column.
+  A lookup computes the same hash of the search value and matches it in the database.
+  For prefix searches ("Mei*"), the first PrefixLength characters of the surname
+  are hashed into a bucket column; the bucket is then filtered after decryption.
+
+  The HMAC key is derived from the encryption key of the field, so only a user
+  who can decrypt a field can compute its blind index.
+  Without encryption, a fixed key is used.
+  */
+class PatientBlindIndex
+{
+public:
+
+    enum Field
+    {
+        Surname,
+        FirstName,
+        DateOfBirth,
+        SurnamePrefix
+    };
+
+    enum
+    {
+        PrefixLength = 3
+    };
+
+    /// The case-folded value with whitespace simplified
+    static QString normalize(const QString& value);
+
+    /**
+      Returns the blind index of value, or a null string if value is empty
+      or the key for the field is not available.
+      For SurnamePrefix, pass the full surname.
+      */
+    static QString compute(Field field, const QString& value);
+    static QString compute(const QDate& dateOfBirth);
+
+    /// Returns true if the blind index of all fields can be computed by the current user
+    static bool isAvailable();
+
+    /**
+      Returns the values of the columns surnameBlind, firstNameBlind,
+      dateOfBirthBlind and surnamePrefixBlind for p, in this order.
+      Uncomputable values are null.
+      */
+    static QVariantList columnValues(const Patient& p);
+
+    /// Returns true if each non-empty field of p has a blind index
+    static bool isComplete(const Patient& p, const QVariantList& columnValues);
+};
+
+#endif // PATIENTBLINDINDEX_H
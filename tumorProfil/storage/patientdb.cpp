@@ -24,22 +24,48 @@
 // Qt includes
 
 #include <QDebug>
+#include <QSqlDriver>
+#include <QSqlRecord>
 #include <QVector>
 
 // Local includes
 
+#include "authentication/userinformation.h"
+#include "constants.h"
 #include "databasecorebackend.h"
+#include "databasetransaction.h"
+#include "patientblindindex.h"
 #include "property.h"
 
 class PatientDB::PatientDBPriv
 {
 public:
     PatientDBPriv()
-        : db(0)
+        : db(0),
+          blindIndexComplete(-1),
+          isSQLite(-1)
     {
     }
 
     DatabaseCoreBackend* db;
+    // cached setting, -1 if not yet read
+    int                  blindIndexComplete;
+    // -1 if not yet known
+    int                  isSQLite;
+
+    /**
+      The property tables have no id, properties are in insertion order.
+      SQLite needs the rowid for this; InnoDB tables without primary key are stored in insertion order.
+      */
+    QString propertyOrder(const QString& table)
+    {
+        if (isSQLite == -1)
+        {
+            SqlQuery query = db->prepareQuery("SELECT 1;");
+            isSQLite = query.driver() && query.driver()->dbmsType() == QSqlDriver::SQLite;
+        }
+        return isSQLite ? " ORDER BY " + table + ".rowid" : QString();
+    }
 
     inline QString tableName(PatientDB::PropertyType e)
     {
@@ -55,6 +81,43 @@ public:
         return QString();
     }
 
+    /**
+      Executes the prepared statement once for each row.
+      columns contains one list of values per bound parameter, all of the same size.
+      */
+    bool execBatch(const QString& sql, const QList<QVariantList>& columns)
+    {
+        if (columns.isEmpty() || columns.first().isEmpty())
+        {
+            return true;
+        }
+        SqlQuery query = db->prepareQuery(sql);
+        foreach (const QVariantList& column, columns)
+        {
+            query.addBindValue(column);
+        }
+        return db->execBatch(query);
+    }
+
+    /// Rows are not cached by the driver for a forward-only query
+    void execForwardOnly(const QString& sql, const QVariantList& boundValues, QList<QVariant>* values)
+    {
+        SqlQuery query = db->prepareQuery(sql);
+        query.setForwardOnly(true);
+        db->execSql(query, boundValues, values);
+    }
+
+    /// A patient written without its full blind index makes server-side lookups unreliable
+    void checkBlindIndex(bool complete)
+    {
+        if (blindIndexComplete != 0 && !complete)
+        {
+            db->execSql(QString("REPLACE into Settings VALUES (?,?);"),
+                        QString(DB_BLIND_INDEX_COMPLETE), QString::number(0));
+            blindIndexComplete = 0;
+        }
+    }
+
     inline QString idName(PatientDB::PropertyType e)
     {
         switch (e)
@@ -110,9 +173,14 @@ int PatientDB::addPatient(const Patient& p)
     QVariant id;
     Patient p_copy(p);
     p_copy.encrypt();
-    d->db->execSql("INSERT INTO Patients (firstName, surname, dateOfBirth, gender) "
-                   "VALUES (?, ?, ?, ?)",
-                   p_copy.firstName, p_copy.surname, p_copy.encryptedDateOfBirth, p_copy.gender, 0, &id);
+    const QVariantList blindIndex = PatientBlindIndex::columnValues(p);
+    d->db->execSql("INSERT INTO Patients (firstName, surname, dateOfBirth, gender, "
+                   "surnameBlind, firstNameBlind, dateOfBirthBlind, surnamePrefixBlind) "
+                   "VALUES (?, ?, ?, ?, ?, ?, ?, ?)",
+                   QVariantList() << p_copy.firstName << p_copy.surname
+                                  << p_copy.encryptedDateOfBirth << p_copy.gender << blindIndex,
+                   0, &id);
+    d->checkBlindIndex(PatientBlindIndex::isComplete(p, blindIndex));
 
     return id.toInt();
 }
@@ -121,9 +189,104 @@ void PatientDB::updatePatient(const Patient& p)
 {
     Patient p_copy(p);
     p_copy.encrypt();
-    d->db->execSql("UPDATE Patients SET firstName=?, surname=?, dateOfBirth=?, gender=? WHERE id=?;",
-                    QVariantList() << p_copy.firstName << p_copy.surname
-                                   << p_copy.encryptedDateOfBirth << p_copy.gender << p_copy.id);
+    const QVariantList blindIndex = PatientBlindIndex::columnValues(p);
+    updateEncryptedPatient(p_copy, blindIndex, PatientBlindIndex::isComplete(p, blindIndex));
+}
+
+void PatientDB::updateEncryptedPatient(const Patient& encrypted, const QVariantList& blindIndex, bool blindIndexComplete)
+{
+    d->db->execSql("UPDATE Patients SET firstName=?, surname=?, dateOfBirth=?, gender=?, "
+                   "surnameBlind=?, firstNameBlind=?, dateOfBirthBlind=?, surnamePrefixBlind=? WHERE id=?;",
+                    QVariantList() << encrypted.firstName << encrypted.surname
+                                   << encrypted.encryptedDateOfBirth << encrypted.gender
+                                   << blindIndex << encrypted.id);
+    d->checkBlindIndex(blindIndexComplete);
+}
+
+bool PatientDB::hasCompleteBlindIndex()
+{
+    if (d->blindIndexComplete == -1)
+    {
+        d->blindIndexComplete = setting(DB_BLIND_INDEX_COMPLETE).toInt() ? 1 : 0;
+    }
+    return d->blindIndexComplete;
+}
+
+bool PatientDB::updateBlindIndex(const QList<Patient>& patients)
+{
+    if (!PatientBlindIndex::isAvailable())
+    {
+        return false;
+    }
+
+    QVariantList surnames, firstNames, datesOfBirth, prefixes, ids;
+    foreach (const Patient& p, patients)
+    {
+        const QVariantList blindIndex = PatientBlindIndex::columnValues(p);
+        surnames     << blindIndex[0];
+        firstNames   << blindIndex[1];
+        datesOfBirth << blindIndex[2];
+        prefixes     << blindIndex[3];
+        ids          << p.id;
+    }
+    d->execBatch("UPDATE Patients SET surnameBlind=?, firstNameBlind=?, dateOfBirthBlind=?, surnamePrefixBlind=? WHERE id=?;",
+                 QList<QVariantList>() << surnames << firstNames << datesOfBirth << prefixes << ids);
+
+    setSetting(DB_BLIND_INDEX_COMPLETE, QString::number(1));
+    d->blindIndexComplete = 1;
+    return true;
+}
+
+QStringList PatientDB::checkQueryPlans()
+{
+    // Loading, saving and the delete triggers look up these tables by foreign key
+    static const char* const statements[] =
+    {
+        "SELECT property, value, detail FROM PatientProperties WHERE patientid=?;",
+        "SELECT property, value, detail FROM DiseaseProperties WHERE diseaseid=?;",
+        "SELECT property, value, detail FROM PathologyProperties WHERE pathologyid=?;",
+        "DELETE FROM PathologyProperties WHERE pathologyid=? AND property='';",
+        "SELECT id, initialDiagnosis, cTNM, pTNM FROM Diseases WHERE patientId = ?;",
+        "SELECT id, entity, sampleOrigin, context, date FROM Pathologies WHERE diseaseId = ?;",
+        "SELECT id, class, date, type FROM Events WHERE diseaseid=? ORDER BY id;",
+        "SELECT eventid, type, info FROM EventInfos WHERE eventid=?;",
+        "SELECT id FROM Patients WHERE surnameBlind=?;",
+        "SELECT id FROM Patients WHERE dateOfBirthBlind=?;",
+        "SELECT id FROM Patients WHERE surnamePrefixBlind=?;"
+    };
+
+    SqlQuery driverQuery = d->db->prepareQuery("SELECT 1;");
+    const bool isSQLite = driverQuery.driver() && driverQuery.driver()->dbmsType() == QSqlDriver::SQLite;
+
+    QStringList scanning;
+    for (unsigned i=0; i<sizeof(statements)/sizeof(statements[0]); i++)
+    {
+        const QString sql = QString::fromLatin1(statements[i]);
+        SqlQuery query = d->db->execQuery((isSQLite ? "EXPLAIN QUERY PLAN " : "EXPLAIN ") + sql, QVariant(0));
+        bool scans = false;
+        while (query.next())
+        {
+            const QSqlRecord record = query.record();
+            if (isSQLite)
+            {
+                // "SCAN TABLE x" without "USING INDEX" reads all rows
+                const QString detail = record.value("detail").toString();
+                scans = scans || (detail.startsWith("SCAN") && !detail.contains("USING"));
+            }
+            else
+            {
+                // MySQL may choose a full scan for small tables, it is a problem if it has no choice
+                scans = scans || (record.value("type").toString() == "ALL"
+                                  && record.value("possible_keys").toString().isEmpty());
+            }
+        }
+        if (scans)
+        {
+            qWarning() << "Statement scans a whole table, an index is missing:" << sql;
+            scanning << sql;
+        }
+    }
+    return scanning;
 }
 
 void PatientDB::deletePatient(int id)
@@ -132,6 +295,19 @@ void PatientDB::deletePatient(int id)
     d->db->execSql("DELETE FROM Patients WHERE id=?", id);
 }
 
+static bool matchesWildcard(const QString& value, const QString& match)
+{
+    if (match.isNull())
+    {
+        return true;
+    }
+    if (match.endsWith('*'))
+    {
+        return PatientBlindIndex::normalize(value).startsWith(PatientBlindIndex::normalize(match.left(match.size()-1)));
+    }
+    return true;
+}
+
 QList<Patient> PatientDB::findPatients(const Patient& p)
 {
     QList<QVariant> values;
@@ -139,36 +315,86 @@ QList<Patient> PatientDB::findPatients(const Patient& p)
     Patient p_copy(p);
 
     qDebug() << "Find patients" << p.firstName << " " << p.surname << " " << p.gender << " " << p.dateOfBirth;
-    // we can only search for encrypted data
-    // if no encryption, this does nothing
-    p_copy.encrypt();
 
     QString sql = "SELECT id, firstName, surname, dateOfBirth, gender FROM Patients ";
     QString whereClause;
     QVariantList boundValues;
-    if (!p_copy.firstName.isNull())
+
+    // With encryption, names and date of birth are compared on the blind index.
+    // A trailing * in a name matches a prefix: the surname is restricted to its prefix bucket,
+    // both names are filtered after decryption.
+    const bool useBlindIndex = UserInformation::instance()->isEncryptionEnabled()
+            && hasCompleteBlindIndex() && PatientBlindIndex::isAvailable();
+    bool needsFiltering = false;
+    if (useBlindIndex)
     {
-        whereClause += "firstName = ? AND ";
-        boundValues << p_copy.firstName;
+        if (!p.surname.isNull())
+        {
+            if (p.surname.endsWith('*'))
+            {
+                const QString stem = p.surname.left(p.surname.size()-1);
+                if (PatientBlindIndex::normalize(stem).size() >= PatientBlindIndex::PrefixLength)
+                {
+                    whereClause += "surnamePrefixBlind = ? AND ";
+                    boundValues << PatientBlindIndex::compute(PatientBlindIndex::SurnamePrefix, stem);
+                }
+                needsFiltering = true;
+            }
+            else
+            {
+                whereClause += "surnameBlind = ? AND ";
+                boundValues << PatientBlindIndex::compute(PatientBlindIndex::Surname, p.surname);
+            }
+        }
+        if (!p.firstName.isNull())
+        {
+            if (p.firstName.endsWith('*'))
+            {
+                needsFiltering = true;
+            }
+            else
+            {
+                whereClause += "firstNameBlind = ? AND ";
+                boundValues << PatientBlindIndex::compute(PatientBlindIndex::FirstName, p.firstName);
+            }
+        }
+        if (p.dateOfBirth.isValid())
+        {
+            whereClause += "dateOfBirthBlind = ? AND ";
+            boundValues << PatientBlindIndex::compute(p.dateOfBirth);
+        }
     }
-    if (!p_copy.surname.isNull())
+    else
     {
-        whereClause += "surname = ? AND ";
-        boundValues << p_copy.surname;
+        // we can only search for encrypted data
+        // if no encryption, this does nothing
+        p_copy.encrypt();
+
+        if (!p_copy.firstName.isNull())
+        {
+            whereClause += "firstName = ? AND ";
+            boundValues << p_copy.firstName;
+        }
+        if (!p_copy.surname.isNull())
+        {
+            whereClause += "surname = ? AND ";
+            boundValues << p_copy.surname;
+        }
+        if (!p_copy.encryptedDateOfBirth.isEmpty())
+        {
+            whereClause += "dateOfBirth = ? AND ";
+            boundValues << p_copy.encryptedDateOfBirth;
+        }
     }
-    if (p_copy.gender != Patient::UnknownGender)
+    if (p.gender != Patient::UnknownGender)
     {
         whereClause += "gender = ? AND ";
-        boundValues << p_copy.gender;
-    }
-    if (!p_copy.encryptedDateOfBirth.isEmpty())
-    {
-        whereClause += "firstName = ? AND ";
-        boundValues << p_copy.encryptedDateOfBirth;
+        boundValues << p.gender;
     }
 
     if (!whereClause.isEmpty())
     {
+        whereClause.chop(5); // trailing " AND "
         sql += "WHERE (" + whereClause + ");";
     }
 
@@ -196,6 +422,20 @@ QList<Patient> PatientDB::findPatients(const Patient& p)
         patients << p;
     }
 
+    if (needsFiltering)
+    {
+        QList<Patient> filtered;
+        foreach (const Patient& found, patients)
+        {
+            if (matchesWildcard(found.surname, p_copy.surname)
+                    && matchesWildcard(found.firstName, p_copy.firstName))
+            {
+                filtered << found;
+            }
+        }
+        return filtered;
+    }
+
     return patients;
 }
 
@@ -220,7 +460,7 @@ QList<Disease> PatientDB::findDiseases(int patientId)
 {
     QList<QVariant> values;
 
-    d->db->execSql("SELECT id, initialDiagnosis, cTNM, pTNM FROM Diseases WHERE patientId = ?;",
+    d->db->execSql("SELECT id, initialDiagnosis, cTNM, pTNM FROM Diseases WHERE patientId = ? ORDER BY id;",
                    patientId, &values);
 
     QList<Disease> diseases;
@@ -264,7 +504,7 @@ QList<Pathology> PatientDB::findPathologies(int diseaseId)
 {
     QList<QVariant> values;
 
-    d->db->execSql("SELECT id, entity, sampleOrigin, context, date FROM Pathologies WHERE diseaseId = ?;",
+    d->db->execSql("SELECT id, entity, sampleOrigin, context, date FROM Pathologies WHERE diseaseId = ? ORDER BY id;",
                    diseaseId, &values);
 
     QList<Pathology> pathologies;
@@ -294,7 +534,7 @@ QList<Property> PatientDB::properties(PropertyType e, int id)
     QList<QVariant> values;
 
     d->db->execSql( "SELECT property, value, detail FROM " + d->tableName(e) +
-                    " WHERE " + d->idName(e) + "=?;",
+                    " WHERE " + d->idName(e) + "=?" + d->propertyOrder(d->tableName(e)) + ";",
                     id, &values );
 
     QList<Property> properties;
@@ -329,6 +569,27 @@ void PatientDB::addProperty(PropertyType e, int id, const QString& property,
                    id, property, value, detail);
 }
 
+void PatientDB::addProperties(PropertyType e, int id, const QList<Property>& properties)
+{
+    if (properties.isEmpty())
+    {
+        return;
+    }
+
+    QVariantList ids, keys, values, details;
+    foreach (const Property& property, properties)
+    {
+        ids     << id;
+        keys    << property.property;
+        values  << property.value;
+        details << property.detail;
+    }
+
+    d->execBatch("INSERT INTO " + d->tableName(e) +
+                 " (" + d->idName(e) + ", property, value, detail) VALUES(?, ?, ?, ?);",
+                 QList<QVariantList>() << ids << keys << values << details);
+}
+
 void PatientDB::removeProperties(PropertyType e, int id, const QString& property, const QString& value)
 {
     if (property.isNull())
@@ -351,30 +612,110 @@ void PatientDB::removeProperties(PropertyType e, int id, const QString& property
     }
 }
 
+static bool hasSameInfos(const Event& a, const Event& b)
+{
+    if (a.infos.size() != b.infos.size())
+    {
+        return false;
+    }
+    for (int i=0; i<a.infos.size(); i++)
+    {
+        if (a.infos[i].type != b.infos[i].type || a.infos[i].info != b.infos[i].info)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 void PatientDB::replaceEvents(int diseaseId, const QList<Event> events)
 {
-    d->db->execSql("DELETE FROM EventInfos WHERE eventid IN (SELECT id FROM Events WHERE diseaseid=?);", diseaseId);
-    d->db->execSql("DELETE FROM Events WHERE diseaseid=?;", diseaseId);
+    // The order of events and infos is significant, and it is the order of ids.
+    // So we compare event by event with the stored rows: Unchanged events are left alone,
+    // changed events are updated in place, surplus events are appended or deleted.
+    // Usually, only the metadata and the last events change.
+    DatabaseTransaction transaction(d->db);
 
-    SqlQuery eventInsertQuery = d->db->prepareQuery("INSERT INTO Events (diseaseid, class, date, type) VALUES (?, ?, ?, ?);");
-    SqlQuery infoInsertQuery  = d->db->prepareQuery("INSERT INTO EventInfos (eventid, type, info) VALUES (?, ?, ?);");
-    QVariant id;
+    QVector<int> storedIds;
+    QList<Event> stored = findEvents(diseaseId, &storedIds);
+
+    QVariantList updateIds, updateClasses, updateDates, updateTypes;
+    QVariantList infoDeleteIds;
+    QVariantList infoEventIds, infoTypes, infoInfos;
+    QVariantList deleteIds;
 
-    foreach (const Event& event, events)
+    for (int i=0; i<stored.size() && i<events.size(); i++)
     {
-        d->db->execSql(eventInsertQuery, diseaseId, event.eventClass, event.date.toString(Qt::ISODate), event.type, 0, &id);
+        const Event& event = events[i];
+        const Event& old   = stored[i];
+        const int id       = storedIds[i];
+        if (old.eventClass != event.eventClass || old.date != event.date || old.type != event.type)
+        {
+            updateIds     << id;
+            updateClasses << event.eventClass;
+            updateDates   << event.date.toString(Qt::ISODate);
+            updateTypes   << event.type;
+        }
+        if (!hasSameInfos(old, event))
+        {
+            infoDeleteIds << id;
+            foreach (const EventInfo& info, event.infos)
+            {
+                infoEventIds << id;
+                infoTypes    << info.type;
+                infoInfos    << info.info;
+            }
+        }
+    }
+
+    for (int i=events.size(); i<stored.size(); i++)
+    {
+        deleteIds     << storedIds[i];
+        infoDeleteIds << storedIds[i];
+    }
+
+    bool ok = d->execBatch("DELETE FROM EventInfos WHERE eventid=?;", QList<QVariantList>() << infoDeleteIds)
+              && d->execBatch("DELETE FROM Events WHERE id=?;", QList<QVariantList>() << deleteIds)
+              && d->execBatch("UPDATE Events SET class=?, date=?, type=? WHERE id=?;",
+                              QList<QVariantList>() << updateClasses << updateDates << updateTypes << updateIds);
+
+    // Appended events get ascending ids from the autoincrement column
+    for (int i=stored.size(); ok && i<events.size(); i++)
+    {
+        const Event& event = events[i];
+        QVariant id;
+        ok = d->db->execSql("INSERT INTO Events (diseaseid, class, date, type) VALUES (?, ?, ?, ?);",
+                            diseaseId, event.eventClass, event.date.toString(Qt::ISODate), event.type,
+                            0, &id) == DatabaseCoreBackend::NoErrors;
         foreach (const EventInfo& info, event.infos)
         {
-            d->db->execSql(infoInsertQuery, id.toInt(), info.type, info.info);
+            infoEventIds << id;
+            infoTypes    << info.type;
+            infoInfos    << info.info;
         }
     }
+
+    ok = ok && d->execBatch("INSERT INTO EventInfos (eventid, type, info) VALUES (?, ?, ?);",
+                            QList<QVariantList>() << infoEventIds << infoTypes << infoInfos);
+
+    if (!ok)
+    {
+        qWarning() << "Failed to store the events of disease" << diseaseId << ", rolling back";
+        transaction.rollback();
+    }
 }
 
 QList<Event> PatientDB::findEvents(int diseaseId)
+{
+    return findEvents(diseaseId, 0);
+}
+
+QList<Event> PatientDB::findEvents(int diseaseId, QVector<int>* eventIds)
 {
     QList<QVariant> values;
 
-    d->db->execSql( "SELECT id, class, date, type FROM Events WHERE diseaseid=?;",
+    // The order of ids is the order of events, see replaceEvents
+    d->db->execSql( "SELECT id, class, date, type FROM Events WHERE diseaseid=? ORDER BY id;",
                     diseaseId, &values );
 
     int numberOfEvents = values.size() / 4;
@@ -385,13 +726,19 @@ QList<Event> PatientDB::findEvents(int diseaseId)
 
     if (values.isEmpty())
     {
+        if (eventIds)
+        {
+            *eventIds = ids;
+        }
         return events;
     }
 
+    QHash<int, int> indexForId;
     for (QList<QVariant>::const_iterator it = values.constBegin(); it != values.constEnd();)
     {
         Event event;
 
+        indexForId[(*it).toInt()] = events.size();
         ids              << (*it).toInt();
         ++it;
         event.eventClass  = (*it).toString();
@@ -404,27 +751,318 @@ QList<Event> PatientDB::findEvents(int diseaseId)
         events << event;
     }
 
-    SqlQuery query = d->db->prepareQuery("SELECT id, type, info FROM EventInfos WHERE eventid=?;");
-    for (int i=0; i<events.size(); i++)
+    d->db->execSql( "SELECT eventid, type, info FROM EventInfos "
+                    "WHERE eventid IN (SELECT id FROM Events WHERE diseaseid=?) ORDER BY id;",
+                    diseaseId, &values );
+
+    for (QList<QVariant>::const_iterator it = values.constBegin(); it != values.constEnd();)
     {
-        Event& event = events[i];
+        EventInfo info;
 
-        d->db->execSql(query, ids[i], &values);
+        const int index  = indexForId.value((*it).toInt(), -1);
+        ++it;
+        info.type        = (*it).toString();
+        ++it;
+        info.info        = (*it).toString();
+        ++it;
 
-        for (QList<QVariant>::const_iterator it = values.constBegin(); it != values.constEnd();)
+        if (index != -1)
         {
-            EventInfo info;
+            events[index].infos << info;
+        }
+    }
 
-            info.type        = (*it).toString();
-            ++it;
-            info.info        = (*it).toString();
-            ++it;
+    if (eventIds)
+    {
+        *eventIds = ids;
+    }
+    return events;
+}
 
-            event.infos << info;
-        }
+QHash<int, QList<Disease> > PatientDB::findAllDiseases()
+{
+    QList<QVariant> values;
+
+    d->db->execSql("SELECT patientId, id, initialDiagnosis, cTNM, pTNM FROM Diseases ORDER BY id;", &values);
+
+    QHash<int, QList<Disease> > diseases;
+    for (QList<QVariant>::const_iterator it = values.constBegin(); it != values.constEnd();)
+    {
+        Disease d;
+
+        const int patientId = it->toInt();
+        ++it;
+        d.id        = it->toInt();
+        ++it;
+        d.initialDiagnosis = QDate::fromString(it->toString(), Qt::ISODate);
+        ++it;
+        d.initialTNM.setTNM(it->toString()); // cTNM string
+        ++it;
+        d.initialTNM.addTNM(it->toString()); // ignore
+        ++it;
+
+        diseases[patientId] << d;
+    }
+
+    return diseases;
+}
+
+QHash<int, QList<Pathology> > PatientDB::findAllPathologies()
+{
+    QList<QVariant> values;
+
+    d->db->execSql("SELECT diseaseId, id, entity, sampleOrigin, context, date FROM Pathologies ORDER BY id;", &values);
+
+    QHash<int, QList<Pathology> > pathologies;
+    for (QList<QVariant>::const_iterator it = values.constBegin(); it != values.constEnd();)
+    {
+        Pathology p;
+
+        const int diseaseId = it->toInt();
+        ++it;
+        p.id           = it->toInt();
+        ++it;
+        p.entity       = (Pathology::Entity)it->toInt();
+        ++it;
+        p.sampleOrigin = (Pathology::SampleOrigin)it->toInt();
+        ++it;
+        p.context      = it->toString();
+        ++it;
+        p.date         = QDate::fromString(it->toString(), Qt::ISODate);
+        ++it;
 
+        pathologies[diseaseId] << p;
+    }
+
+    return pathologies;
+}
+
+QHash<int, QList<Property> > PatientDB::allProperties(PropertyType e)
+{
+    QList<QVariant> values;
+
+    d->db->execSql( "SELECT " + d->idName(e) + ", property, value, detail FROM " + d->tableName(e)
+                    + d->propertyOrder(d->tableName(e)) + ";",
+                    &values );
+
+    QHash<int, QList<Property> > properties;
+    for (QList<QVariant>::const_iterator it = values.constBegin(); it != values.constEnd();)
+    {
+        Property property;
+
+        const int id      = (*it).toInt();
+        ++it;
+        property.property = (*it).toString();
+        ++it;
+        property.value    = (*it).toString();
+        ++it;
+        property.detail   = (*it).toString();
+        ++it;
+
+        properties[id] << property;
+    }
+
+    return properties;
+}
+
+QHash<int, QList<Event> > PatientDB::findAllEvents()
+{
+    QList<QVariant> values;
+
+    // Infos first, grouped by event id
+    d->db->execSql( "SELECT eventid, type, info FROM EventInfos ORDER BY id;", &values );
+
+    QHash<int, QList<EventInfo> > infos;
+    for (QList<QVariant>::const_iterator it = values.constBegin(); it != values.constEnd();)
+    {
+        EventInfo info;
+
+        const int eventId = (*it).toInt();
+        ++it;
+        info.type         = (*it).toString();
+        ++it;
+        info.info         = (*it).toString();
+        ++it;
+
+        infos[eventId] << info;
+    }
+
+    d->db->execSql( "SELECT diseaseid, id, class, date, type FROM Events ORDER BY id;", &values );
+
+    QHash<int, QList<Event> > events;
+    for (QList<QVariant>::const_iterator it = values.constBegin(); it != values.constEnd();)
+    {
+        Event event;
+
+        const int diseaseId = (*it).toInt();
+        ++it;
+        event.infos       = infos.value((*it).toInt());
+        ++it;
+        event.eventClass  = (*it).toString();
+        ++it;
+        event.date        = QDate::fromString(it->toString(), Qt::ISODate);
+        ++it;
+        event.type        = (*it).toString();
+        ++it;
+
+        events[diseaseId] << event;
     }
 
     return events;
 }
 
+QList<Patient::Ptr> PatientDB::findPatientsAfter(int afterId, int limit)
+{
+    QList<QVariant> values;
+
+    d->execForwardOnly("SELECT id, firstName, surname, dateOfBirth, gender FROM Patients "
+                       "WHERE id > ? ORDER BY id LIMIT ?;",
+                       QVariantList() << afterId << limit, &values);
+
+    QList<Patient::Ptr> patients;
+    for (QList<QVariant>::const_iterator it = values.constBegin(); it != values.constEnd();)
+    {
+        Patient::Ptr p(new Patient);
+
+        p->id          = it->toInt();
+        ++it;
+        p->firstName   = it->toString();
+        ++it;
+        p->surname     = it->toString();
+        ++it;
+        p->encryptedDateOfBirth = it->toString();
+        ++it;
+        p->gender      = (Patient::Gender)it->toInt();
+        ++it;
+
+        patients << p;
+    }
+
+    return patients;
+}
+
+QHash<int, QList<Disease> > PatientDB::findDiseasesOfPatients(int firstPatientId, int lastPatientId)
+{
+    QList<QVariant> values;
+
+    d->execForwardOnly("SELECT patientId, id, initialDiagnosis, cTNM, pTNM FROM Diseases "
+                       "WHERE patientId BETWEEN ? AND ? ORDER BY id;",
+                       QVariantList() << firstPatientId << lastPatientId, &values);
+
+    QHash<int, QList<Disease> > diseases;
+    for (QList<QVariant>::const_iterator it = values.constBegin(); it != values.constEnd();)
+    {
+        Disease d;
+
+        const int patientId = it->toInt();
+        ++it;
+        d.id        = it->toInt();
+        ++it;
+        d.initialDiagnosis = QDate::fromString(it->toString(), Qt::ISODate);
+        ++it;
+        d.initialTNM.setTNM(it->toString()); // cTNM string
+        ++it;
+        d.initialTNM.addTNM(it->toString()); // ignore
+        ++it;
+
+        diseases[patientId] << d;
+    }
+
+    return diseases;
+}
+
+QHash<int, QList<Pathology> > PatientDB::findPathologiesOfPatients(int firstPatientId, int lastPatientId)
+{
+    QList<QVariant> values;
+
+    d->execForwardOnly("SELECT Pathologies.diseaseId, Pathologies.id, entity, sampleOrigin, context, date "
+                       "FROM Pathologies INNER JOIN Diseases ON Pathologies.diseaseId = Diseases.id "
+                       "WHERE Diseases.patientId BETWEEN ? AND ? ORDER BY Pathologies.id;",
+                       QVariantList() << firstPatientId << lastPatientId, &values);
+
+    QHash<int, QList<Pathology> > pathologies;
+    for (QList<QVariant>::const_iterator it = values.constBegin(); it != values.constEnd();)
+    {
+        Pathology p;
+
+        const int diseaseId = it->toInt();
+        ++it;
+        p.id           = it->toInt();
+        ++it;
+        p.entity       = (Pathology::Entity)it->toInt();
+        ++it;
+        p.sampleOrigin = (Pathology::SampleOrigin)it->toInt();
+        ++it;
+        p.context      = it->toString();
+        ++it;
+        p.date         = QDate::fromString(it->toString(), Qt::ISODate);
+        ++it;
+
+        pathologies[diseaseId] << p;
+    }
+
+    return pathologies;
+}
+
+QHash<int, QList<Property> > PatientDB::propertiesOfPatients(PropertyType e, int firstPatientId, int lastPatientId)
+{
+    QList<QVariant> values;
+
+    const QString table = d->tableName(e);
+    QString sql = "SELECT " + table + "." + d->idName(e) + ", property, value, detail FROM " + table;
+    switch (e)
+    {
+    case PatientProperties:
+        sql += " WHERE patientid BETWEEN ? AND ?";
+        break;
+    case DiseaseProperties:
+        sql += " INNER JOIN Diseases ON DiseaseProperties.diseaseid = Diseases.id"
+               " WHERE Diseases.patientId BETWEEN ? AND ?";
+        break;
+    case PathologyProperties:
+        sql += " INNER JOIN Pathologies ON PathologyProperties.pathologyid = Pathologies.id"
+               " INNER JOIN Diseases ON Pathologies.diseaseId = Diseases.id"
+               " WHERE Diseases.patientId BETWEEN ? AND ?";
+        break;
+    }
+    sql += d->propertyOrder(table) + ";";
+    d->execForwardOnly(sql, QVariantList() << firstPatientId << lastPatientId, &values);
+
+    QHash<int, QList<Property> > properties;
+    for (QList<QVariant>::const_iterator it = values.constBegin(); it != values.constEnd();)
+    {
+        Property property;
+
+        const int id      = (*it).toInt();
+        ++it;
+        property.property = (*it).toString();
+        ++it;
+        property.value    = (*it).toString();
+        ++it;
+        property.detail   = (*it).toString();
+        ++it;
+
+        properties[id] << property;
+    }
+
+    return properties;
+}
+
+QStringList PatientDB::propertyNames(PropertyType e, bool withDetail)
+{
+    QList<QVariant> values;
+
+    QString sql = "SELECT DISTINCT property FROM " + d->tableName(e);
+    if (withDetail)
+    {
+        sql += " WHERE detail IS NOT NULL AND detail <> ''";
+    }
+    d->db->execSql(sql + " ORDER BY property;", &values);
+
+    QStringList names;
+    foreach (const QVariant& value, values)
+    {
+        names << value.toString();
+    }
+    return names;
+}
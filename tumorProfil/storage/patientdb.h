@@ -24,8 +24,11 @@
 
 // Qt includes
 
+#include <QHash>
 #include <QString>
+#include <QStringList>
 #include <QVariant>
+#include <QVector>
 
 // Local includes
 
@@ -47,6 +50,11 @@ public:
 
     int addPatient(const Patient& p);
     void updatePatient(const Patient& p);
+    /**
+      Writes the metadata of a patient already encrypted by Patient::encrypt(), with the blind index
+      computed from the unencrypted patient. For writers on other threads, which must not access the keys.
+      */
+    void updateEncryptedPatient(const Patient& encrypted, const QVariantList& blindIndex, bool blindIndexComplete);
     /** Finds patients matching criteria defined by p.
         Any null field of p will be treated as a wildcard.
         A null patient will retrieve all patients.
@@ -54,6 +62,19 @@ public:
         */
     QList<Patient> findPatients(const Patient& p = Patient());
 
+    /// Returns true if the blind index columns are filled for all patients
+    bool hasCompleteBlindIndex();
+    /// Recomputes the blind index of the given patients (plain values, as returned by findPatients).
+    /// Marks the blind index complete, so pass all patients. Returns false if the user has no keys.
+    bool updateBlindIndex(const QList<Patient>& patients);
+
+    /**
+      Runs EXPLAIN on the statements executed per patient, disease or event
+      and warns about each of them which has to scan a whole table.
+      Returns the statements scanning a table.
+      */
+    QStringList checkQueryPlans();
+
     int addDisease(int patientId, const Disease& d);
     void updateDisease(const Disease& dis);
     void deletePatient(int id);
@@ -73,6 +94,8 @@ public:
     QList<Property> properties(PropertyType e, int id);
     void addProperty(PropertyType e, int id, const QString& property,
                      const QString& value, const QString& detail);
+    /// Adds all properties with one prepared, batched statement
+    void addProperties(PropertyType e, int id, const QList<Property>& properties);
     void removeProperties(PropertyType e, int id,
                           const QString& property = QString(),
                           const QString& value = QString());
@@ -80,8 +103,37 @@ public:
     void replaceEvents(int diseaseId, const QList<Event> events);
     QList<Event> findEvents(int diseaseId);
 
+    /**
+      Bulk loading: Each method reads a whole table with a single query
+      and returns the rows grouped by the id of the owning entity
+      (patient id for diseases, disease id for pathologies and events).
+      Row order is the same as with the per-id methods above.
+      */
+    QHash<int, QList<Disease> > findAllDiseases();
+    QHash<int, QList<Pathology> > findAllPathologies();
+    QHash<int, QList<Property> > allProperties(PropertyType e);
+    QHash<int, QList<Event> > findAllEvents();
+
+    /**
+      Streaming: Each method reads the rows belonging to a range of patients
+      with one forward-only query, so that whole-database exports run in bounded memory.
+      findPatientsAfter returns at most limit patients with an id greater than afterId,
+      ordered by id and not decrypted. They are returned as pointers: the copy constructor
+      of Patient does not copy the encrypted date of birth. The other methods return the rows of the patients
+      with firstPatientId <= id <= lastPatientId, grouped as with bulk loading,
+      pathologies ordered by id.
+      */
+    QList<Patient::Ptr> findPatientsAfter(int afterId, int limit);
+    QHash<int, QList<Disease> > findDiseasesOfPatients(int firstPatientId, int lastPatientId);
+    QHash<int, QList<Pathology> > findPathologiesOfPatients(int firstPatientId, int lastPatientId);
+    QHash<int, QList<Property> > propertiesOfPatients(PropertyType e, int firstPatientId, int lastPatientId);
+    /// Returns the distinct property names of the table. If withDetail, only those with a detail anywhere.
+    QStringList propertyNames(PropertyType e, bool withDetail = false);
+
 private:
 
+    /// Returns the events in stored order, and if eventIds is given, their ids
+    QList<Event> findEvents(int diseaseId, QVector<int>* eventIds);
 
     class PatientDBPriv;
     PatientDBPriv* const d;
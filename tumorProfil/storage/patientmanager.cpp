@@ -23,15 +23,15 @@
 
 #include <QApplication>
 #include <QDebug>
-#include <QDir>
-#include <QFileInfo>
 #include <QMessageBox>
 #include <QTextEdit>
+#include <QTimer>
 
 // Local includes
 
 #include "databaseaccess.h"
 #include "databaseconstants.h"
+#include "databasecorebackend.h"
 #include "databasetransaction.h"
 #include "databaseinitializationobserver.h"
 #include "databaseoperationgroup.h"
@@ -40,17 +40,42 @@
 #include "patient.h"
 #include "patientdb.h"
 #include "patientmanager.h"
+#include "patientwritequeue.h"
+#include "securityjournal.h"
+#include "tracing.h"
 
 class PatientManager::PatientManagerPriv
 {
 public:
     PatientManagerPriv()
+        : journal(0)
     {
+        retryTimer.setSingleShot(true);
+        retryTimer.setInterval(10000);
+    }
 
+    ~PatientManagerPriv()
+    {
+        delete journal;
+    }
+
+    SecurityJournal* securityJournal()
+    {
+        // the path depends on the database parameters
+        if (!journal)
+        {
+            journal = new SecurityJournal(SecurityJournal::defaultFilePath());
+        }
+        return journal;
     }
 
     QList<Patient::Ptr>      patients;
     QHash<int, int>          patientIdHash;
+    PatientWriteQueue        writeQueue;
+    SecurityJournal*         journal;
+    // change flags of patients whose write failed, written again by retryTimer
+    QHash<int, int>          failedWrites;
+    QTimer                   retryTimer;
 };
 
 class DefaultInitializationObserver : public InitializationObserver
@@ -90,6 +115,17 @@ PatientManager::PatientManager(QObject *parent) :
     QObject(parent),
     d(new PatientManagerPriv)
 {
+    connect(&d->writeQueue, SIGNAL(patientStored(int,int)),
+            this, SLOT(slotPatientStored(int,int)));
+    connect(&d->writeQueue, SIGNAL(patientStoreFailed(int,int,QString)),
+            this, SLOT(slotPatientStoreFailed(int,int,QString)));
+    connect(&d->retryTimer, SIGNAL(timeout()),
+            this, SLOT(retryFailedWrites()));
+    if (QCoreApplication::instance())
+    {
+        connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()),
+                this, SLOT(flush()));
+    }
 }
 
 PatientManager::~PatientManager()
@@ -114,7 +150,18 @@ bool PatientManager::initialize()
 
 void PatientManager::readDatabase()
 {
-    QList<Patient> patients = DatabaseAccess().db()->findPatients();
+    TRACE_SPAN("PatientManager::readDatabase");
+    flush();
+    QList<Patient> patients;
+    {
+        DatabaseAccess access;
+        patients = access.db()->findPatients();
+        // Fill the blind index after a schema update, or after patients were written by a user without keys
+        if (!access.db()->hasCompleteBlindIndex())
+        {
+            access.db()->updateBlindIndex(patients);
+        }
+    }
     emit progressStarted(patients.size());
     QHash<int, int> oldIds = d->patientIdHash;
     QList<Patient::Ptr> newPatientList;
@@ -131,6 +178,7 @@ void PatientManager::readDatabase()
         else
         {
             loadData(d->patients[index]);
+            emit patientDataChanged(d->patients[index], ChangedAll);
         }
         emit progressValue(d->patients.size());
     }
@@ -162,17 +210,106 @@ Patient::Ptr PatientManager::addPatient(const Patient& values)
     return p;
 }
 
+static void invalidateDerivedData(const Patient::Ptr& patient, PatientManager::ChangeFlags flags)
+{
+    if (flags & PatientManager::ChangedPathologyData)
+    {
+        foreach (const Disease& disease, patient->diseases)
+        {
+            disease.invalidateDerivedData();
+        }
+    }
+}
+
 void PatientManager::updateData(const Patient::Ptr& patient, ChangeFlags flags)
 {
     if (!patient)
     {
         return;
     }
-    storeData(patient, flags);
+    if (!patient->id)
+    {
+        qWarning() << "Invalid patient given to updateData";
+        return;
+    }
+    invalidateDerivedData(patient, flags);
+    // New diseases and pathologies are inserted at once, the ids are needed for the snapshot
+    assignIds(patient, flags);
+    d->writeQueue.enqueue(*patient, flags);
     // we dont check for actual modification here
     emit patientDataChanged(patient, flags);
 }
 
+void PatientManager::flush()
+{
+    // one more attempt for failed writes
+    if (!d->failedWrites.isEmpty())
+    {
+        retryFailedWrites();
+    }
+    d->writeQueue.flush();
+    if (d->journal && !d->journal->flush())
+    {
+        qWarning() << "The security journal could not be written, trying again with the next change";
+    }
+}
+
+bool PatientManager::hasUnsavedChanges() const
+{
+    return !d->failedWrites.isEmpty();
+}
+
+void PatientManager::slotPatientStored(int patientId, int flags)
+{
+    QHash<int, int>::iterator it = d->failedWrites.find(patientId);
+    if (it != d->failedWrites.end())
+    {
+        *it &= ~flags;
+        if (!*it)
+        {
+            d->failedWrites.erase(it);
+        }
+    }
+    emit patientStored(patientId, flags);
+}
+
+void PatientManager::slotPatientStoreFailed(int patientId, int flags, const QString& error)
+{
+    // The patient keeps its changes in memory, they are written again
+    const bool firstFailure = !d->failedWrites.contains(patientId);
+    d->failedWrites[patientId] |= flags;
+    if (!d->retryTimer.isActive())
+    {
+        d->retryTimer.start();
+    }
+    emit patientStoreFailed(patientId, flags, error);
+
+    if (firstFailure)
+    {
+        Patient::Ptr p = patientForId(patientId);
+        const QString name = p ? p->surname + ", " + p->firstName : QString::number(patientId);
+        QMessageBox::warning(0, tr("Datenbankproblem"),
+                             tr("Die Änderungen an Patient %1 konnten nicht gespeichert werden. "
+                                "Es wird erneut versucht.\n%2").arg(name, error));
+    }
+}
+
+void PatientManager::retryFailedWrites()
+{
+    for (QHash<int, int>::iterator it = d->failedWrites.begin(); it != d->failedWrites.end(); )
+    {
+        Patient::Ptr p = patientForId(it.key());
+        if (!p)
+        {
+            // removed meanwhile
+            it = d->failedWrites.erase(it);
+            continue;
+        }
+        d->writeQueue.enqueue(*p, it.value());
+        ++it;
+    }
+}
+
 Patient::Ptr PatientManager::createPatient(const Patient& values)
 {
     Patient::Ptr ptr(new Patient(values));
@@ -197,6 +334,8 @@ void PatientManager::removePatient(const Patient::Ptr& patient)
         return;
     }
 
+    // pending changes must not recreate rows of the deleted patient
+    flush();
     DatabaseAccess().db()->deletePatient(patient->id);
     cleanUpPatient(index);
 }
@@ -333,91 +472,62 @@ void PatientManager::storeData(const Patient::Ptr& patient, ChangeFlags flags)
     if (!patient || !patient->id)
     {
         qWarning() << "Invalid patient given to storeData";
+        return;
     }
 
-    DatabaseOperationGroup group;
-    group.setMaximumTime(200);
+    invalidateDerivedData(patient, flags);
 
-    if (flags & ChangedPatientMetadata)
-    {
-        DatabaseAccess().db()->updatePatient(*patient);
-    }
+    // one commit for all statements of the patient, also on MySQL
+    DatabaseOperationGroup group(DatabaseOperationGroup::AllBackends);
 
-    if (flags & ChangedPatientProperties)
-    {
-        DatabaseAccess().db()->removeProperties(PatientDB::PatientProperties, patient->id);
-        foreach (const Property& property, patient->patientProperties)
-        {
-            //qDebug() << "Patient property" << property.property << property.value;
-            DatabaseAccess().db()->addProperty(PatientDB::PatientProperties, patient->id,
-                                               property.property, property.value, property.detail);
-        }
-    }
+    assignIds(patient, flags);
+    PatientWriteSnapshot(*patient, flags).write();
+}
 
+void PatientManager::assignIds(const Patient::Ptr& patient, ChangeFlags flags)
+{
     for (int i=0; i<patient->diseases.size(); ++i)
     {
-        //qDebug() << "Storing disease";
         Disease& disease = patient->diseases[i];
-        if (disease.id)
-        {
-            if (flags & ChangedDiseaseMetadata)
-            {
-                DatabaseAccess().db()->updateDisease(disease);
-            }
-        }
-        else
+        if (!disease.id)
         {
             disease.id = DatabaseAccess().db()->addDisease(patient->id, disease);
         }
 
-        if (flags & ChangedDiseaseProperties)
-        {
-            DatabaseAccess().db()->removeProperties(PatientDB::DiseaseProperties, disease.id);
-            foreach (const Property& property, disease.diseaseProperties)
-            {
-                DatabaseAccess().db()->addProperty(PatientDB::DiseaseProperties, disease.id,
-                                                   property.property, property.value, property.detail);
-            }
-        }
-
-        if (flags & ChangedDiseaseHistory)
-        {
-            QList<Event> events = disease.history.toEvents();
-            DatabaseAccess().db()->replaceEvents(disease.id, events);
-        }
-
         if (flags & ChangedPathologyData)
         {
             for (int u=0; u<disease.pathologies.size(); ++u)
             {
                 Pathology& pathology = disease.pathologies[u];
-                if (pathology.id)
-                {
-                    DatabaseAccess().db()->updatePathology(pathology);
-                }
-                else
+                if (!pathology.id)
                 {
                     pathology.id = DatabaseAccess().db()->addPathology(disease.id, pathology);
                 }
-
-                DatabaseAccess().db()->removeProperties(PatientDB::PathologyProperties, pathology.id);
-                foreach (const Property& property, pathology.properties)
-                {
-                    DatabaseAccess().db()->addProperty(PatientDB::PathologyProperties, pathology.id,
-                                                       property.property, property.value, property.detail);
-                }
-                foreach (const QString& text, pathology.reports)
-                {
-                    DatabaseAccess().db()->addProperty(PatientDB::PathologyProperties, pathology.id,
-                                                       PathologyPropertyName::pathologyReportId(), text, QString());
-                }
             }
         }
     }
 }
 
+static void sortOutPathologyReports(Pathology& pathology)
+{
+    // Sort out pathology report properties to separate list
+    for (PropertyList::iterator it = pathology.properties.begin(); it != pathology.properties.end(); )
+    {
+        if (it->property == PathologyPropertyName::pathologyReportId())
+        {
+            pathology.reports += it->value;
+            it = pathology.properties.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
 void PatientManager::loadData(const Patient::Ptr& p)
 {
+    TRACE_SPAN("PatientManager::loadData");
     if (!p || !p->id)
     {
         qWarning() << "Invalid patient given to loadData";
@@ -446,46 +556,22 @@ void PatientManager::loadData(const Patient::Ptr& p)
         {
             Pathology& pathology = disease.pathologies[u];
             pathology.properties = DatabaseAccess().db()->properties(PatientDB::PathologyProperties, pathology.id);
-            // Sort out pathology report properties to separate list
-            for (PropertyList::iterator it = pathology.properties.begin(); it != pathology.properties.end(); )
-            {
-                if (it->property == PathologyPropertyName::pathologyReportId())
-                {
-                    pathology.reports += it->value;
-                    it = pathology.properties.erase(it);
-                }
-                else
-                {
-                    ++it;
-                }
-            }
+            sortOutPathologyReports(pathology);
         }
     }
 }
 
 void PatientManager::historySecurityCopy(const Patient::Ptr& p, const QString& type, const QString& value)
 {
-    DatabaseParameters params = DatabaseAccess::parameters();
-    QFileInfo file(params.databaseName);
-    QDir dir = file.dir();
-    if (!dir.exists("Sicherung"))
-    {
-        dir.mkdir("Sicherung");
-    }
-    dir.cd("Sicherung");
-    QString fileName = p->surname + '-' + p->firstName + '-' + p->dateOfBirth.toString(Qt::ISODate)
-            + '-' + type + '-' + QDateTime::currentDateTime().toString(Qt::ISODate);
-    fileName.remove(":");
-    QString filePath = dir.filePath(fileName);
-    QFile f(filePath);
-    if (f.open(QIODevice::WriteOnly | QIODevice::Text))
-    {
-        f.write(value.toUtf8());
-    }
-    else
-    {
-        qDebug() << "Failed to open" << filePath;
-    }
+    SecurityJournalEntry entry;
+    entry.patientId   = p->id;
+    entry.time        = QDateTime::currentDateTime();
+    entry.type        = type;
+    entry.surname     = p->surname;
+    entry.firstName   = p->firstName;
+    entry.dateOfBirth = p->dateOfBirth;
+    entry.value       = value;
+    d->securityJournal()->append(entry);
 }
 
 class QMessageBoxResize: public QMessageBox
@@ -632,138 +718,301 @@ static bool checkHistoryShouldBeReplaced(const Disease& currentD, const DiseaseH
     }
 }
 
-void PatientManager::mergeDatabase(const DatabaseParameters& otherDb)
+
+/**
+  Reads all patients of the given database with one query per table.
+  The result is the same as with loadData for each patient.
+  */
+static QList<Patient> loadAllPatients(PatientDB* db)
 {
-    DefaultInitializationObserver observer;
-    DatabaseAccess* access = DatabaseAccess::createExternalPatientDBAccess(otherDb, &observer);
-    if (!access)
-    {
-        qWarning() << "Failed to access other database" << otherDb;
-    }
+    QList<Patient> patients = db->findPatients();
+
+    QHash<int, QList<Property> >  patientProperties   = db->allProperties(PatientDB::PatientProperties);
+    QHash<int, QList<Disease> >   diseases            = db->findAllDiseases();
+    QHash<int, QList<Property> >  diseaseProperties   = db->allProperties(PatientDB::DiseaseProperties);
+    QHash<int, QList<Event> >     events              = db->findAllEvents();
+    QHash<int, QList<Pathology> > pathologies         = db->findAllPathologies();
+    QHash<int, QList<Property> >  pathologyProperties = db->allProperties(PatientDB::PathologyProperties);
 
-    QList<Patient> patients = access->db()->findPatients();
     for (int i=0; i<patients.size(); ++i)
     {
         Patient& p = patients[i];
-
-        p.patientProperties = access->db()->properties(PatientDB::PatientProperties, p.id);
-        p.diseases = access->db()->findDiseases(p.id);
-        for (int i=0; i<p.diseases.size(); ++i)
+        p.patientProperties = patientProperties.take(p.id);
+        p.diseases = diseases.take(p.id);
+        for (int k=0; k<p.diseases.size(); ++k)
         {
-            Disease& disease = p.diseases[i];
-            disease.diseaseProperties = access->db()->properties(PatientDB::DiseaseProperties, disease.id);
-            disease.pathologies = access->db()->findPathologies(disease.id);
+            Disease& disease = p.diseases[k];
+            disease.diseaseProperties = diseaseProperties.take(disease.id);
+            disease.history = DiseaseHistory::fromEvents(events.take(disease.id));
+            // MIGRATION: Load XML alternatively
+            if (disease.history.isEmpty())
+            {
+                disease.history = disease.historyFromProperties();
+            }
+            disease.pathologies = pathologies.take(disease.id);
             for (int u=0; u<disease.pathologies.size(); ++u)
             {
                 Pathology& pathology = disease.pathologies[u];
-                pathology.properties = access->db()->properties(PatientDB::PathologyProperties, pathology.id);
+                pathology.properties = pathologyProperties.take(pathology.id);
+                sortOutPathologyReports(pathology);
             }
         }
     }
-    delete access;
-    qDebug() << "Currently" << d->patients.size() << "patients, new db" << patients.size();
+    return patients;
+}
 
-    // Dry run
-    QStringList mergeActions, mergeHints;
-    foreach (const Patient& other, patients)
+/**
+  Hash table of patients on the identity key used by findPatients:
+  names (case-insensitive) and date of birth. Gender is checked on lookup.
+  */
+class PatientIdentityIndex
+{
+public:
+
+    static QString key(const Patient& p)
     {
-        Patient::Ptr p;
-        QList<Patient::Ptr> ps = findPatients(other);
-        if (ps.isEmpty())
-        {
-            mergeActions << "Merge new Patient " + other.firstName + " " + other.surname + " "  + other.dateOfBirth.toString();
-            continue;
-        }
-        else
+        return p.surname.toCaseFolded() + '\n' + p.firstName.toCaseFolded() + '\n' + p.dateOfBirth.toString(Qt::ISODate);
+    }
+
+    /// Returns true if findPatients would not treat any name or the date of birth of p as a wildcard
+    static bool canLookUp(const Patient& p)
+    {
+        return !p.surname.isEmpty() && !p.firstName.isEmpty() && p.dateOfBirth.isValid()
+                && !p.surname.endsWith('*') && !p.firstName.endsWith('*');
+    }
+
+    void insert(const Patient::Ptr& p)
+    {
+        hash[key(*p)] << p;
+    }
+
+    QList<Patient::Ptr> find(const Patient& other) const
+    {
+        QList<Patient::Ptr> found;
+        foreach (const Patient::Ptr& p, hash.value(key(other)))
         {
-            p = ps.first();
-            if (ps.size() > 1)
+            if (other.gender == Patient::UnknownGender || p->gender == other.gender)
             {
-                mergeActions << "Warning: Multiple patients found for" + other.firstName + other.surname + other.dateOfBirth.toString();
+                found << p;
             }
         }
+        return found;
+    }
+
+private:
 
-        QString patientIdentifierString = p->firstName + " " + p->surname + ", " + p->dateOfBirth.toString();
+    QHash<QString, QList<Patient::Ptr> > hash;
+};
 
-        ChangeFlags changed = ChangedNothing;
-        if (p->patientProperties != other.patientProperties)
+class MergePlan
+{
+public:
+
+    class Entry
+    {
+    public:
+
+        Entry() : changed(PatientManager::ChangedNothing) {}
+
+        // null for a patient new to this database
+        Patient::Ptr                target;
+        // the values of target after merging. (Patient's copy constructor copies only the patient data.)
+        Patient::Ptr                merged;
+        PatientManager::ChangeFlags changed;
+    };
+
+    QList<Entry> entries;
+    QStringList  actions;
+    QStringList  hints;
+};
+
+/**
+  Merges other into p, which is modified. Returns what was changed.
+  Describes the changes in mergeActions, and problems requiring manual review in mergeHints.
+  */
+static PatientManager::ChangeFlags mergePatient(Patient& p, const Patient& other,
+                                                QStringList& mergeActions, QStringList& mergeHints)
+{
+    PatientManager::ChangeFlags changed = PatientManager::ChangedNothing;
+    const QString patientIdentifierString = p.firstName + " " + p.surname + ", " + p.dateOfBirth.toString();
+
+    if (p.patientProperties != other.patientProperties)
+    {
+        p.patientProperties.merge(other.patientProperties);
+        changed |= PatientManager::ChangedPatientProperties;
+    }
+    foreach (const Disease& otherD, other.diseases)
+    {
+        int diseaseIndex;
+        for (diseaseIndex=0; diseaseIndex<p.diseases.size(); ++diseaseIndex)
         {
-            changed |= ChangedPatientProperties;
+            if (p.diseases[diseaseIndex].entity() == otherD.entity())
+            {
+                break;
+            }
         }
-        foreach (const Disease& otherD, other.diseases)
+        if (diseaseIndex == p.diseases.size())
         {
-            int diseaseIndex;
-            for (diseaseIndex=0; diseaseIndex<p->diseases.size(); ++diseaseIndex)
+            if (p.diseases.size())
+            {
+                mergeHints << "Second entity for " + patientIdentifierString + ", please check manually";
+            }
+            else
             {
-                if (p->diseases[diseaseIndex].entity() == otherD.entity())
+                mergeActions << "Adding new disease for " + patientIdentifierString;
+                p.diseases << otherD;
+                Disease& d = p.diseases.last();
+                // reset id trans-database
+                d.id = 0;
+                for (int o=0; o<d.pathologies.size(); o++)
                 {
-                    break;
+                    d.pathologies[o].id = 0;
                 }
+                changed |= PatientManager::ChangedDiseaseMetadata | PatientManager::ChangedDiseaseProperties
+                         | PatientManager::ChangedDiseaseHistory | PatientManager::ChangedPathologyData;
             }
-            if (diseaseIndex == p->diseases.size())
+            continue;
+        }
+
+        Disease& d = p.diseases[diseaseIndex];
+        // ! initialDiagnosis: Merge if history changed
+        // ! initialTNM: Merge if history changed
+        // ! diseaseProperties: Handle history
+        if (d.diseaseProperties != otherD.diseaseProperties)
+        {
+            if (checkHistoryShouldBeReplaced(d, otherD.history, d.history, patientIdentifierString, &mergeHints))
             {
-                if (p->diseases.size())
+                QString entityString; if (d.entity() == Pathology::ColorectalAdeno) entityString="CRC"; if (d.entity() == Pathology::PulmonaryAdeno) entityString="ADC";
+                mergeActions << entityString + " History of "+ patientIdentifierString + " will be replaced";
+                d.history = otherD.history;
+                if (otherD.initialDiagnosis.isValid())
                 {
-                    mergeHints << "Second entity for " + patientIdentifierString + ", please check manually";
+                    d.initialDiagnosis = otherD.initialDiagnosis;
                 }
-                else
+                if (!otherD.initialTNM.toText().isEmpty())
                 {
-                    mergeActions << "Adding new disease for " + patientIdentifierString;
-                    changed |= ChangedDiseaseMetadata | ChangedDiseaseProperties | ChangedDiseaseHistory | ChangedPathologyData;
-                    continue;
+                    d.initialTNM = otherD.initialTNM;
                 }
+                changed |= PatientManager::ChangedDiseaseHistory | PatientManager::ChangedDiseaseMetadata;
+            }
+        }
+        foreach (const Pathology& otherP, otherD.pathologies)
+        {
+            if (!d.hasPathology(otherP.context))
+            {
+                mergeActions << "Adding new pathology for " + patientIdentifierString;
+                d.pathologies << otherP;
+                // reset id trans-database
+                d.pathologies.last().id = 0;
+                changed |= PatientManager::ChangedPathologyData;
             }
             else
             {
-                Disease& d = p->diseases[diseaseIndex];
-                // ! initialDiagnosis: Do not merge
-                // ! initialTNM: Do not merge
-                // ! diseaseProperties: Handle history
-                if (d.diseaseProperties != otherD.diseaseProperties)
+                Pathology& pa = d.firstPathology(otherP.context);
+                if (pa == otherP)
                 {
-                    DiseaseHistory h = d.history;
-                    DiseaseHistory otherH = otherD.history;
-                    if (checkHistoryShouldBeReplaced(d, otherH, h, patientIdentifierString, &mergeHints))
-                    {
-                        QString entityString; if (d.entity() == Pathology::ColorectalAdeno) entityString="CRC"; if (d.entity() == Pathology::PulmonaryAdeno) entityString="ADC";
-                        mergeActions << entityString + " History of "+ patientIdentifierString + " will be replaced";
-                        changed |= ChangedDiseaseHistory;
-                    }
+                    continue;
                 }
-                foreach (const Pathology& otherP, otherD.pathologies)
+                mergeActions << "Merging changed pathology for " + patientIdentifierString;
+                pa.entity = otherP.entity;
+                pa.sampleOrigin = otherP.sampleOrigin;
+                pa.date = otherP.date;
+                pa.properties.merge(otherP.properties);
+                changed |= PatientManager::ChangedPathologyData;
+            }
+        }
+    }
+    if (changed == PatientManager::ChangedPatientProperties)
+    {
+        mergeActions << "Merging patient properties for " + patientIdentifierString;
+    }
+    return changed;
+}
+
+void PatientManager::mergeDatabase(const DatabaseParameters& otherDb)
+{
+    // the merge plan is computed from the current state of the database
+    flush();
+
+    DefaultInitializationObserver observer;
+    DatabaseAccess* access = DatabaseAccess::createExternalPatientDBAccess(otherDb, &observer);
+    if (!access)
+    {
+        qWarning() << "Failed to access other database" << otherDb;
+        return;
+    }
+
+    QList<Patient> patients = loadAllPatients(access->db());
+    delete access;
+    qDebug() << "Currently" << d->patients.size() << "patients, new db" << patients.size();
+
+    // Compute the merge plan once. It is shown for confirmation, then applied as is.
+    PatientIdentityIndex index;
+    foreach (const Patient::Ptr& p, d->patients)
+    {
+        index.insert(p);
+    }
+
+    MergePlan plan;
+    QHash<Patient*, int> entryForTarget;
+    QHash<QString, int>  entryForNewPatient;
+    foreach (const Patient& other, patients)
+    {
+        const bool canLookUp = PatientIdentityIndex::canLookUp(other);
+        QList<Patient::Ptr> ps = canLookUp ? index.find(other) : findPatients(other);
+
+        int entryIndex;
+        if (ps.isEmpty())
+        {
+            const QString key = PatientIdentityIndex::key(other);
+            entryIndex = canLookUp ? entryForNewPatient.value(key, -1) : -1;
+            if (entryIndex == -1)
+            {
+                plan.actions << "Merge new Patient " + other.firstName + " " + other.surname + " "  + other.dateOfBirth.toString();
+                MergePlan::Entry entry;
+                entry.merged = Patient::Ptr(new Patient(other));
+                entry.merged->patientProperties = other.patientProperties;
+                entry.merged->id = 0; // will not be added to db if it has an id
+                entry.changed = ChangedAll;
+                // diseases are merged, the details of a new patient are not listed
+                QStringList newPatientActions;
+                mergePatient(*entry.merged, other, newPatientActions, plan.hints);
+                plan.entries << entry;
+                if (canLookUp)
                 {
-                    if (!d.hasPathology(otherP.context))
-                    {
-                        mergeActions << "Adding new pathology for " + patientIdentifierString;
-                        changed |= ChangedPathologyData;
-                        continue;
-                    }
-                    else
-                    {
-                        Pathology& pa = d.firstPathology(otherP.context);
-                        if (pa == otherP)
-                        {
-                            continue;
-                        }
-                        mergeActions << "Merging changed pathology for " + patientIdentifierString;
-                        qDebug() << "Pathology different:" << p->firstName << p->surname << p->dateOfBirth.toString();
-
-                        changed |= ChangedPathologyData;
-                        continue;
-                    }
+                    entryForNewPatient[key] = plan.entries.size() - 1;
                 }
+                continue;
             }
         }
-        if (changed == ChangedPatientProperties)
+        else
         {
-            mergeActions << "Merging patient properties for " + patientIdentifierString;
+            if (ps.size() > 1)
+            {
+                plan.actions << "Warning: Multiple patients found for" + other.firstName + other.surname + other.dateOfBirth.toString();
+            }
+            Patient::Ptr p = ps.first();
+            entryIndex = entryForTarget.value(p.data(), -1);
+            if (entryIndex == -1)
+            {
+                MergePlan::Entry entry;
+                entry.target = p;
+                entry.merged = Patient::Ptr(new Patient);
+                *entry.merged = *p;
+                plan.entries << entry;
+                entryIndex = plan.entries.size() - 1;
+                entryForTarget[p.data()] = entryIndex;
+            }
         }
+
+        MergePlan::Entry& entry = plan.entries[entryIndex];
+        entry.changed |= mergePatient(*entry.merged, other, plan.actions, plan.hints);
     }
-    qDebug() << "Mergehints/actions" << mergeHints << mergeActions;
+    qDebug() << "Mergehints/actions" << plan.hints << plan.actions;
 
-    if (mergeActions.isEmpty())
+    if (plan.actions.isEmpty())
     {
-        if (mergeHints.isEmpty())
+        if (plan.hints.isEmpty())
         {
             QMessageBox::information(0, tr("Keine Änderungen"), tr("Keine Änderungen zum Zusammenführen"));
             return;
@@ -771,7 +1020,7 @@ void PatientManager::mergeDatabase(const DatabaseParameters& otherDb)
         else
         {
             QMessageBoxResize msgBox(QMessageBox::Information, tr("Keine Änderungen"), tr("Keine Änderungen zum Zusammenführen. Bitte beachten Sie die Hinweise."), QMessageBox::Ok);
-            msgBox.setDetailedText(mergeHints.join("\n"));
+            msgBox.setDetailedText(plan.hints.join("\n"));
             msgBox.resize(800, 600);
             msgBox.exec();
             return;
@@ -779,8 +1028,8 @@ void PatientManager::mergeDatabase(const DatabaseParameters& otherDb)
     }
     else
     {
-        QMessageBoxResize msgBox(QMessageBox::Question, tr("Zusammenführen"), tr("Sollen %1 Änderungen durchgeführt werden?").arg(mergeActions.size()), QMessageBox::Ok | QMessageBox::Cancel);
-        msgBox.setDetailedText(mergeActions.join("\n") + "\n" + mergeHints.join(("\n")));
+        QMessageBoxResize msgBox(QMessageBox::Question, tr("Zusammenführen"), tr("Sollen %1 Änderungen durchgeführt werden?").arg(plan.actions.size()), QMessageBox::Ok | QMessageBox::Cancel);
+        msgBox.setDetailedText(plan.actions.join("\n") + "\n" + plan.hints.join(("\n")));
         msgBox.resize(800, 600);
         if (msgBox.exec() != QMessageBox::Ok)
         {
@@ -788,121 +1037,77 @@ void PatientManager::mergeDatabase(const DatabaseParameters& otherDb)
         }
     }
 
-    DatabaseAccess taccess;
-    DatabaseTransaction transaction(&taccess);
-    foreach (const Patient& other, patients)
+    // Apply the plan to the database in a single transaction.
+    // The patients in memory are only changed when it was committed.
+    QList<int> appliedEntries;
+    bool       success;
+    QString    error;
     {
-        Patient::Ptr p;
-        ChangeFlags changed = ChangedNothing;
-        QList<Patient::Ptr> ps = findPatients(other);
-        if (ps.isEmpty())
+        DatabaseAccess taccess;
+        DatabaseTransaction transaction(&taccess);
+        const int failuresBefore = taccess.backend()->failedStatementCount();
+        for (int i=0; i<plan.entries.size(); i++)
         {
-            qDebug() << "New patient merged" << other.surname;
-            Patient newValues(other);
-            newValues.id = 0; // will not be added to db if it has an id
-            newValues.diseases.clear(); // merge below, afterwards
-            p = addPatient(newValues);
-            if (!p)
+            const MergePlan::Entry& entry = plan.entries.at(i);
+            if (entry.changed == ChangedNothing)
             {
-                qDebug() << "Failed to add patient when merging" << other.firstName << other.surname;
                 continue;
             }
-            changed = ChangedAll;
+            if (!entry.target)
+            {
+                // The plan already checked for duplicates, so no need to go through addPatient
+                if (!entry.merged->isValid())
+                {
+                    qDebug() << "Failed to add patient when merging" << entry.merged->firstName << entry.merged->surname;
+                    continue;
+                }
+                qDebug() << "New patient merged" << entry.merged->surname;
+                entry.merged->id = taccess.db()->addPatient(*entry.merged);
+            }
+            // written synchronously, inside the transaction. Assigns the ids of new diseases and pathologies.
+            storeData(entry.merged, entry.changed);
+            appliedEntries << i;
+        }
+
+        if (taccess.backend()->failedStatementCount() != failuresBefore)
+        {
+            error = taccess.backend()->lastError();
+            transaction.rollback();
+            success = false;
         }
         else
         {
-            p = ps.first();
-            if (ps.size() > 1)
+            success = transaction.commit();
+            if (!success)
             {
-                qWarning() << "Multiple patients found for" << p->firstName << p->surname << p->dateOfBirth;
+                error = taccess.backend()->lastError();
             }
         }
+    }
 
-        QString patientIdentifierString = p->firstName + " " + p->surname + ", " + p->dateOfBirth.toString();
+    if (!success)
+    {
+        qWarning() << "Merging failed, the database was rolled back:" << error;
+        QMessageBox::warning(0, tr("Zusammenführen fehlgeschlagen"),
+                             tr("Die Änderungen konnten nicht gespeichert werden, die Datenbank ist unverändert.\n%1").arg(error));
+        return;
+    }
 
-        if (p->patientProperties != other.patientProperties)
+    foreach (int i, appliedEntries)
+    {
+        const MergePlan::Entry& entry = plan.entries.at(i);
+        Patient::Ptr p = entry.target;
+        if (p)
         {
-            p->patientProperties.merge(other.patientProperties);
-            changed |= ChangedPatientProperties;
+            *p = *entry.merged;
         }
-        foreach (const Disease& otherD, other.diseases)
+        else
         {
-            int diseaseIndex;
-            for (diseaseIndex=0; diseaseIndex<p->diseases.size(); ++diseaseIndex)
-            {
-                if (p->diseases[diseaseIndex].entity() == otherD.entity())
-                {
-                    break;
-                }
-            }
-            if (diseaseIndex == p->diseases.size())
-            {
-                if (p->diseases.size())
-                {
-                    qDebug() << "Second entity NOT copied automatically" << patientIdentifierString;
-                }
-                else
-                {
-                    qDebug() << "Copy new disease" << patientIdentifierString;
-                    p->diseases << otherD;
-                    Disease& d = p->diseases.last();
-                    // reset id trans-database
-                    d.id = 0;
-                    for (int o=0; o<d.pathologies.size(); o++)
-                    {
-                        d.pathologies[o].id = 0;
-                    }
-                    changed |= ChangedDiseaseMetadata | ChangedDiseaseProperties | ChangedDiseaseHistory | ChangedPathologyData;
-                }
-            }
-            else
-            {
-                Disease& d = p->diseases[diseaseIndex];
-                // ! initialDiagnosis: Merge if history changed
-                // ! initialTNM: Merge if history changed
-                // ! diseaseProperties: Handle history
-                if (d.diseaseProperties != otherD.diseaseProperties)
-                {
-                    DiseaseHistory h = d.history;
-                    DiseaseHistory otherH = otherD.history;
-                    if (checkHistoryShouldBeReplaced(d, otherH, h, patientIdentifierString))
-                    {
-                        d.history = otherH;
-                        if (otherD.initialDiagnosis.isValid())
-                        {
-                            d.initialDiagnosis = otherD.initialDiagnosis;
-                        }
-                        if (!otherD.initialTNM.toText().isEmpty())
-                            d.initialTNM = otherD.initialTNM;
-                    }
-                }
-                foreach (const Pathology& otherP, otherD.pathologies)
-                {
-                    if (!d.hasPathology(otherP.context))
-                    {
-                        qDebug() << "Copy new pathology" << patientIdentifierString;
-                        d.pathologies << otherP;
-                        // reset id trans-database
-                        d.pathologies.last().id = 0;
-                        changed |= ChangedPathologyData;
-                    }
-                    else
-                    {
-                        Pathology& pa = d.firstPathology(otherP.context);
-                        if (pa == otherP)
-                        {
-                            continue;
-                        }
-                        qDebug() << "Merging pathology" << patientIdentifierString << pa.context;
-                        pa.entity = otherP.entity;
-                        pa.sampleOrigin = otherP.sampleOrigin;
-                        pa.date = otherP.date;
-                        pa.properties.merge(otherP.properties);
-                        changed |= ChangedPathologyData;
-                    }
-                }
-            }
+            // copies only the patient data, the id is set
+            p = createPatient(*entry.merged);
+            *p = *entry.merged;
+            emit patientAdded(d->patients.size()-1, p);
         }
-        updateData(p, changed);
+        emit patientDataChanged(p, entry.changed);
     }
 }
@@ -61,6 +61,11 @@ public:
     void readDatabase();
 
     Patient::Ptr addPatient(const Patient& values);
+    /**
+      Writes the changed parts of the patient to the database and emits patientDataChanged.
+      Returns at once, the data is written by a worker thread. patientStored or patientStoreFailed
+      is emitted when done. Several changes of the same patient may be written together.
+      */
     void updateData(const Patient::Ptr& patient, ChangeFlags flags);
     void removePatient(const Patient::Ptr& patient);
 
@@ -77,6 +82,7 @@ public:
                                      const QDate& dob = QDate(),
                                      Patient::Gender gender = Patient::UnknownGender);
 
+    /// Appends value to the security journal (see SecurityJournal)
     void historySecurityCopy(const Patient::Ptr& p, const QString& type, const QString& value);
     void mergeDatabase(const DatabaseParameters& otherDb);
 
@@ -90,14 +96,30 @@ signals:
     void progressStarted(int max);
     void progressValue(int value);
 
+    void patientStored(int patientId, int flags);
+    void patientStoreFailed(int patientId, int flags, const QString& error);
+
 public slots:
 
+    /// Blocks until all changes passed to updateData and all security copies are written
+    void flush();
+
+    /// True if the changes of some patients could not be written and wait for a retry
+    bool hasUnsavedChanges() const;
+
+protected slots:
+
+    void slotPatientStored(int patientId, int flags);
+    void slotPatientStoreFailed(int patientId, int flags, const QString& error);
+    void retryFailedWrites();
+
 protected:
 
     void loadData(const Patient::Ptr& patient);
     Patient::Ptr createPatient(const Patient& values);
     void cleanUpPatient(int index);
     void storeData(const Patient::Ptr& patient, ChangeFlags flags);
+    void assignIds(const Patient::Ptr& patient, ChangeFlags flags);
 
 private:
 
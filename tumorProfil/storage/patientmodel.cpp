@@ -28,6 +28,7 @@
 // Local includes
 
 #include "patientmanager.h"
+#include "patientsearchindex.h"
 #include "pathologypropertyinfo.h"
 
 namespace
@@ -44,7 +45,8 @@ namespace
 }
 
 PatientModel::PatientModel(QObject *parent) :
-    QAbstractItemModel(parent)
+    QAbstractItemModel(parent),
+    m_searchIndex(0)
 {
     connect(PatientManager::instance(), SIGNAL(patientAdded(int,Patient::Ptr)),
             this, SLOT(patientAdded(int,Patient::Ptr)));
@@ -56,6 +58,11 @@ PatientModel::PatientModel(QObject *parent) :
             this, SLOT(patientDataChanged(Patient::Ptr, int)));
 }
 
+PatientModel::~PatientModel()
+{
+    delete m_searchIndex;
+}
+
 static bool hasTumorprofil(const Patient::Ptr& p)
 {
     return p->hasDisease() && p->firstDisease().hasPathology(PathologyContextInfo::Tumorprofil);
@@ -66,6 +73,16 @@ void PatientModel::installRoleDataProvider(Qt::ItemDataRole role, RoleDataProvid
     m_roleDataProviders[role] = provider;
 }
 
+const PatientSearchIndex* PatientModel::searchIndex() const
+{
+    if (!m_searchIndex)
+    {
+        m_searchIndex = new PatientSearchIndex;
+        m_searchIndex->build(PatientManager::instance()->patients());
+    }
+    return m_searchIndex;
+}
+
 QVariant PatientModel::data(const QModelIndex& index, int role) const
 {
     if (!index.isValid())
@@ -268,14 +285,22 @@ Patient::Ptr PatientModel::retrievePatient(const QModelIndex& index)
     return data.value<Patient::Ptr>();
 }
 
-void PatientModel::patientAdded(int index, const Patient::Ptr&)
+void PatientModel::patientAdded(int index, const Patient::Ptr& patient)
 {
+    if (m_searchIndex)
+    {
+        m_searchIndex->add(patient);
+    }
     beginInsertRows(QModelIndex(), index, index);
     endInsertRows();
 }
 
 void PatientModel::patientDataChanged(const Patient::Ptr& patient, int)
 {
+    if (m_searchIndex)
+    {
+        m_searchIndex->update(patient);
+    }
     QModelIndex index = indexForPatient(patient);
     emit dataChanged(index, index);
 }
@@ -285,8 +310,12 @@ void PatientModel::patientAboutToBeRemoved(int index, const Patient::Ptr&)
     beginRemoveRows(QModelIndex(), index, index);
 }
 
-void PatientModel::patientRemoved(const Patient::Ptr&)
+void PatientModel::patientRemoved(const Patient::Ptr& patient)
 {
+    if (m_searchIndex)
+    {
+        m_searchIndex->remove(patient);
+    }
     endRemoveRows();
 }
 
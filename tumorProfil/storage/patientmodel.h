@@ -31,6 +31,7 @@
 #include "patient.h"
 
 class PatientModel;
+class PatientSearchIndex;
 class RoleDataProvider
 {
 public:
@@ -51,6 +52,7 @@ public:
     };
 
     explicit PatientModel(QObject *parent = 0);
+    ~PatientModel();
 
     QModelIndex indexForPatient(const Patient::Ptr& patient) const;
     Patient::Ptr patientForIndex(const QModelIndex& index) const;
@@ -69,18 +71,22 @@ public:
     // install a provider for given role. Ownership is not taken.
     void installRoleDataProvider(Qt::ItemDataRole role, RoleDataProvider* provider);
 
+    /// Index for searching patients by name and id. Created on first use, then kept up to date.
+    const PatientSearchIndex* searchIndex() const;
+
 protected slots:
 
-    void patientAdded(int index, const Patient::Ptr& patient);
-    void patientDataChanged(const Patient::Ptr& patient, int);
-    void patientAboutToBeRemoved(int index, const Patient::Ptr& patient);
-    void patientRemoved(const Patient::Ptr& patient);
+    virtual void patientAdded(int index, const Patient::Ptr& patient);
+    virtual void patientDataChanged(const Patient::Ptr& patient, int);
+    virtual void patientAboutToBeRemoved(int index, const Patient::Ptr& patient);
+    virtual void patientRemoved(const Patient::Ptr& patient);
 
 protected:
 
     QModelIndex createIndexForRow(int row, int column) const;
 
     QMap<int, RoleDataProvider*> m_roleDataProviders;
+    mutable PatientSearchIndex*  m_searchIndex;
 };
 
 #endif // PATIENTMODEL_H
@@ -0,0 +1,436 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#include "patientpredicateindex.h"
+
+// Qt includes
+
+#include <QHash>
+#include <QVector>
+#include <QWeakPointer>
+
+// Local includes
+
+#include "patientmanager.h"
+#include "patientpropertyfiltermodel.h"
+
+namespace
+{
+
+// Not to grow without bounds when many different filters are tried
+const int maximumCachedPredicates = 256;
+
+class Predicate
+{
+public:
+
+    enum Kind
+    {
+        HasPathology,
+        Entity,
+        PathologyProperty,
+        Context,
+        Trial,
+        LocalCenter,
+        Dates
+    };
+
+    Predicate()
+        : kind(HasPathology)
+    {
+    }
+
+    Predicate(Kind kind, const QString& key)
+        : kind(kind), key(key)
+    {
+    }
+
+    bool evaluate(const Patient::Ptr& p) const
+    {
+        switch (kind)
+        {
+        case HasPathology:
+            return p->hasPathology();
+        case Entity:
+            return settings.matchesEntities(p);
+        case Trial:
+            return settings.matchesTrialParticipation(p);
+        case LocalCenter:
+            return settings.matchesCriteria(p);
+        case PathologyProperty:
+            // these need the first disease
+            return p->hasPathology() && settings.matchesPathologyProperties(p);
+        case Context:
+            return p->hasPathology() && settings.matchesPathologyContexts(p);
+        case Dates:
+            return p->hasPathology() && settings.matchesDates(p);
+        }
+        return false;
+    }
+
+    Kind    kind;
+    QString key;
+    // holds only the filter which this predicate represents
+    PatientPropertyFilterSettings settings;
+};
+
+Predicate hasPathologyPredicate()
+{
+    return Predicate(Predicate::HasPathology, "h");
+}
+
+Predicate entityPredicate(Pathology::Entity entity)
+{
+    Predicate predicate(Predicate::Entity, "e:" + QString::number(entity));
+    predicate.settings.entities << entity;
+    return predicate;
+}
+
+Predicate pathologyPropertyPredicate(const QString& property, const QVariant& value)
+{
+    // The type is part of the filter: strings are compared literally, booleans loosely
+    Predicate predicate(Predicate::PathologyProperty,
+                        "p:" + property + '\x1f' + value.typeName() + '\x1f' + value.toString());
+    predicate.settings.pathologyProperties[property] = value;
+    return predicate;
+}
+
+Predicate contextPredicate(const QString& context)
+{
+    Predicate predicate(Predicate::Context, "c:" + context);
+    predicate.settings.pathologyContexts[context] = true;
+    return predicate;
+}
+
+Predicate trialPredicate(const QString& trial)
+{
+    Predicate predicate(Predicate::Trial, "t:" + trial);
+    predicate.settings.trialParticipation[trial] = true;
+    return predicate;
+}
+
+Predicate localCenterPredicate()
+{
+    Predicate predicate(Predicate::LocalCenter, "l");
+    predicate.settings.criteria[PatientPropertyFilterSettings::LocalCenterOrigin] = true;
+    return predicate;
+}
+
+Predicate datesPredicate(const PatientPropertyFilterSettings& settings)
+{
+    QString key = "d:" + settings.resultDateBegin.toString(Qt::ISODate)
+                  + '\x1f' + settings.resultDateEnd.toString(Qt::ISODate);
+    if (settings.dateAppliesCombinedWithContext)
+    {
+        QMap<QString, bool>::const_iterator it;
+        for (it = settings.pathologyContexts.begin(); it != settings.pathologyContexts.end(); ++it)
+        {
+            key += '\x1f' + it.key() + (it.value() ? "+" : "-");
+        }
+    }
+    Predicate predicate(Predicate::Dates, key);
+    predicate.settings.resultDateBegin                = settings.resultDateBegin;
+    predicate.settings.resultDateEnd                  = settings.resultDateEnd;
+    predicate.settings.dateAppliesCombinedWithContext = settings.dateAppliesCombinedWithContext;
+    predicate.settings.pathologyContexts              = settings.pathologyContexts;
+    return predicate;
+}
+
+}
+
+class PatientPredicateIndex::PatientPredicateIndexPriv
+{
+public:
+
+    class Entry
+    {
+    public:
+
+        Predicate predicate;
+        QBitArray bits;
+    };
+
+    QHash<QString, Entry>           entries;
+
+    QHash<int, int>                 slotForId;
+    QVector<QWeakPointer<Patient> > slotPatients;
+
+    int slotCount() const
+    {
+        return slotPatients.size();
+    }
+
+    void evaluateSlot(int slot, const Patient::Ptr& p)
+    {
+        QHash<QString, Entry>::iterator it;
+        for (it = entries.begin(); it != entries.end(); ++it)
+        {
+            it->bits.setBit(slot, it->predicate.evaluate(p));
+        }
+    }
+
+    /// Assigns a slot to p if it is new, returns -1 if p already has a slot
+    int assignSlot(const Patient::Ptr& p)
+    {
+        QHash<int, int>::const_iterator it = slotForId.constFind(p->id);
+        if (it == slotForId.constEnd())
+        {
+            const int slot = slotPatients.size();
+            slotForId.insert(p->id, slot);
+            slotPatients << p.toWeakRef();
+            return slot;
+        }
+        if (slotPatients.at(it.value()) != p)
+        {
+            // the id was given to a new patient object
+            slotPatients[it.value()] = p.toWeakRef();
+            return it.value();
+        }
+        return -1;
+    }
+
+    void resizeBits()
+    {
+        QHash<QString, Entry>::iterator it;
+        for (it = entries.begin(); it != entries.end(); ++it)
+        {
+            it->bits.resize(slotCount());
+        }
+    }
+
+    /// Assigns slots to all patients which are new, and evaluates the cached predicates for them
+    void sync()
+    {
+        QList<int> changedSlots;
+        QList<Patient::Ptr> changedPatients;
+        foreach (const Patient::Ptr& p, PatientManager::instance()->patients())
+        {
+            const int slot = assignSlot(p);
+            if (slot != -1)
+            {
+                changedSlots << slot;
+                changedPatients << p;
+            }
+        }
+
+        if (changedSlots.isEmpty())
+        {
+            return;
+        }
+        resizeBits();
+        for (int i=0; i<changedSlots.size(); i++)
+        {
+            evaluateSlot(changedSlots.at(i), changedPatients.at(i));
+        }
+    }
+
+    QBitArray bitsFor(const Predicate& predicate)
+    {
+        QHash<QString, Entry>::const_iterator it = entries.constFind(predicate.key);
+        if (it != entries.constEnd())
+        {
+            return it->bits;
+        }
+
+        if (entries.size() >= maximumCachedPredicates)
+        {
+            entries.clear();
+        }
+
+        Entry entry;
+        entry.predicate = predicate;
+        entry.bits      = QBitArray(slotCount());
+        foreach (const Patient::Ptr& p, PatientManager::instance()->patients())
+        {
+            const int slot = slotForId.value(p->id, -1);
+            if (slot != -1)
+            {
+                entry.bits.setBit(slot, predicate.evaluate(p));
+            }
+        }
+        entries.insert(predicate.key, entry);
+        return entry.bits;
+    }
+};
+
+PatientPredicateIndex::PatientPredicateIndex()
+    : d(new PatientPredicateIndexPriv)
+{
+}
+
+PatientPredicateIndex::~PatientPredicateIndex()
+{
+    delete d;
+}
+
+int PatientPredicateIndex::slot(const Patient::Ptr& p) const
+{
+    if (!p)
+    {
+        return -1;
+    }
+    const int slot = d->slotForId.value(p->id, -1);
+    if (slot == -1 || d->slotPatients.at(slot) != p)
+    {
+        return -1;
+    }
+    return slot;
+}
+
+int PatientPredicateIndex::insert(const Patient::Ptr& p)
+{
+    if (!p)
+    {
+        return -1;
+    }
+    const int s = d->assignSlot(p);
+    if (s == -1)
+    {
+        return slot(p);
+    }
+    d->resizeBits();
+    d->evaluateSlot(s, p);
+    return s;
+}
+
+void PatientPredicateIndex::update(const Patient::Ptr& p)
+{
+    const int s = slot(p);
+    if (s != -1)
+    {
+        d->evaluateSlot(s, p);
+    }
+}
+
+void PatientPredicateIndex::clear()
+{
+    d->entries.clear();
+}
+
+QBitArray PatientPredicateIndex::matching(const PatientPropertyFilterSettings& settings)
+{
+    d->sync();
+    const int size = d->slotCount();
+
+    // Keep in sync with PatientPropertyFilterSettings::matches
+
+    const bool filteringByEntity       = !settings.entities.isEmpty();
+    const bool filteringByPathology    = !settings.pathologyProperties.isEmpty();
+    const bool filteringByPathologyAnd = !settings.pathologyPropertiesAnd.isEmpty();
+    const bool filteringByContext      = !settings.pathologyContexts.isEmpty();
+    const bool filteringByTrial        = !settings.trialParticipation.isEmpty();
+    const bool filteringByDate         = settings.resultDateBegin.isValid() ||
+                                           settings.resultDateEnd.isValid();
+    const bool filteringByCriteria     = !settings.criteria.isEmpty();
+
+    QBitArray result(size, true);
+
+    if (!filteringByEntity && !filteringByPathology && !filteringByPathologyAnd && !filteringByContext && !filteringByTrial && !filteringByDate && !filteringByCriteria)
+    {
+        return result;
+    }
+
+    if (filteringByPathology || filteringByPathologyAnd || filteringByContext || filteringByDate)
+    {
+        result &= d->bitsFor(hasPathologyPredicate());
+    }
+
+    if (filteringByContext)
+    {
+        // The first context in map order which a patient has decides
+        QBitArray contexts(size);
+        QBitArray undecided(size, true);
+        QMap<QString, bool>::const_iterator it;
+        for (it = settings.pathologyContexts.begin(); it != settings.pathologyContexts.end(); ++it)
+        {
+            const QBitArray found = d->bitsFor(contextPredicate(it.key())) & undecided;
+            if (it.value())
+            {
+                contexts |= found;
+            }
+            undecided &= ~found;
+        }
+        result &= contexts;
+    }
+
+    if (filteringByTrial)
+    {
+        // only the first entry is regarded
+        QMap<QString, bool>::const_iterator it = settings.trialParticipation.begin();
+        const QBitArray participating = d->bitsFor(trialPredicate(it.key()));
+        result &= it.value() ? participating : ~participating;
+    }
+
+    if (filteringByCriteria)
+    {
+        QMap<PatientPropertyFilterSettings::Criteria, bool>::const_iterator it;
+        for (it = settings.criteria.begin(); it != settings.criteria.end(); ++it)
+        {
+            switch (it.key())
+            {
+            case PatientPropertyFilterSettings::LocalCenterOrigin:
+            {
+                const QBitArray local = d->bitsFor(localCenterPredicate());
+                result &= it.value() ? local : ~local;
+                break;
+            }
+            }
+        }
+    }
+
+    if (filteringByDate)
+    {
+        result &= d->bitsFor(datesPredicate(settings));
+    }
+
+    if (filteringByEntity)
+    {
+        QBitArray entities(size);
+        foreach (Pathology::Entity entity, settings.entities)
+        {
+            entities |= d->bitsFor(entityPredicate(entity));
+        }
+        result &= entities;
+    }
+
+    if (filteringByPathology)
+    {
+        QBitArray any(size);
+        QMap<QString, QVariant>::const_iterator it;
+        for (it = settings.pathologyProperties.begin(); it != settings.pathologyProperties.end(); ++it)
+        {
+            any |= d->bitsFor(pathologyPropertyPredicate(it.key(), it.value()));
+        }
+        result &= any;
+    }
+
+    if (filteringByPathologyAnd)
+    {
+        QMap<QString, QVariant>::const_iterator it;
+        for (it = settings.pathologyPropertiesAnd.begin(); it != settings.pathologyPropertiesAnd.end(); ++it)
+        {
+            result &= d->bitsFor(pathologyPropertyPredicate(it.key(), it.value()));
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,81 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#ifndef PATIENTPREDICATEINDEX_H
+#define PATIENTPREDICATEINDEX_H
+
+// Qt includes
+
+#include <QBitArray>
+
+// Local includes
+
+#include "patient.h"
+
+class PatientPropertyFilterSettings;
+
+/**
+  Evaluates PatientPropertyFilterSettings for all patients of the PatientManager at once.
+
+  Each atomic predicate (an entity, a pathology property value, a context, a trial,
+  a criterion, a date range) is evaluated once per patient and kept as a bit array.
+  A combination of settings is then computed by AND / OR / NOT of whole bit arrays.
+  When a patient's data changes, only this patient's bits are reevaluated.
+
+  Bit positions are slots assigned per patient, which remain stable when other patients are removed.
+  Not thread-safe, to be used from the thread of the model.
+  */
+class PatientPredicateIndex
+{
+public:
+
+    PatientPredicateIndex();
+    ~PatientPredicateIndex();
+
+    /**
+      Returns, by slot, the patients accepted by settings.
+      The result is the same as calling settings.matches() for each patient.
+      */
+    QBitArray matching(const PatientPropertyFilterSettings& settings);
+
+    /// Returns the bit position of p in the result of matching(), or -1 if p was not yet seen
+    int slot(const Patient::Ptr& p) const;
+
+    /**
+      Assigns a slot to p, a patient added since the last call to matching(),
+      and evaluates the cached predicates for it. Returns the slot.
+      */
+    int insert(const Patient::Ptr& p);
+
+    /// Reevaluates all cached predicates for p, after its data has changed
+    void update(const Patient::Ptr& p);
+
+    /// Drops all cached predicates
+    void clear();
+
+private:
+
+    class PatientPredicateIndexPriv;
+    PatientPredicateIndexPriv* const d;
+};
+
+#endif // PATIENTPREDICATEINDEX_H
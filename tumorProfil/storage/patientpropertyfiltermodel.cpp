@@ -21,21 +21,237 @@
 
 #include "patientpropertyfiltermodel.h"
 
+#include <algorithm>
+
 #include <QDebug>
+#include <QVector>
+#include <QtConcurrent/QtConcurrentMap>
 
 #include "combinedvalue.h"
 #include "databaseconstants.h"
 #include "patientmodel.h"
 #include "pathologypropertyinfo.h"
+#include "patientpredicateindex.h"
+#include "patientsearchindex.h"
+#include "tracing.h"
+
+namespace
+{
+
+/**
+  A sort value converted once from the QVariant returned by the model,
+  ordered like QSortFilterProxyModel::lessThan orders the variants.
+  */
+class SortKey
+{
+public:
+
+    // Invalid values sort last, as in QSortFilterProxyModel
+    enum Kind
+    {
+        Number,
+        String,
+        Invalid
+    };
+
+    SortKey()
+        : kind(Invalid), valid(false), number(0)
+    {
+    }
+
+    void convert(Qt::CaseSensitivity caseSensitivity)
+    {
+        switch (value.userType())
+        {
+        case QVariant::Invalid:
+            kind = Invalid;
+            break;
+        case QVariant::Bool:
+        case QVariant::Int:
+        case QVariant::UInt:
+        case QVariant::LongLong:
+        case QVariant::ULongLong:
+        case QVariant::Double:
+        case QMetaType::Float:
+            kind   = Number;
+            number = value.toDouble();
+            break;
+        case QVariant::Date:
+            kind   = Number;
+            number = value.toDate().toJulianDay();
+            break;
+        case QVariant::Time:
+            kind   = Number;
+            number = value.toTime().msecsSinceStartOfDay();
+            break;
+        case QVariant::DateTime:
+            kind   = Number;
+            number = value.toDateTime().toMSecsSinceEpoch();
+            break;
+        default:
+            kind   = String;
+            string = value.toString();
+            if (caseSensitivity == Qt::CaseInsensitive)
+            {
+                string = string.toCaseFolded();
+            }
+            break;
+        }
+        // the variant is not needed anymore
+        value = QVariant();
+        valid = true;
+    }
+
+    bool lessThan(const SortKey& other, bool localeAware) const
+    {
+        if (kind != other.kind)
+        {
+            return kind < other.kind;
+        }
+        switch (kind)
+        {
+        case Invalid:
+            return false;
+        case Number:
+            return number < other.number;
+        case String:
+            if (localeAware)
+            {
+                return string.localeAwareCompare(other.string) < 0;
+            }
+            return string < other.string;
+        }
+        return false;
+    }
+
+    Kind     kind;
+    bool     valid;
+    double   number;
+    QString  string;
+    QVariant value;
+};
+
+class SortKeyConverter
+{
+public:
+
+    SortKeyConverter(Qt::CaseSensitivity caseSensitivity)
+        : caseSensitivity(caseSensitivity)
+    {
+    }
+
+    void operator()(SortKey& key)
+    {
+        key.convert(caseSensitivity);
+    }
+
+    Qt::CaseSensitivity caseSensitivity;
+};
+
+// Above this number of rows, the conversion of the fetched values is done in parallel
+const int parallelSortKeyThreshold = 5000;
+
+}
 
 class PatientPropertyFilterModel::PatientPropertyFilterModelPriv
 {
 public:
     PatientPropertyFilterModelPriv()
+        : acceptedValid(false),
+          sortKeyColumn(-1),
+          sortKeyRole(-1),
+          sortKeyCaseSensitivity(Qt::CaseSensitive)
     {
     }
 
     PatientPropertyFilterSettings settings;
+
+    PatientPredicateIndex predicateIndex;
+    QBitArray             accepted;
+    bool                  acceptedValid;
+
+    PatientSearchFilter   searchFilter;
+
+    bool accepts(const Patient::Ptr& p)
+    {
+        if (!acceptedValid)
+        {
+            accepted      = predicateIndex.matching(settings);
+            acceptedValid = true;
+        }
+        int slot = predicateIndex.slot(p);
+        if (slot == -1)
+        {
+            // a patient added since the last evaluation: evaluate this row only
+            const bool matches = settings.matches(p);
+            slot = predicateIndex.insert(p);
+            if (slot >= accepted.size())
+            {
+                accepted.resize(slot + 1);
+            }
+            accepted.setBit(slot, matches);
+            return matches;
+        }
+        if (slot >= accepted.size())
+        {
+            return settings.matches(p);
+        }
+        return accepted.testBit(slot);
+    }
+
+    QVector<SortKey>    sortKeys;
+    int                 sortKeyColumn;
+    int                 sortKeyRole;
+    Qt::CaseSensitivity sortKeyCaseSensitivity;
+
+    void clearSortKeys()
+    {
+        sortKeys.clear();
+        sortKeyColumn = -1;
+    }
+
+    const SortKey& sortKey(const PatientPropertyFilterModel* q, int row, int column)
+    {
+        QAbstractItemModel* const model = q->sourceModel();
+        if (sortKeyColumn != column || sortKeyRole != q->sortRole()
+            || sortKeyCaseSensitivity != q->sortCaseSensitivity()
+            || sortKeys.size() != model->rowCount())
+        {
+            buildSortKeys(q, column);
+        }
+        SortKey& key = sortKeys[row];
+        if (!key.valid)
+        {
+            key.value = model->index(row, column).data(sortKeyRole);
+            key.convert(sortKeyCaseSensitivity);
+        }
+        return key;
+    }
+
+    void buildSortKeys(const PatientPropertyFilterModel* q, int column)
+    {
+        TRACE_SPAN("PatientPropertyFilterModel::buildSortKeys");
+        QAbstractItemModel* const model = q->sourceModel();
+        sortKeyColumn          = column;
+        sortKeyRole            = q->sortRole();
+        sortKeyCaseSensitivity = q->sortCaseSensitivity();
+
+        // The model is not thread-safe: fetch in this thread, convert in parallel
+        const int rows = model->rowCount();
+        sortKeys = QVector<SortKey>(rows);
+        for (int row=0; row<rows; row++)
+        {
+            sortKeys[row].value = model->index(row, column).data(sortKeyRole);
+        }
+        if (rows > parallelSortKeyThreshold)
+        {
+            QtConcurrent::blockingMap(sortKeys, SortKeyConverter(sortKeyCaseSensitivity));
+        }
+        else
+        {
+            std::for_each(sortKeys.begin(), sortKeys.end(), SortKeyConverter(sortKeyCaseSensitivity));
+        }
+    }
 };
 
 PatientPropertyFilterModel::PatientPropertyFilterModel(QObject* parent)
@@ -45,6 +261,107 @@ PatientPropertyFilterModel::PatientPropertyFilterModel(QObject* parent)
     setSortRole(PatientModel::VariantDataRole);
 }
 
+void PatientPropertyFilterModel::setSourceModel(QAbstractItemModel* model)
+{
+    // Only our own connections; the base class disconnects its slots itself
+    if (QAbstractItemModel* const old = sourceModel())
+    {
+        disconnect(old, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
+                   this, SLOT(sourceDataChanged(QModelIndex,QModelIndex)));
+        disconnect(old, SIGNAL(rowsInserted(QModelIndex,int,int)),
+                   this, SLOT(sourceRowsInserted(QModelIndex,int,int)));
+        disconnect(old, SIGNAL(rowsRemoved(QModelIndex,int,int)),
+                   this, SLOT(sourceRowsRemoved(QModelIndex,int,int)));
+        disconnect(old, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)),
+                   this, SLOT(invalidateSortKeys()));
+        disconnect(old, SIGNAL(modelReset()),
+                   this, SLOT(invalidateSortKeys()));
+        disconnect(old, SIGNAL(layoutChanged()),
+                   this, SLOT(invalidateSortKeys()));
+    }
+    d->clearSortKeys();
+
+    // Connect before the base class: keys must be updated before it resorts on these signals
+    if (model)
+    {
+        connect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
+                this, SLOT(sourceDataChanged(QModelIndex,QModelIndex)));
+        connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)),
+                this, SLOT(sourceRowsInserted(QModelIndex,int,int)));
+        connect(model, SIGNAL(rowsRemoved(QModelIndex,int,int)),
+                this, SLOT(sourceRowsRemoved(QModelIndex,int,int)));
+        connect(model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)),
+                this, SLOT(invalidateSortKeys()));
+        connect(model, SIGNAL(modelReset()),
+                this, SLOT(invalidateSortKeys()));
+        connect(model, SIGNAL(layoutChanged()),
+                this, SLOT(invalidateSortKeys()));
+    }
+
+    QSortFilterProxyModel::setSourceModel(model);
+}
+
+bool PatientPropertyFilterModel::lessThan(const QModelIndex& source_left, const QModelIndex& source_right) const
+{
+    if (source_left.parent().isValid() || source_left.column() != source_right.column())
+    {
+        return QSortFilterProxyModel::lessThan(source_left, source_right);
+    }
+    const SortKey& left  = d->sortKey(this, source_left.row(), source_left.column());
+    const SortKey& right = d->sortKey(this, source_right.row(), source_right.column());
+    return left.lessThan(right, isSortLocaleAware());
+}
+
+void PatientPropertyFilterModel::sourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+{
+    if (!topLeft.isValid() || !bottomRight.isValid() || topLeft.parent().isValid())
+    {
+        return;
+    }
+
+    // PatientModel signals a change of the patient with the first column only,
+    // so regard the whole row as changed
+    for (int row = topLeft.row(); row <= bottomRight.row(); row++)
+    {
+        Patient::Ptr p = PatientModel::retrievePatient(sourceModel()->index(row, 0));
+        if (p)
+        {
+            d->predicateIndex.update(p);
+        }
+        if (row < d->sortKeys.size())
+        {
+            d->sortKeys[row].valid = false;
+        }
+    }
+    d->acceptedValid = false;
+}
+
+void PatientPropertyFilterModel::sourceRowsInserted(const QModelIndex& parent, int start, int end)
+{
+    if (parent.isValid() || d->sortKeys.isEmpty() || start > d->sortKeys.size())
+    {
+        invalidateSortKeys();
+        return;
+    }
+    // the new keys are invalid and computed on first use
+    d->sortKeys.insert(start, end - start + 1, SortKey());
+}
+
+void PatientPropertyFilterModel::sourceRowsRemoved(const QModelIndex& parent, int start, int end)
+{
+    if (parent.isValid() || end >= d->sortKeys.size())
+    {
+        invalidateSortKeys();
+        return;
+    }
+    d->sortKeys.remove(start, end - start + 1);
+}
+
+void PatientPropertyFilterModel::invalidateSortKeys()
+{
+    d->clearSortKeys();
+}
+
 PatientPropertyFilterModel::~PatientPropertyFilterModel()
 {
     delete d;
@@ -57,7 +374,8 @@ PatientPropertyFilterSettings PatientPropertyFilterModel::filterSettings() const
 
 void PatientPropertyFilterModel::setFilterSettings(const PatientPropertyFilterSettings& settings)
 {
-    d->settings = settings;
+    d->settings      = settings;
+    d->acceptedValid = false;
     invalidateFilter();
 }
 
@@ -322,29 +640,21 @@ bool PatientPropertyFilterSettings::matchesCriteria(Patient::Ptr p) const
     return true;
 }
 
-bool PatientPropertyFilterModel::filterAcceptsRow(int source_row, const QModelIndex& source_parent) const
+bool PatientPropertyFilterSettings::matches(Patient::Ptr p) const
 {
-    // support basic text filtering
-    if (!QSortFilterProxyModel::filterAcceptsRow(source_row, source_parent))
-    {
-        return false;
-    }
-
-    QModelIndex index = sourceModel()->index(source_row, 0, source_parent);
-    Patient::Ptr p = PatientModel::retrievePatient(index);
     if (!p)
     {
         return false;
     }
 
-    const bool filteringByEntity       = !d->settings.entities.isEmpty();
-    const bool filteringByPathology    = !d->settings.pathologyProperties.isEmpty();
-    const bool filteringByPathologyAnd = !d->settings.pathologyPropertiesAnd.isEmpty();
-    const bool filteringByContext      = !d->settings.pathologyContexts.isEmpty();
-    const bool filteringByTrial        = !d->settings.trialParticipation.isEmpty();
-    const bool filteringByDate         = d->settings.resultDateBegin.isValid() ||
-                                           d->settings.resultDateEnd.isValid();
-    const bool filteringByCriteria     = !d->settings.criteria.isEmpty();
+    const bool filteringByEntity       = !entities.isEmpty();
+    const bool filteringByPathology    = !pathologyProperties.isEmpty();
+    const bool filteringByPathologyAnd = !pathologyPropertiesAnd.isEmpty();
+    const bool filteringByContext      = !pathologyContexts.isEmpty();
+    const bool filteringByTrial        = !trialParticipation.isEmpty();
+    const bool filteringByDate         = resultDateBegin.isValid() ||
+                                           resultDateEnd.isValid();
+    const bool filteringByCriteria     = !criteria.isEmpty();
 
     if (!filteringByEntity && !filteringByPathology && !filteringByPathologyAnd && !filteringByContext && !filteringByTrial && !filteringByDate && !filteringByCriteria)
     {
@@ -360,7 +670,7 @@ bool PatientPropertyFilterModel::filterAcceptsRow(int source_row, const QModelIn
 
     if (filteringByContext)
     {
-        if (!d->settings.matchesPathologyContexts(p))
+        if (!matchesPathologyContexts(p))
         {
             return false;
         }
@@ -368,7 +678,7 @@ bool PatientPropertyFilterModel::filterAcceptsRow(int source_row, const QModelIn
 
     if (filteringByTrial)
     {
-        if (!d->settings.matchesTrialParticipation(p))
+        if (!matchesTrialParticipation(p))
         {
             return false;
         }
@@ -376,7 +686,7 @@ bool PatientPropertyFilterModel::filterAcceptsRow(int source_row, const QModelIn
 
     if (filteringByCriteria)
     {
-        if (!d->settings.matchesCriteria(p))
+        if (!matchesCriteria(p))
         {
             return false;
         }
@@ -384,7 +694,7 @@ bool PatientPropertyFilterModel::filterAcceptsRow(int source_row, const QModelIn
 
     if (filteringByDate)
     {
-        if (!d->settings.matchesDates(p))
+        if (!matchesDates(p))
         {
             return false;
         }
@@ -392,7 +702,7 @@ bool PatientPropertyFilterModel::filterAcceptsRow(int source_row, const QModelIn
 
     if (filteringByEntity)
     {
-        if (!d->settings.matchesEntities(p))
+        if (!matchesEntities(p))
         {
             return false;
         }
@@ -400,7 +710,7 @@ bool PatientPropertyFilterModel::filterAcceptsRow(int source_row, const QModelIn
 
     if (filteringByPathology)
     {
-        if (!d->settings.matchesPathologyProperties(p))
+        if (!matchesPathologyProperties(p))
         {
             return false;
         }
@@ -408,7 +718,7 @@ bool PatientPropertyFilterModel::filterAcceptsRow(int source_row, const QModelIn
 
     if (filteringByPathologyAnd)
     {
-        if (!d->settings.matchesPathologyPropertiesAnd(p))
+        if (!matchesPathologyPropertiesAnd(p))
         {
             return false;
         }
@@ -416,3 +726,21 @@ bool PatientPropertyFilterModel::filterAcceptsRow(int source_row, const QModelIn
 
     return true;
 }
+
+bool PatientPropertyFilterModel::filterAcceptsRow(int source_row, const QModelIndex& source_parent) const
+{
+    TRACE_SPAN("PatientPropertyFilterModel::filterAcceptsRow");
+    // support basic text filtering
+    if (!d->searchFilter.acceptsRow(this, source_row, source_parent))
+    {
+        return false;
+    }
+
+    QModelIndex index = sourceModel()->index(source_row, 0, source_parent);
+    Patient::Ptr p = PatientModel::retrievePatient(index);
+    if (!p)
+    {
+        return false;
+    }
+    return d->accepts(p);
+}
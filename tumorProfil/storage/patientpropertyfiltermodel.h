@@ -64,6 +64,9 @@ public:
 
     bool localCenterOnly;
 
+    /// Applies all set filters; unset filters always match
+    bool matches(Patient::Ptr p) const;
+
     bool matchesEntities(Patient::Ptr p) const;
     bool matchesPathologyProperties(Patient::Ptr p) const;
     bool matchesPathologyPropertiesAnd(Patient::Ptr p) const;
@@ -86,6 +89,8 @@ protected:
 
 class PatientPropertyFilterModel : public QSortFilterProxyModel
 {
+    Q_OBJECT
+
 public:
 
     PatientPropertyFilterModel(QObject* parent = 0);
@@ -101,9 +106,20 @@ public:
     void filterByPathologyContext(const QString& property, bool value = true);
     void filterByTrialParticipation(const QString& property, bool value = true);
 
+    virtual void setSourceModel(QAbstractItemModel* sourceModel);
+
 protected:
 
     bool filterAcceptsRow(int source_row, const QModelIndex& source_parent) const;
+    /// Compares precomputed sort keys, which are built once per column and kept until the source data changes
+    bool lessThan(const QModelIndex& source_left, const QModelIndex& source_right) const;
+
+private slots:
+
+    void sourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
+    void sourceRowsInserted(const QModelIndex& parent, int start, int end);
+    void sourceRowsRemoved(const QModelIndex& parent, int start, int end);
+    void invalidateSortKeys();
 
 private:
 
@@ -21,25 +21,90 @@
 
 // Qt includes
 
+#include <QCache>
 #include <QDebug>
 
 // Local includes
 
+#include "combinedvalue.h"
 #include "dataaggregator.h"
 #include "modeldatagenerator.h"
 #include "patientpropertymodel.h"
 #include "pathologypropertyinfo.h"
+#include "patientmanager.h"
+
+namespace
+{
+
+class CachedCell
+{
+public:
+
+    CachedCell(const QVariant& value, uint generation)
+        : value(value), generation(generation)
+    {
+    }
+
+    QVariant value;
+    uint     generation;
+};
+
+// The cache holds one column for all rows, for sorting, and all columns of the visible rows
+enum CacheSize
+{
+    SortKeyRolesPerRow = 2,
+    VisibleRowBudget   = 200,
+    RolesPerCell       = 8
+};
+
+// Only these changes affect the columns computed by DataGenerator
+const int cacheRelevantChanges = PatientManager::ChangedPathologyData
+                               | PatientManager::ChangedDiseaseProperties
+                               | PatientManager::ChangedDiseaseMetadata
+                               | PatientManager::ChangedPatientMetadata;
+
+}
 
 class PatientPropertyModel::PatientPropertyModelPriv
 {
 public:
     PatientPropertyModelPriv()
+        : profile(AllPatientsProfile)
     {
     }
 
     PatientPropertyModel::Profile profile;
     QList<PathologyPropertyInfo>  infos;
 
+    /**
+      Computed cell data. An entry is valid if its generation
+      is the current generation of the patient; invalidating a patient
+      increments its generation, stale entries are dropped when touched or evicted.
+      */
+    mutable QCache<quint64, CachedCell> cache;
+    QHash<int, uint>                    generations;
+
+    static bool cacheKey(int patientId, int column, int role, quint64* key)
+    {
+        if (column > 0xFFFF || role < 0 || role > 0xFFFF)
+        {
+            return false;
+        }
+        *key = (quint64(uint(patientId)) << 32) | (quint64(column) << 16) | quint64(role);
+        return true;
+    }
+
+    void invalidate(int patientId)
+    {
+        ++generations[patientId];
+    }
+
+    void resizeCache(int rowCount, int columnCount)
+    {
+        cache.setMaxCost(qMax(1024, rowCount * SortKeyRolesPerRow
+                                    + VisibleRowBudget * columnCount * RolesPerCell));
+    }
+
     void setInfos()
     {
         infos.clear();
@@ -139,6 +204,7 @@ PatientPropertyModel::PatientPropertyModel(QObject *parent) :
     PatientModel(parent),
     d(new PatientPropertyModelPriv)
 {
+    d->resizeCache(rowCount(), columnCount());
 }
 
 PatientPropertyModel::~PatientPropertyModel()
@@ -155,6 +221,10 @@ void PatientPropertyModel::setProfile(Profile profile)
     beginResetModel();
     d->profile = profile;
     d->setInfos();
+    // combined columns are then served from the per-disease cache, like plain properties
+    CombinedValue::combineAll(PatientManager::instance()->patients(), d->infos);
+    d->cache.clear();
+    d->resizeCache(rowCount(), columnCount());
     endResetModel();
 }
 
@@ -398,19 +468,40 @@ QVariant PatientPropertyModel::data(const QModelIndex& index, int role) const
         return QVariant();
     }
 
+    quint64 key;
+    const bool cacheable = PatientPropertyModelPriv::cacheKey(p->id, index.column(), role, &key);
+    const uint generation = d->generations.value(p->id);
+    if (cacheable)
+    {
+        CachedCell* cell = d->cache.object(key);
+        if (cell && cell->generation == generation)
+        {
+            return cell->value;
+        }
+    }
+
     DataGenerator generator(d->profile, d->infos, p, index.column(), role);
 
+    QVariant value;
     switch (d->profile)
     {
     case AllPatientsProfile:
-        return generator.overviewData();
+        value = generator.overviewData();
+        break;
     case PIK3Profile:
     case PTENLossProfile:
-        return generator.mutationOverviewData();
+        value = generator.mutationOverviewData();
+        break;
     default: // Standard profiles
-        return generator.profileData();
+        value = generator.profileData();
+        break;
     }
-    return QVariant();
+
+    if (cacheable)
+    {
+        d->cache.insert(key, new CachedCell(value, generation));
+    }
+    return value;
 }
 
 QVariant PatientPropertyModel::headerData(int section, Qt::Orientation orientation, int role) const
@@ -476,3 +567,26 @@ QModelIndex PatientPropertyModel::index(int row, int column, const QModelIndex&
 }
 
 
+
+void PatientPropertyModel::patientAdded(int index, const Patient::Ptr& patient)
+{
+    d->resizeCache(rowCount(), columnCount());
+    PatientModel::patientAdded(index, patient);
+}
+
+void PatientPropertyModel::patientDataChanged(const Patient::Ptr& patient, int flags)
+{
+    // invalidate before the base class emits dataChanged, which may synchronously resort
+    if (patient && (flags & cacheRelevantChanges))
+    {
+        d->invalidate(patient->id);
+    }
+    PatientModel::patientDataChanged(patient, flags);
+}
+
+void PatientPropertyModel::patientRemoved(const Patient::Ptr& patient)
+{
+    d->invalidate(patient->id);
+    PatientModel::patientRemoved(patient);
+    d->resizeCache(rowCount(), columnCount());
+}
@@ -65,7 +65,13 @@ public:
 signals:
     
 public slots:
-    
+
+protected:
+
+    virtual void patientAdded(int index, const Patient::Ptr& patient);
+    virtual void patientDataChanged(const Patient::Ptr& patient, int flags);
+    virtual void patientRemoved(const Patient::Ptr& patient);
+
 private:
 
     QVariant overviewData(const Patient::Ptr& p, int field, int role) const;
@@ -0,0 +1,301 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#include "patientsearchindex.h"
+
+// C++ includes
+
+#include <algorithm>
+#include <iterator>
+
+// Qt includes
+
+#include <QSortFilterProxyModel>
+
+// Local includes
+
+#include "patientmodel.h"
+
+static QString searchText(const Patient& p)
+{
+    // separated, so that no trigram spans two fields
+    return (p.surname + '\n' + p.firstName + '\n' + QString::number(p.id)).toCaseFolded();
+}
+
+static inline quint64 trigramKey(const QChar* c)
+{
+    return (quint64(c[0].unicode()) << 32) | (quint64(c[1].unicode()) << 16) | quint64(c[2].unicode());
+}
+
+static QVector<quint64> trigrams(const QString& text)
+{
+    QVector<quint64> keys;
+    const QChar* data = text.constData();
+    for (int i=0; i+3 <= text.size(); i++)
+    {
+        keys << trigramKey(data + i);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+PatientSearchIndex::PatientSearchIndex()
+    : m_revision(0)
+{
+}
+
+void PatientSearchIndex::build(const QList<Patient::Ptr>& patients)
+{
+    m_slotForId.clear();
+    m_texts.clear();
+    m_postings.clear();
+    m_texts.reserve(patients.size());
+    foreach (const Patient::Ptr& p, patients)
+    {
+        add(p);
+    }
+}
+
+void PatientSearchIndex::add(const Patient::Ptr& p)
+{
+    if (!p || m_slotForId.contains(p->id))
+    {
+        update(p);
+        return;
+    }
+    // slots are appended, so posting lists stay sorted
+    const int slot = m_texts.size();
+    m_slotForId.insert(p->id, slot);
+    m_texts << searchText(*p);
+    addTrigrams(slot);
+    m_revision++;
+}
+
+void PatientSearchIndex::update(const Patient::Ptr& p)
+{
+    const int slot = this->slot(p);
+    if (slot == -1)
+    {
+        return;
+    }
+    const QString text = searchText(*p);
+    if (text == m_texts.at(slot))
+    {
+        return;
+    }
+    removeTrigrams(slot);
+    m_texts[slot] = text;
+    addTrigrams(slot);
+    m_revision++;
+}
+
+void PatientSearchIndex::remove(const Patient::Ptr& p)
+{
+    const int slot = this->slot(p);
+    if (slot == -1)
+    {
+        return;
+    }
+    // the slot is not reused
+    removeTrigrams(slot);
+    m_texts[slot].clear();
+    m_slotForId.remove(p->id);
+    m_revision++;
+}
+
+int PatientSearchIndex::slot(const Patient::Ptr& p) const
+{
+    if (!p)
+    {
+        return -1;
+    }
+    return m_slotForId.value(p->id, -1);
+}
+
+int PatientSearchIndex::revision() const
+{
+    return m_revision;
+}
+
+void PatientSearchIndex::addTrigrams(int slot)
+{
+    foreach (quint64 key, trigrams(m_texts.at(slot)))
+    {
+        QVector<int>& list = m_postings[key];
+        list.insert(std::lower_bound(list.begin(), list.end(), slot), slot);
+    }
+}
+
+void PatientSearchIndex::removeTrigrams(int slot)
+{
+    foreach (quint64 key, trigrams(m_texts.at(slot)))
+    {
+        QHash<quint64, QVector<int> >::iterator it = m_postings.find(key);
+        if (it == m_postings.end())
+        {
+            continue;
+        }
+        QVector<int>::iterator pos = std::lower_bound(it->begin(), it->end(), slot);
+        if (pos != it->end() && *pos == slot)
+        {
+            it->erase(pos);
+        }
+        if (it->isEmpty())
+        {
+            m_postings.erase(it);
+        }
+    }
+}
+
+static bool shorterList(const QVector<int>* a, const QVector<int>* b)
+{
+    return a->size() < b->size();
+}
+
+QBitArray PatientSearchIndex::search(const QString& text, const QBitArray& candidates) const
+{
+    const QString folded = text.toCaseFolded();
+    QBitArray result(m_texts.size());
+
+    if (folded.size() < 3)
+    {
+        // too short for trigrams: scan the candidates
+        for (int slot=0; slot<m_texts.size(); slot++)
+        {
+            if ((candidates.isNull() || candidates.testBit(slot)) && m_texts.at(slot).contains(folded))
+            {
+                result.setBit(slot);
+            }
+        }
+        return result;
+    }
+
+    // Intersect the posting lists, beginning with the shortest
+    QList<const QVector<int>*> lists;
+    foreach (quint64 key, trigrams(folded))
+    {
+        QHash<quint64, QVector<int> >::const_iterator it = m_postings.constFind(key);
+        if (it == m_postings.constEnd())
+        {
+            return result;
+        }
+        lists << &it.value();
+    }
+    std::sort(lists.begin(), lists.end(), shorterList);
+
+    QVector<int> hits;
+    if (candidates.isNull())
+    {
+        hits = *lists.first();
+    }
+    else
+    {
+        foreach (int slot, *lists.first())
+        {
+            if (candidates.testBit(slot))
+            {
+                hits << slot;
+            }
+        }
+    }
+    for (int i=1; i<lists.size() && !hits.isEmpty(); i++)
+    {
+        QVector<int> intersection;
+        std::set_intersection(hits.begin(), hits.end(), lists.at(i)->begin(), lists.at(i)->end(),
+                              std::back_inserter(intersection));
+        hits = intersection;
+    }
+
+    // All trigrams occurring does not yet mean the text occurs
+    foreach (int slot, hits)
+    {
+        if (m_texts.at(slot).contains(folded))
+        {
+            result.setBit(slot);
+        }
+    }
+    return result;
+}
+
+PatientSearchFilter::PatientSearchFilter()
+    : m_revision(-1),
+      m_index(0)
+{
+}
+
+static bool acceptsRowByRegExp(const QSortFilterProxyModel* proxy, int source_row, const QModelIndex& source_parent)
+{
+    // as QSortFilterProxyModel::filterAcceptsRow
+    const QRegExp regExp = proxy->filterRegExp();
+    if (regExp.isEmpty())
+    {
+        return true;
+    }
+    QAbstractItemModel* const model = proxy->sourceModel();
+    if (proxy->filterKeyColumn() != -1)
+    {
+        QModelIndex index = model->index(source_row, proxy->filterKeyColumn(), source_parent);
+        return index.data(proxy->filterRole()).toString().contains(regExp);
+    }
+    for (int column=0; column<model->columnCount(source_parent); column++)
+    {
+        QModelIndex index = model->index(source_row, column, source_parent);
+        if (index.data(proxy->filterRole()).toString().contains(regExp))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PatientSearchFilter::acceptsRow(const QSortFilterProxyModel* proxy, int source_row, const QModelIndex& source_parent)
+{
+    const QRegExp regExp = proxy->filterRegExp();
+    const QString text   = regExp.pattern();
+    if (text.isEmpty())
+    {
+        return true;
+    }
+
+    const PatientModel* model = qobject_cast<const PatientModel*>(proxy->sourceModel());
+    if (!model || regExp.patternSyntax() != QRegExp::FixedString
+        || regExp.caseSensitivity() != Qt::CaseInsensitive)
+    {
+        return acceptsRowByRegExp(proxy, source_row, source_parent);
+    }
+
+    const PatientSearchIndex* index = model->searchIndex();
+    if (text != m_text || index != m_index || index->revision() != m_revision)
+    {
+        // Typing on refines the previous result
+        const bool refines = index == m_index && index->revision() == m_revision
+                && !m_text.isEmpty() && text.contains(m_text, Qt::CaseInsensitive);
+        m_result   = index->search(text, refines ? m_result : QBitArray());
+        m_text     = text;
+        m_index    = index;
+        m_revision = index->revision();
+    }
+
+    const int slot = index->slot(PatientModel::retrievePatient(model->index(source_row, 0, source_parent)));
+    return slot != -1 && slot < m_result.size() && m_result.testBit(slot);
+}
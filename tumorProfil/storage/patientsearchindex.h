@@ -0,0 +1,100 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#ifndef PATIENTSEARCHINDEX_H
+#define PATIENTSEARCHINDEX_H
+
+// Qt includes
+
+#include <QBitArray>
+#include <QHash>
+#include <QVector>
+
+// Local includes
+
+#include "patient.h"
+
+class QModelIndex;
+class QSortFilterProxyModel;
+
+/**
+  A trigram index over the searchable text of patients: surname, first name and id.
+  Maintained by PatientModel.
+
+  Each patient has a slot (bit position in search results) which is stable until it is removed.
+  */
+class PatientSearchIndex
+{
+public:
+
+    PatientSearchIndex();
+
+    void build(const QList<Patient::Ptr>& patients);
+    void add(const Patient::Ptr& p);
+    void update(const Patient::Ptr& p);
+    void remove(const Patient::Ptr& p);
+
+    /// Returns the slot of p, or -1
+    int slot(const Patient::Ptr& p) const;
+    /// Changes with every modification of the index
+    int revision() const;
+
+    /**
+      Returns, by slot, the patients whose surname, first name or id contains text, ignoring case.
+      If candidates is not null, only these slots are checked.
+      */
+    QBitArray search(const QString& text, const QBitArray& candidates = QBitArray()) const;
+
+private:
+
+    void addTrigrams(int slot);
+    void removeTrigrams(int slot);
+
+    QHash<int, int>             m_slotForId;
+    QVector<QString>            m_texts;
+    QHash<quint64, QVector<int> > m_postings;
+    int                         m_revision;
+};
+
+/**
+  Replaces the filtering by fixed string of a QSortFilterProxyModel on top of a PatientModel
+  with a lookup in the PatientModel's search index.
+  When the text is typed on, the previous result is refined.
+  Use from the proxy's filterAcceptsRow instead of QSortFilterProxyModel::filterAcceptsRow.
+  */
+class PatientSearchFilter
+{
+public:
+
+    PatientSearchFilter();
+
+    bool acceptsRow(const QSortFilterProxyModel* proxy, int source_row, const QModelIndex& source_parent);
+
+private:
+
+    QString   m_text;
+    QBitArray m_result;
+    int       m_revision;
+    const PatientSearchIndex* m_index;
+};
+
+#endif // PATIENTSEARCHINDEX_H
@@ -0,0 +1,325 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#include "patientwritequeue.h"
+
+// Qt includes
+
+#include <QDebug>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <QWaitCondition>
+
+// Local includes
+
+#include "databaseaccess.h"
+#include "databaseconstants.h"
+#include "databasecorebackend.h"
+#include "databaseoperationgroup.h"
+#include "patientblindindex.h"
+#include "patientdb.h"
+#include "patientmanager.h"
+#include "tracing.h"
+
+PatientWriteSnapshot::PatientWriteSnapshot(const Patient& p, int flags)
+    : patient(p),
+      flags(flags),
+      blindIndexComplete(true)
+{
+    if (flags & PatientManager::ChangedPatientMetadata)
+    {
+        encryptedPatient = p;
+        encryptedPatient.encrypt();
+        blindIndex         = PatientBlindIndex::columnValues(p);
+        blindIndexComplete = PatientBlindIndex::isComplete(p, blindIndex);
+    }
+
+    // The copy constructor copies only the metadata
+    patient.patientProperties = p.patientProperties;
+    patient.diseases          = p.diseases;
+    for (int i=0; i<patient.diseases.size(); ++i)
+    {
+        Disease& disease = patient.diseases[i];
+        events << ((flags & PatientManager::ChangedDiseaseHistory) ? disease.history.toEvents() : QList<Event>());
+        disease.history = DiseaseHistory();
+    }
+}
+
+void PatientWriteSnapshot::write() const
+{
+    TRACE_SPAN("PatientWriteSnapshot::write");
+    if (flags & PatientManager::ChangedPatientMetadata)
+    {
+        DatabaseAccess().db()->updateEncryptedPatient(encryptedPatient, blindIndex, blindIndexComplete);
+    }
+
+    if (flags & PatientManager::ChangedPatientProperties)
+    {
+        DatabaseAccess().db()->removeProperties(PatientDB::PatientProperties, patient.id);
+        DatabaseAccess().db()->addProperties(PatientDB::PatientProperties, patient.id, patient.patientProperties);
+    }
+
+    for (int i=0; i<patient.diseases.size(); ++i)
+    {
+        const Disease& disease = patient.diseases[i];
+        if (!disease.id)
+        {
+            qWarning() << "Disease without id in patient snapshot" << patient.id;
+            continue;
+        }
+
+        if (flags & PatientManager::ChangedDiseaseMetadata)
+        {
+            DatabaseAccess().db()->updateDisease(disease);
+        }
+
+        if (flags & PatientManager::ChangedDiseaseProperties)
+        {
+            DatabaseAccess().db()->removeProperties(PatientDB::DiseaseProperties, disease.id);
+            DatabaseAccess().db()->addProperties(PatientDB::DiseaseProperties, disease.id, disease.diseaseProperties);
+        }
+
+        if (flags & PatientManager::ChangedDiseaseHistory)
+        {
+            DatabaseAccess().db()->replaceEvents(disease.id, events[i]);
+        }
+
+        if (flags & PatientManager::ChangedPathologyData)
+        {
+            foreach (const Pathology& pathology, disease.pathologies)
+            {
+                DatabaseAccess().db()->updatePathology(pathology);
+                DatabaseAccess().db()->removeProperties(PatientDB::PathologyProperties, pathology.id);
+                QList<Property> properties = pathology.properties;
+                foreach (const QString& text, pathology.reports)
+                {
+                    properties << Property(PathologyPropertyName::pathologyReportId(), text);
+                }
+                DatabaseAccess().db()->addProperties(PatientDB::PathologyProperties, pathology.id, properties);
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------
+
+// Bounds of one transaction of the write queue, and attempts to commit it
+static const int maxTransactionTime       = 1000;
+static const int maxTransactionStatements = 5000;
+static const int maxAttempts              = 3;
+
+class PatientWriteQueue::PatientWriteQueuePriv
+{
+public:
+
+    PatientWriteQueuePriv()
+        : running(true),
+          writing(false)
+    {
+    }
+
+    mutable QMutex                   mutex;
+    // signalled when changes are enqueued or the thread shall stop
+    QWaitCondition                   workCondVar;
+    // signalled when all changes are written
+    QWaitCondition                   idleCondVar;
+    // patient ids in the order of their first change since the last write
+    QList<int>                       order;
+    QHash<int, PatientWriteSnapshotPtr> pending;
+    bool                             running;
+    bool                             writing;
+};
+
+PatientWriteQueue::PatientWriteQueue(QObject* parent)
+    : QThread(parent),
+      d(new PatientWriteQueuePriv)
+{
+}
+
+PatientWriteQueue::~PatientWriteQueue()
+{
+    {
+        QMutexLocker lock(&d->mutex);
+        d->running = false;
+        d->workCondVar.wakeAll();
+    }
+    // run() returns when everything is written
+    wait();
+    delete d;
+}
+
+void PatientWriteQueue::enqueue(const Patient& patient, int flags)
+{
+    if (!patient.id || !flags)
+    {
+        return;
+    }
+
+    // Taking the snapshot is cheap, the lists are implicitly shared
+    PatientWriteSnapshotPtr snapshot(new PatientWriteSnapshot(patient, flags));
+
+    QMutexLocker lock(&d->mutex);
+    QHash<int, PatientWriteSnapshotPtr>::iterator it = d->pending.find(patient.id);
+    if (it == d->pending.end())
+    {
+        d->order << patient.id;
+        d->pending.insert(patient.id, snapshot);
+    }
+    else
+    {
+        // The new snapshot has the current state of all parts. It must also take the parts
+        // changed by the pending snapshot: the events, and the encrypted metadata.
+        const int pendingFlags = (*it)->flags;
+        if ((pendingFlags | flags) != flags)
+        {
+            snapshot = PatientWriteSnapshotPtr(new PatientWriteSnapshot(patient, flags | pendingFlags));
+        }
+        *it = snapshot;
+    }
+
+    if (!isRunning())
+    {
+        start();
+    }
+    d->workCondVar.wakeAll();
+}
+
+void PatientWriteQueue::flush()
+{
+    TRACE_SPAN("PatientWriteQueue::flush");
+    QMutexLocker lock(&d->mutex);
+    while (!d->pending.isEmpty() || d->writing)
+    {
+        d->idleCondVar.wait(&d->mutex);
+    }
+}
+
+bool PatientWriteQueue::isIdle() const
+{
+    QMutexLocker lock(&d->mutex);
+    return d->pending.isEmpty() && !d->writing;
+}
+
+void PatientWriteQueue::writeBatch(const QList<PatientWriteSnapshotPtr>& batch)
+{
+    // Group commit: many patients share one transaction, which is committed after
+    // maxTransactionTime or maxTransactionStatements. If a statement fails, the transaction
+    // is rolled back, the patient is reported as failed, and the other patients since the
+    // last commit are written again. If a commit fails, it was rolled back and the patients
+    // are written again as well. The writes are idempotent.
+    DatabaseOperationGroup group(DatabaseOperationGroup::AllBackends);
+    group.setMaximumTime(maxTransactionTime);
+    group.setMaximumStatements(maxTransactionStatements);
+
+    QVector<bool> failed(batch.size(), false);
+    int begin    = 0;
+    int attempts = 0;
+    int i        = 0;
+    while (i < batch.size())
+    {
+        if (!failed[i])
+        {
+            const int failuresBefore = DatabaseAccess().backend()->failedStatementCount();
+            batch[i]->write();
+            if (DatabaseAccess().backend()->failedStatementCount() != failuresBefore)
+            {
+                const PatientWriteSnapshot& snapshot = *batch[i];
+                const QString error                  = DatabaseAccess().backend()->lastError();
+                group.rollback();
+                failed[i] = true;
+                qWarning() << "Failed to store changes of patient" << snapshot.patient.id;
+                emit patientStoreFailed(snapshot.patient.id, snapshot.flags, error);
+                i = begin;
+                continue;
+            }
+        }
+        i++;
+
+        const bool lifted = group.allowLift();
+        if (!lifted && i < batch.size())
+        {
+            continue;
+        }
+
+        // lift() commits and begins the next transaction
+        const bool committed = lifted ? group.lastCommitSucceeded() : group.lift();
+        if (!committed && ++attempts < maxAttempts)
+        {
+            qWarning() << "Commit of" << i - begin << "patients failed, writing them again";
+            i = begin;
+            continue;
+        }
+
+        for (int k=begin; k<i; k++)
+        {
+            const PatientWriteSnapshot& snapshot = *batch[k];
+            if (failed[k])
+            {
+                // already reported
+                continue;
+            }
+            if (committed)
+            {
+                emit patientStored(snapshot.patient.id, snapshot.flags);
+            }
+            else
+            {
+                qWarning() << "Failed to store changes of patient" << snapshot.patient.id;
+                emit patientStoreFailed(snapshot.patient.id, snapshot.flags, DatabaseAccess().backend()->lastError());
+            }
+        }
+        begin    = i;
+        attempts = 0;
+    }
+}
+
+void PatientWriteQueue::run()
+{
+    forever
+    {
+        QList<PatientWriteSnapshotPtr> batch;
+        {
+            QMutexLocker lock(&d->mutex);
+            d->writing = false;
+            while (d->pending.isEmpty())
+            {
+                d->idleCondVar.wakeAll();
+                if (!d->running)
+                {
+                    return;
+                }
+                d->workCondVar.wait(&d->mutex);
+            }
+            foreach (int id, d->order)
+            {
+                batch << d->pending.take(id);
+            }
+            d->order.clear();
+            d->writing = true;
+        }
+
+        TRACE_SPAN("PatientWriteQueue::writeBatch");
+        writeBatch(batch);
+    }
+}
@@ -0,0 +1,111 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#ifndef PATIENTWRITEQUEUE_H
+#define PATIENTWRITEQUEUE_H
+
+// Qt includes
+
+#include <QList>
+#include <QSharedPointer>
+#include <QThread>
+
+// Local includes
+
+#include "event.h"
+#include "patient.h"
+
+/**
+  The data of a patient to be written, taken in the UI thread.
+  The disease histories are converted to events, the HistoryElements are not shared between threads.
+  The patient metadata is encrypted when the snapshot is taken, with the keys of the user
+  logged in at this time; the writer thread does not access UserInformation.
+  Not copyable: Patient's copy constructor copies only the metadata, use PatientWriteSnapshotPtr.
+  */
+class PatientWriteSnapshot
+{
+public:
+
+    PatientWriteSnapshot(const Patient& patient, int flags);
+
+    /// Writes the parts of the patient given by flags. All diseases and pathologies must have an id.
+    void write() const;
+
+    Patient              patient;
+    QList<QList<Event> > events;
+    int                  flags;
+    // for ChangedPatientMetadata
+    Patient              encryptedPatient;
+    QVariantList         blindIndex;
+    bool                 blindIndexComplete;
+
+private:
+
+    Q_DISABLE_COPY(PatientWriteSnapshot)
+};
+
+typedef QSharedPointer<PatientWriteSnapshot> PatientWriteSnapshotPtr;
+
+/**
+  Writes patient data on a worker thread.
+
+  enqueue() takes a snapshot and returns at once. Changes of the same patient
+  waiting to be written are coalesced: the latest snapshot is written, with all
+  change flags given since the last write. The waiting patients are written with group commit,
+  see DatabaseOperationGroup::AllBackends.
+  */
+class PatientWriteQueue : public QThread
+{
+    Q_OBJECT
+
+public:
+
+    explicit PatientWriteQueue(QObject* parent = 0);
+    /// Writes all pending changes, then stops the thread
+    ~PatientWriteQueue();
+
+    /// Call from the UI thread. New diseases and pathologies must already have an id.
+    void enqueue(const Patient& patient, int flags);
+    /// Blocks until all changes enqueued so far are written
+    void flush();
+    bool isIdle() const;
+
+signals:
+
+    void patientStored(int patientId, int flags);
+    void patientStoreFailed(int patientId, int flags, const QString& error);
+
+protected:
+
+    virtual void run();
+
+private:
+
+    void writeBatch(const QList<PatientWriteSnapshotPtr>& batch);
+
+private:
+
+    class PatientWriteQueuePriv;
+    PatientWriteQueuePriv* const d;
+};
+
+#endif // PATIENTWRITEQUEUE_H
@@ -29,6 +29,7 @@
 #include <QFileInfo>
 #include <QFile>
 #include <QDir>
+#include <QRegExp>
 
 // Local includes
 
@@ -40,7 +41,7 @@
 
 int SchemaUpdater::schemaVersion()
 {
-    return 1;
+    return 3;
 }
 
 SchemaUpdater::SchemaUpdater(DatabaseAccess* access)
@@ -50,17 +51,15 @@ SchemaUpdater::SchemaUpdater(DatabaseAccess* access)
     m_currentRequiredVersion = 0;
     m_observer       = 0;
     m_setError       = false;
+    m_deferIndices   = false;
 }
 
 bool SchemaUpdater::update()
 {
     bool success = startUpdates();
 
-    // even on failure, try to set current version - it may have incremented
-
-    if(!success){
-        deleteTables();
-    }
+    // even on failure, try to set current version - it may have incremented.
+    // Tables are only deleted when creating a new database failed, never for an existing database.
     if (m_currentVersion)
     {
         m_access->db()->setSetting("DBVersion", QString::number(m_currentVersion));
@@ -80,6 +79,16 @@ bool SchemaUpdater::update()
     {
         m_access->db()->setSetting(DB_ABOUT_TO_BE_ENCRYPTED, QString::number(0));
     }
+
+    if(m_access->db()->setting(DB_BLIND_INDEX_COMPLETE).isEmpty())
+    {
+        m_access->db()->setSetting(DB_BLIND_INDEX_COMPLETE, QString::number(0));
+    }
+
+    if (success && !m_deferIndices)
+    {
+        m_access->db()->checkQueryPlans();
+    }
     return success;
 }
 
@@ -88,6 +97,22 @@ void SchemaUpdater::setObserver(InitializationObserver* observer)
     m_observer = observer;
 }
 
+void SchemaUpdater::setDeferIndices(bool defer)
+{
+    m_deferIndices = defer;
+}
+
+bool SchemaUpdater::createDeferredIndices()
+{
+    if (!createIndices() || !createTriggers())
+    {
+        qWarning() << "Failed to create indices and triggers" << m_access->backend()->lastError();
+        return false;
+    }
+    m_access->db()->checkQueryPlans();
+    return true;
+}
+
 void SchemaUpdater::deleteTables()
 {
     m_access->backend()->execDBAction(m_access->backend()->getDBAction(QString("DeleteDB")));
@@ -200,7 +225,17 @@ bool SchemaUpdater::makeUpdates()
     {
         if (m_currentVersion == 1)
         {
-            updateV1ToV2();
+            if (!updateV1ToV2())
+            {
+                return false;
+            }
+        }
+        if (m_currentVersion == 2)
+        {
+            if (!updateV2ToV3())
+            {
+                return false;
+            }
         }
     }
 
@@ -211,8 +246,7 @@ bool SchemaUpdater::makeUpdates()
 bool SchemaUpdater::createDatabase()
 {
     if ( createTables()
-         && createIndices()
-         && createTriggers())
+         && (m_deferIndices || (createIndices() && createTriggers())) )
     {
         m_currentVersion = schemaVersion();
         m_currentRequiredVersion = 1;
@@ -241,14 +275,97 @@ bool SchemaUpdater::createTriggers()
 
 bool SchemaUpdater::updateV1ToV2()
 {
-    /*if (!m_access->backend()->execDBAction(m_access->backend()->getDBAction("UpdateDBSchemaFromV1ToV2")))
+    // Blind index columns. They are filled by PatientManager when a user with keys reads the database.
+    if (!addColumnIfMissing("Patients", "surnameBlind", "VARCHAR(32)")
+        || !addColumnIfMissing("Patients", "firstNameBlind", "VARCHAR(32)")
+        || !addColumnIfMissing("Patients", "dateOfBirthBlind", "VARCHAR(32)")
+        || !addColumnIfMissing("Patients", "surnamePrefixBlind", "VARCHAR(32)")
+        || !createIndexIfMissing("blindNameIndex", "Patients", "surnameBlind, firstNameBlind")
+        || !createIndexIfMissing("blindDateOfBirthIndex", "Patients", "dateOfBirthBlind")
+        || !createIndexIfMissing("blindSurnamePrefixIndex", "Patients", "surnamePrefixBlind"))
     {
-        qError() << "Schema upgrade in DB from V1 to V2 failed!";
+        updateFailed(QObject::tr("Schema upgrade in DB from V1 to V2 failed!"));
         return false;
-    }*/
+    }
+    m_access->db()->setSetting(DB_BLIND_INDEX_COMPLETE, QString::number(0));
 
     m_currentVersion = 2;
     m_currentRequiredVersion = 1;
     return true;
 }
 
+bool SchemaUpdater::updateV2ToV3()
+{
+    // Indices on the foreign keys, used by loading and by the delete triggers
+    if (!createIndexIfMissing("patientPropertiesIndex", "PatientProperties", "patientid, property(40)")
+        || !createIndexIfMissing("diseasePropertiesIndex", "DiseaseProperties", "diseaseid, property(40)")
+        || !createIndexIfMissing("pathologyPropertiesIdIndex", "PathologyProperties", "pathologyid, property(40)")
+        || !createIndexIfMissing("diseasesPatientIndex", "Diseases", "patientid")
+        || !createIndexIfMissing("pathologiesDiseaseIndex", "Pathologies", "diseaseid")
+        || !createIndexIfMissing("eventsDiseaseIndex", "Events", "diseaseid, id")
+        || !createIndexIfMissing("eventInfosEventIndex", "EventInfos", "eventid, id"))
+    {
+        updateFailed(QObject::tr("Schema upgrade in DB from V2 to V3 failed!"));
+        return false;
+    }
+
+    m_currentVersion = 3;
+    m_currentRequiredVersion = 1;
+    return true;
+}
+
+bool SchemaUpdater::addColumnIfMissing(const QString& table, const QString& column, const QString& type)
+{
+    if (m_access->backend()->columns(table).contains(column, Qt::CaseInsensitive))
+    {
+        return true;
+    }
+    return m_access->backend()->execSql(QString("ALTER TABLE %1 ADD COLUMN %2 %3;").arg(table, column, type));
+}
+
+bool SchemaUpdater::hasIndex(const QString& table, const QString& index)
+{
+    QList<QVariant> values;
+    if (m_access->parameters().isSQLite())
+    {
+        m_access->backend()->execSql("SELECT name FROM sqlite_master WHERE type='index' AND tbl_name=? AND name=?;",
+                                     QList<QVariant>() << table << index, &values);
+    }
+    else
+    {
+        m_access->backend()->execSql(QString("SHOW INDEX FROM %1 WHERE Key_name=?;").arg(table),
+                                     QList<QVariant>() << index, &values);
+    }
+    return !values.isEmpty();
+}
+
+bool SchemaUpdater::createIndexIfMissing(const QString& index, const QString& table, const QString& columns)
+{
+    if (!m_access->backend()->tables().contains(table, Qt::CaseInsensitive))
+    {
+        // older databases may lack some tables; they are not used there
+        return true;
+    }
+    if (hasIndex(table, index))
+    {
+        return true;
+    }
+    QString columnList = columns;
+    if (m_access->parameters().isSQLite())
+    {
+        // SQLite does not know index prefix lengths
+        columnList.remove(QRegExp("\\(\\d+\\)"));
+    }
+    return m_access->backend()->execSql(QString("CREATE INDEX %1 ON %2 (%3);").arg(index, table, columnList));
+}
+
+void SchemaUpdater::updateFailed(const QString& errorMsg)
+{
+    qWarning() << errorMsg << m_access->backend()->lastError();
+    m_access->setLastError(errorMsg + "\n" + m_access->backend()->lastError());
+    if (m_observer)
+    {
+        m_observer->error(errorMsg);
+        m_observer->finishedSchemaUpdate(InitializationObserver::UpdateErrorMustAbort);
+    }
+}
@@ -41,6 +41,13 @@ public:
     bool update();
     void setObserver(InitializationObserver* observer);
 
+    /**
+      When creating a new database, create only the tables.
+      For bulk loading, the indices and triggers are then created by createDeferredIndices.
+      */
+    void setDeferIndices(bool defer);
+    bool createDeferredIndices();
+
 private:
 
     /**
@@ -55,10 +62,22 @@ private:
     bool createIndices();
     bool createTriggers();
     bool updateV1ToV2();
+    bool updateV2ToV3();
+
+    /**
+     * Schema updates may have been applied partially before (MySQL DDL is not transactional),
+     * so each step checks if it is already done.
+     * Index columns are given in MySQL syntax, prefix lengths are removed for SQLite.
+     */
+    bool addColumnIfMissing(const QString& table, const QString& column, const QString& type);
+    bool createIndexIfMissing(const QString& index, const QString& table, const QString& columns);
+    bool hasIndex(const QString& table, const QString& index);
+    void updateFailed(const QString& errorMsg);
 
 private:
 
     bool                    m_setError;
+    bool                    m_deferIndices;
 
     int                     m_currentVersion;
     int                     m_currentRequiredVersion;
@@ -0,0 +1,565 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#include "securityjournal.h"
+
+// C++ includes
+
+#include <algorithm>
+#include <cstring>
+
+// Qt includes
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QtConcurrent/QtConcurrent>
+#include <QVector>
+#include <QWaitCondition>
+
+// Local includes
+
+#include "databaseaccess.h"
+#include "databaseparameters.h"
+#include "tracing.h"
+
+static const char chunkMagic[] = "TPJC";
+
+static QVector<quint32> crc32Table()
+{
+    QVector<quint32> table(256);
+    for (quint32 i=0; i<256; i++)
+    {
+        quint32 c = i;
+        for (int k=0; k<8; k++)
+        {
+            c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+static quint32 crc32(const QByteArray& data, quint32 crc = 0)
+{
+    static const QVector<quint32> table = crc32Table();
+
+    crc = ~crc;
+    const uchar* p = reinterpret_cast<const uchar*>(data.constData());
+    for (int i=0; i<data.size(); i++)
+    {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+SecurityJournalEntry::SecurityJournalEntry()
+    : patientId(0)
+{
+}
+
+bool SecurityJournalEntry::isNull() const
+{
+    return time.isNull();
+}
+
+QString SecurityJournalEntry::fileName() const
+{
+    QString fileName = surname + '-' + firstName + '-' + dateOfBirth.toString(Qt::ISODate)
+            + '-' + type + '-' + time.toString(Qt::ISODate);
+    fileName.remove(":");
+    return fileName;
+}
+
+static QDataStream& operator<<(QDataStream& out, const SecurityJournalEntry& entry)
+{
+    out << qint32(entry.patientId) << entry.time.toMSecsSinceEpoch() << entry.type
+        << entry.surname << entry.firstName << entry.dateOfBirth << entry.value;
+    return out;
+}
+
+static QDataStream& operator>>(QDataStream& in, SecurityJournalEntry& entry)
+{
+    qint32 id;
+    qint64 msecs;
+    in >> id >> msecs >> entry.type >> entry.surname >> entry.firstName >> entry.dateOfBirth >> entry.value;
+    entry.patientId = id;
+    entry.time      = QDateTime::fromMSecsSinceEpoch(msecs);
+    return in;
+}
+
+namespace
+{
+
+class ChunkInfo
+{
+public:
+
+    ChunkInfo()
+        : headerOffset(0), headerSize(0), dataOffset(0), dataSize(0), crc(0),
+          firstTime(0), lastTime(0)
+    {
+    }
+
+    bool overlaps(const QDateTime& from, const QDateTime& to) const
+    {
+        return (from.isNull() || lastTime >= from.toMSecsSinceEpoch())
+                && (to.isNull() || firstTime <= to.toMSecsSinceEpoch());
+    }
+
+    qint64          headerOffset;
+    quint32         headerSize;
+    qint64          dataOffset;
+    quint32         dataSize;
+    quint32         crc;
+    qint64          firstTime;
+    qint64          lastTime;
+    QVector<qint32> patientIds;
+};
+
+/**
+  Reads the chunk headers from the chunk beginning at start, skipping the compressed data.
+  validEnd is set to the end of the last complete chunk.
+  If damaged is given, it is set to true if reading stopped at an invalid chunk,
+  not at a torn chunk whose declared size runs past the end of the file.
+  */
+QList<ChunkInfo> readIndex(QFile& file, qint64* validEnd, qint64 start = 0, bool* damaged = 0)
+{
+    QList<ChunkInfo> chunks;
+    const qint64 size = file.size();
+    *validEnd = start;
+    if (damaged)
+    {
+        *damaged = false;
+    }
+    file.seek(start);
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    while (file.pos() + 12 <= size)
+    {
+        char magic[4];
+        if (stream.readRawData(magic, 4) != 4 || memcmp(magic, chunkMagic, 4) != 0)
+        {
+            if (damaged)
+            {
+                *damaged = true;
+            }
+            break;
+        }
+        ChunkInfo chunk;
+        stream >> chunk.headerSize;
+        chunk.headerOffset = file.pos();
+        if (chunk.headerOffset + chunk.headerSize + 4 > size)
+        {
+            break;
+        }
+        const QByteArray header = file.read(chunk.headerSize);
+        stream >> chunk.dataSize;
+        chunk.dataOffset = file.pos();
+        if (chunk.dataOffset + chunk.dataSize + 4 > size)
+        {
+            break;
+        }
+        file.seek(chunk.dataOffset + chunk.dataSize);
+        stream >> chunk.crc;
+
+        QDataStream headerStream(header);
+        headerStream.setVersion(QDataStream::Qt_5_0);
+        headerStream >> chunk.firstTime >> chunk.lastTime >> chunk.patientIds;
+        if (stream.status() != QDataStream::Ok || headerStream.status() != QDataStream::Ok)
+        {
+            if (damaged)
+            {
+                *damaged = true;
+            }
+            break;
+        }
+        chunks << chunk;
+        *validEnd = file.pos();
+    }
+    return chunks;
+}
+
+bool readChunk(QFile& file, const ChunkInfo& chunk, QList<SecurityJournalEntry>& entries)
+{
+    file.seek(chunk.headerOffset);
+    const QByteArray header = file.read(chunk.headerSize);
+    file.seek(chunk.dataOffset);
+    const QByteArray data = file.read(chunk.dataSize);
+    if (crc32(data, crc32(header)) != chunk.crc)
+    {
+        qWarning() << "Security journal" << file.fileName() << ": damaged chunk at" << chunk.headerOffset;
+        return false;
+    }
+
+    QDataStream stream(qUncompress(data));
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 count;
+    stream >> count;
+    for (quint32 i=0; i<count && stream.status() == QDataStream::Ok; i++)
+    {
+        SecurityJournalEntry entry;
+        stream >> entry;
+        entries << entry;
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+}
+
+class SecurityJournal::SecurityJournalPriv
+{
+public:
+
+    SecurityJournalPriv()
+        : writing(false),
+          validatedEnd(0)
+    {
+    }
+
+    /**
+      Opens the file and positions it at the end of the last complete chunk.
+      Other programs may append to the same file, so this must be called holding the lock file.
+      The chunks appended since the last call are validated; a torn chunk at the end,
+      left by a crash while writing, is cut off. A journal damaged otherwise is never cut off,
+      it is renamed and a new journal is started.
+      */
+    bool openForAppend()
+    {
+        // another program may have started a new journal
+        if (file.isOpen() && QFileInfo(filePath).size() != file.size())
+        {
+            file.close();
+        }
+        if (!file.isOpen())
+        {
+            QDir().mkpath(QFileInfo(filePath).absolutePath());
+            file.setFileName(filePath);
+            if (!file.open(QIODevice::ReadWrite | QIODevice::Unbuffered))
+            {
+                qWarning() << "Failed to open security journal" << filePath << file.errorString();
+                return false;
+            }
+            validatedEnd = 0;
+        }
+        if (file.size() < validatedEnd)
+        {
+            // replaced by another program
+            validatedEnd = 0;
+        }
+        qint64 validEnd;
+        bool   damaged;
+        readIndex(file, &validEnd, validatedEnd, &damaged);
+        if (damaged)
+        {
+            // valid chunks may follow the damaged one, keep the file
+            const QString damagedPath = filePath + ".damaged-"
+                                        + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss");
+            qWarning() << "Security journal" << filePath << "is damaged at offset" << validEnd
+                       << ", keeping it as" << damagedPath << "and starting a new journal";
+            file.close();
+            if (!QFile::rename(filePath, damagedPath))
+            {
+                qWarning() << "Failed to rename the damaged security journal" << filePath;
+                return false;
+            }
+            return openForAppend();
+        }
+        if (validEnd < file.size())
+        {
+            qWarning() << "Security journal" << filePath << "has an incomplete chunk at the end, removing"
+                       << file.size() - validEnd << "bytes";
+            if (!file.resize(validEnd))
+            {
+                qWarning() << "Failed to truncate security journal" << filePath << file.errorString();
+                file.close();
+                return false;
+            }
+        }
+        validatedEnd = validEnd;
+        return file.seek(validEnd);
+    }
+
+    bool writeChunk(const QList<SecurityJournalEntry>& entries)
+    {
+        TRACE_SPAN("SecurityJournal::writeChunk");
+        QDir().mkpath(QFileInfo(filePath).absolutePath());
+        QLockFile lock(filePath + ".lock");
+        if (!lock.tryLock(lockTimeout))
+        {
+            qWarning() << "Failed to lock security journal" << filePath << lock.error();
+            return false;
+        }
+        if (!openForAppend())
+        {
+            return false;
+        }
+
+        QByteArray uncompressed;
+        {
+            QDataStream stream(&uncompressed, QIODevice::WriteOnly);
+            stream.setVersion(QDataStream::Qt_5_0);
+            stream << quint32(entries.size());
+            foreach (const SecurityJournalEntry& entry, entries)
+            {
+                stream << entry;
+            }
+        }
+        const QByteArray data = qCompress(uncompressed);
+
+        qint64 firstTime = entries.first().time.toMSecsSinceEpoch();
+        qint64 lastTime  = firstTime;
+        QSet<qint32> ids;
+        foreach (const SecurityJournalEntry& entry, entries)
+        {
+            firstTime = qMin(firstTime, entry.time.toMSecsSinceEpoch());
+            lastTime  = qMax(lastTime, entry.time.toMSecsSinceEpoch());
+            ids << entry.patientId;
+        }
+        QVector<qint32> patientIds = ids.toList().toVector();
+        std::sort(patientIds.begin(), patientIds.end());
+
+        QByteArray header;
+        {
+            QDataStream stream(&header, QIODevice::WriteOnly);
+            stream.setVersion(QDataStream::Qt_5_0);
+            stream << firstTime << lastTime << patientIds;
+        }
+
+        // one write call per chunk
+        QByteArray chunk;
+        {
+            QDataStream stream(&chunk, QIODevice::WriteOnly);
+            stream.setVersion(QDataStream::Qt_5_0);
+            stream.writeRawData(chunkMagic, 4);
+            stream << quint32(header.size());
+            stream.writeRawData(header.constData(), header.size());
+            stream << quint32(data.size());
+            stream.writeRawData(data.constData(), data.size());
+            stream << crc32(data, crc32(header));
+        }
+        if (file.write(chunk) != chunk.size() || !file.flush())
+        {
+            qWarning() << "Failed to write security journal" << filePath << file.errorString();
+            // the torn chunk is removed when reopening
+            file.close();
+            return false;
+        }
+        validatedEnd = file.pos();
+        return true;
+    }
+
+    static const int            lockTimeout = 10000;
+
+    QString                     filePath;
+    // used by the writing thread only
+    QFile                       file;
+    qint64                      validatedEnd;
+
+    QMutex                      mutex;
+    QWaitCondition              idleCondVar;
+    QList<SecurityJournalEntry> pending;
+    bool                        writing;
+};
+
+SecurityJournal::SecurityJournal(const QString& filePath)
+    : d(new SecurityJournalPriv)
+{
+    d->filePath = filePath;
+}
+
+SecurityJournal::~SecurityJournal()
+{
+    if (!flush())
+    {
+        qWarning() << "Security journal" << d->filePath << ":" << d->pending.size() << "entries could not be written";
+    }
+    delete d;
+}
+
+QString SecurityJournal::filePath() const
+{
+    return d->filePath;
+}
+
+QString SecurityJournal::defaultFilePath()
+{
+    DatabaseParameters params = DatabaseAccess::parameters();
+    QDir dir = QFileInfo(params.databaseName).dir();
+    return dir.filePath("Sicherung/Sicherung.journal");
+}
+
+void SecurityJournal::append(const SecurityJournalEntry& entry)
+{
+    QMutexLocker lock(&d->mutex);
+    d->pending << entry;
+    if (!d->writing)
+    {
+        d->writing = true;
+        QtConcurrent::run(this, &SecurityJournal::writePending);
+    }
+}
+
+bool SecurityJournal::flush()
+{
+    QMutexLocker lock(&d->mutex);
+    while (d->writing)
+    {
+        d->idleCondVar.wait(&d->mutex);
+    }
+    if (!d->pending.isEmpty())
+    {
+        // a write failed, try again
+        d->writing = true;
+        lock.unlock();
+        writePending();
+        lock.relock();
+    }
+    return d->pending.isEmpty();
+}
+
+void SecurityJournal::writePending()
+{
+    forever
+    {
+        QList<SecurityJournalEntry> batch;
+        {
+            QMutexLocker lock(&d->mutex);
+            if (d->pending.isEmpty())
+            {
+                d->writing = false;
+                d->idleCondVar.wakeAll();
+                return;
+            }
+            batch.swap(d->pending);
+        }
+        if (!d->writeChunk(batch))
+        {
+            // keep the entries, they are written with the next append() or flush()
+            QMutexLocker lock(&d->mutex);
+            d->pending = batch + d->pending;
+            d->writing = false;
+            d->idleCondVar.wakeAll();
+            return;
+        }
+    }
+}
+
+QList<SecurityJournalEntry> SecurityJournal::entries(int patientId, const QDateTime& from, const QDateTime& to) const
+{
+    QList<SecurityJournalEntry> entries;
+    QFile file(d->filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return entries;
+    }
+
+    qint64 validEnd;
+    foreach (const ChunkInfo& chunk, readIndex(file, &validEnd))
+    {
+        if (!chunk.overlaps(from, to))
+        {
+            continue;
+        }
+        if (patientId != -1 && !std::binary_search(chunk.patientIds.begin(), chunk.patientIds.end(), qint32(patientId)))
+        {
+            continue;
+        }
+        QList<SecurityJournalEntry> chunkEntries;
+        readChunk(file, chunk, chunkEntries);
+        foreach (const SecurityJournalEntry& entry, chunkEntries)
+        {
+            if ((patientId == -1 || entry.patientId == patientId)
+                    && (from.isNull() || entry.time >= from)
+                    && (to.isNull() || entry.time <= to))
+            {
+                entries << entry;
+            }
+        }
+    }
+    return entries;
+}
+
+QList<int> SecurityJournal::patientIds() const
+{
+    QSet<int> ids;
+    QFile file(d->filePath);
+    if (file.open(QIODevice::ReadOnly))
+    {
+        qint64 validEnd;
+        foreach (const ChunkInfo& chunk, readIndex(file, &validEnd))
+        {
+            foreach (qint32 id, chunk.patientIds)
+            {
+                ids << id;
+            }
+        }
+    }
+    QList<int> sorted = ids.toList();
+    std::sort(sorted.begin(), sorted.end());
+    return sorted;
+}
+
+bool SecurityJournal::verify(int* chunks, int* entries) const
+{
+    int chunkCount = 0, entryCount = 0;
+    bool ok = true;
+    QFile file(d->filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "Failed to open security journal" << d->filePath << file.errorString();
+        ok = false;
+    }
+    else
+    {
+        qint64 validEnd;
+        const QList<ChunkInfo> index = readIndex(file, &validEnd);
+        foreach (const ChunkInfo& chunk, index)
+        {
+            QList<SecurityJournalEntry> chunkEntries;
+            ok = readChunk(file, chunk, chunkEntries) && ok;
+            entryCount += chunkEntries.size();
+        }
+        chunkCount = index.size();
+        if (validEnd < file.size())
+        {
+            qWarning() << "Security journal" << d->filePath << "has" << file.size() - validEnd << "unreadable bytes at the end";
+            ok = false;
+        }
+    }
+    if (chunks)
+    {
+        *chunks = chunkCount;
+    }
+    if (entries)
+    {
+        *entries = entryCount;
+    }
+    return ok;
+}
@@ -0,0 +1,115 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#ifndef SECURITYJOURNAL_H
+#define SECURITYJOURNAL_H
+
+// Qt includes
+
+#include <QDate>
+#include <QDateTime>
+#include <QList>
+#include <QString>
+
+class SecurityJournalEntry
+{
+public:
+
+    SecurityJournalEntry();
+
+    bool isNull() const;
+    /// The file name used by the former per-save security copies
+    QString fileName() const;
+
+    int       patientId;
+    QDateTime time;
+    QString   type;
+    QString   surname;
+    QString   firstName;
+    QDate     dateOfBirth;
+    QString   value;
+};
+
+/**
+  Append-only journal of security copies of patient data (e.g., the disease history XML).
+
+  The file is a sequence of chunks. Each chunk holds the entries written together,
+  compressed, with the time range and the patient ids in an uncompressed header,
+  and a CRC-32 over header and data:
+
+    "TPJC" | quint32 header size | header | quint32 data size | data (qCompress) | quint32 CRC-32
+
+  Entries are appended from any thread and return at once;
+  a background thread writes all entries waiting at that time as one chunk.
+  Several programs may append to the same file: a chunk is appended holding a lock file,
+  which also guards cutting off a torn chunk at the end, left by a crash.
+  A journal damaged other than at the end is never cut off: it is renamed with the suffix
+  ".damaged-<time>" and a new journal is started.
+  If writing fails, the entries are kept and written again with the next append() or flush().
+
+  For reading, an index of the chunk headers is built without decompressing,
+  entries are then read only from the chunks containing a patient or time range.
+  */
+class SecurityJournal
+{
+public:
+
+    explicit SecurityJournal(const QString& filePath);
+    /// Writes all pending entries
+    ~SecurityJournal();
+
+    QString filePath() const;
+
+    /// The journal file next to the database, in the "Sicherung" directory
+    static QString defaultFilePath();
+
+    void append(const SecurityJournalEntry& entry);
+    /**
+      Blocks until all entries appended so far are written.
+      Returns false if entries could not be written, they are kept for the next attempt.
+      */
+    bool flush();
+
+    /**
+      Reads the entries of the given patient (-1: all patients) with a time in the given range
+      (null: open end), in the order they were written.
+      Chunks with a wrong checksum are skipped with a warning.
+      */
+    QList<SecurityJournalEntry> entries(int patientId = -1,
+                                        const QDateTime& from = QDateTime(),
+                                        const QDateTime& to = QDateTime()) const;
+
+    /// The ids of all patients with entries
+    QList<int> patientIds() const;
+
+    /// Returns false if the file contains a damaged chunk. Returns the number of chunks and entries.
+    bool verify(int* chunks = 0, int* entries = 0) const;
+
+private:
+
+    void writePending();
+
+    class SecurityJournalPriv;
+    SecurityJournalPriv* const d;
+};
+
+#endif // SECURITYJOURNAL_H
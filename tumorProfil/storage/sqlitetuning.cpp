@@ -0,0 +1,123 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#include "sqlitetuning.h"
+
+// Qt includes
+
+#include <QDebug>
+
+// The values are inserted into PRAGMA statements, only accept plain keywords
+static QString keyword(const QString& value, const QString& defaultValue, bool* ok)
+{
+    *ok = !value.isEmpty();
+    foreach (const QChar& c, value)
+    {
+        *ok = *ok && c.isLetter() && c.unicode() < 128;
+    }
+    return *ok ? value.toUpper() : defaultValue;
+}
+
+SQLiteTuning::SQLiteTuning(const QString& connectOptions)
+    : enabled(true),
+      journalMode("WAL"),
+      synchronous("NORMAL"),
+      mmapSize(256 * 1024 * 1024),
+      cacheSize(64 * 1024),
+      tempStore("MEMORY"),
+      busyTimeout(5000)
+{
+    foreach (const QString& option, connectOptions.split(';', QString::SkipEmptyParts))
+    {
+        const QString name  = option.section('=', 0, 0).trimmed().toUpper();
+        const QString value = option.section('=', 1).trimmed();
+        bool ok = true;
+
+        if (name == "SQLITE_TUNING")
+        {
+            enabled = !(value.compare("OFF", Qt::CaseInsensitive) == 0 || value == "0");
+        }
+        else if (name == "SQLITE_JOURNAL_MODE")
+        {
+            journalMode = keyword(value, journalMode, &ok);
+        }
+        else if (name == "SQLITE_SYNCHRONOUS")
+        {
+            synchronous = keyword(value, synchronous, &ok);
+        }
+        else if (name == "SQLITE_MMAP_SIZE")
+        {
+            const qint64 size = value.toLongLong(&ok);
+            mmapSize = ok ? size : mmapSize;
+        }
+        else if (name == "SQLITE_CACHE_SIZE")
+        {
+            const int size = value.toInt(&ok);
+            cacheSize = ok ? size : cacheSize;
+        }
+        else if (name == "SQLITE_TEMP_STORE")
+        {
+            tempStore = keyword(value, tempStore, &ok);
+        }
+        else if (name == "SQLITE_BUSY_TIMEOUT")
+        {
+            const int msecs = value.toInt(&ok);
+            busyTimeout = ok ? qMax(0, msecs) : busyTimeout;
+        }
+        else
+        {
+            m_driverOptions << option;
+            continue;
+        }
+
+        if (!ok)
+        {
+            qWarning() << "Ignoring invalid SQLite option" << option;
+        }
+    }
+
+    if (!enabled)
+    {
+        busyTimeout = 0;
+    }
+}
+
+QString SQLiteTuning::driverOptions() const
+{
+    return m_driverOptions.join(";");
+}
+
+QStringList SQLiteTuning::pragmas() const
+{
+    QStringList statements;
+    if (!enabled)
+    {
+        return statements;
+    }
+    statements << "PRAGMA journal_mode=" + journalMode;
+    statements << "PRAGMA synchronous=" + synchronous;
+    statements << "PRAGMA mmap_size=" + QString::number(mmapSize);
+    // a negative value is interpreted as KiB
+    statements << "PRAGMA cache_size=" + QString::number(-qAbs(cacheSize));
+    statements << "PRAGMA temp_store=" + tempStore;
+    return statements;
+}
@@ -0,0 +1,70 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#ifndef SQLITETUNING_H
+#define SQLITETUNING_H
+
+// Qt includes
+
+#include <QString>
+#include <QStringList>
+
+/**
+  Performance settings of SQLite connections, read from DatabaseParameters::connectOptions.
+
+  Options are given as "NAME=value", separated by ';', like the options of the Qt driver:
+  - SQLITE_TUNING=OFF            disables all of the following, restoring the plain driver defaults
+  - SQLITE_JOURNAL_MODE=WAL      readers and the writer do not block each other
+  - SQLITE_SYNCHRONOUS=NORMAL    in WAL mode, still safe against application crashes
+  - SQLITE_MMAP_SIZE=268435456   bytes of the database file read through memory mapping
+  - SQLITE_CACHE_SIZE=65536      page cache per connection in KiB
+  - SQLITE_TEMP_STORE=MEMORY     temporary tables and indices
+  - SQLITE_BUSY_TIMEOUT=5000     milliseconds SQLite waits for a lock held by another process
+  The values shown are the defaults. All other options are passed to the driver unchanged.
+  */
+class SQLiteTuning
+{
+public:
+
+    explicit SQLiteTuning(const QString& connectOptions = QString());
+
+    /// The connect options without the options handled here
+    QString driverOptions() const;
+    /// The PRAGMA statements to execute on each new connection
+    QStringList pragmas() const;
+
+public:
+
+    bool    enabled;
+    QString journalMode;
+    QString synchronous;
+    qint64  mmapSize;
+    int     cacheSize;
+    QString tempStore;
+    int     busyTimeout;
+
+private:
+
+    QStringList m_driverOptions;
+};
+
+#endif // SQLITETUNING_H
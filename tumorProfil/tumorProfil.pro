@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui sql xml widgets svg
+QT       += core gui sql xml widgets svg concurrent
 
 TARGET = Tumorprofil
 TEMPLATE = app
@@ -31,6 +31,8 @@ SOURCES += main.cpp\
     ui/smokerwidget.cpp \
     storage/patientmanager.cpp \
     storage/databasecorebackend.cpp \
+    storage/databaseprofiler.cpp \
+    storage/sqlitetuning.cpp \
     storage/databaseparameters.cpp \
     storage/sqlquery.cpp \
     storage/dbactiontype.cpp \
@@ -38,10 +40,16 @@ SOURCES += main.cpp\
     storage/schemaupdater.cpp \
     storage/databasetransaction.cpp \
     storage/databaseoperationgroup.cpp \
+    storage/databasemigrator.cpp \
     storage/databaseaccess.cpp \
     storage/patientdb.cpp \
+    storage/patientwritequeue.cpp \
+    storage/patientblindindex.cpp \
+    storage/securityjournal.cpp \
     storage/patientmodel.cpp \
     storage/patientpropertyfiltermodel.cpp \
+    storage/patientpredicateindex.cpp \
+    storage/patientsearchindex.cpp \
     storage/patientpropertymodel.cpp \
     datamodel/pathologypropertyinfo.cpp \
     ui/reportwindow.cpp \
@@ -75,7 +83,10 @@ SOURCES += main.cpp\
     medical/history/historyiterator.cpp \
     ui/history/visualhistorywidget.cpp \
     util/analysisgenerator.cpp \
+    util/exportspec.cpp \
+    util/databaseexport.cpp \
     util/historyvalidator.cpp \
+    util/tracing.cpp \
     settings/mainsettings.cpp \
     menubar.cpp \
     storage/pathologypropertiestablemodel.cpp \
@@ -83,6 +94,7 @@ SOURCES += main.cpp\
     ui/entityselectionwidgetv2.cpp \
     ui/modelfilterlineedit.cpp \
     medical/pathologyparser.cpp \
+    medical/literalprefilter.cpp \
     settings/databasesettings.cpp \
     ui/propertiestabletab.cpp \
     ui/extrainformationtab.cpp \
@@ -120,6 +132,8 @@ HEADERS  += mainwindow.h \
     storage/patientmanager.h \
     storage/databasecorebackend.h \
     storage/databasecorebackend_p.h \
+    storage/databaseprofiler.h \
+    storage/sqlitetuning.h \
     storage/databaseerrorhandler.h \
     storage/databaseparameters.h \
     storage/sqlquery.h \
@@ -128,11 +142,17 @@ HEADERS  += mainwindow.h \
     storage/schemaupdater.h \
     storage/databasetransaction.h \
     storage/databaseoperationgroup.h \
+    storage/databasemigrator.h \
     storage/databaseaccess.h \
     storage/patientdb.h \
+    storage/patientwritequeue.h \
+    storage/patientblindindex.h \
+    storage/securityjournal.h \
     storage/databaseinitializationobserver.h \
     storage/patientmodel.h \
     storage/patientpropertyfiltermodel.h \
+    storage/patientpredicateindex.h \
+    storage/patientsearchindex.h \
     storage/patientpropertymodel.h \
     datamodel/pathologypropertyinfo.h \
     ui/reportwindow.h \
@@ -168,7 +188,10 @@ HEADERS  += mainwindow.h \
     medical/history/historyiterator.h \
     ui/history/visualhistorywidget.h \
     util/analysisgenerator.h \
+    util/exportspec.h \
+    util/databaseexport.h \
     util/historyvalidator.h \
+    util/tracing.h \
     settings/mainsettings.h \
     menubar.h \
     storage/pathologypropertiestablemodel.h \
@@ -176,6 +199,7 @@ HEADERS  += mainwindow.h \
     ui/entityselectionwidgetv2.h \
     ui/modelfilterlineedit.h \
     medical/pathologyparser.h \
+    medical/literalprefilter.h \
     ui/propertiestabletab.h \
     ui/extrainformationtab.h \
     ui/mainviewtabinterface.h \
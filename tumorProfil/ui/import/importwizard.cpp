@@ -39,7 +39,10 @@ ImportWizard::ImportWizard()
 void ImportWizard::wizardFinished()
 {
     QApplication::setOverrideCursor(Qt::WaitCursor);
-    DatabaseOperationGroup group;
+    // Group commit of the patients inserted here. Their data is written by PatientManager's queue.
+    DatabaseOperationGroup group(DatabaseOperationGroup::AllBackends);
+    group.setMaximumTime(1000);
+    group.setMaximumStatements(5000);
     foreach (int id, pageIds())
     {
         PatientParsePage* parsePage = qobject_cast<PatientParsePage*>(page(id));
@@ -40,6 +40,7 @@
 #include "patiententerform.h"
 #include "patientmanager.h"
 #include "patientmodel.h"
+#include "patientsearchindex.h"
 
 class PatientListviewFilterModel : public QSortFilterProxyModel
 {
@@ -77,10 +78,11 @@ protected:
                 return false;
             }
         }
-        return QSortFilterProxyModel::filterAcceptsRow(source_row, source_parent);
+        return searchFilter.acceptsRow(this, source_row, source_parent);
     }
 
     bool onlyTumorProfil;
+    mutable PatientSearchFilter searchFilter;
 };
 
 class PatientListView::PatientListViewPriv
@@ -365,51 +365,47 @@ QList<Patient::Ptr> AnalysisGenerator::patientsFromCSV(const QString &path)
         return patients;
     }
     // skip header line
-    source.parseNextLine();
-    while (!source.atEnd())
+    CSVRow data;
+    source.readNextRow(data);
+    while (source.readNextRow(data))
     {
-        QList<QVariant> data = source.parseNextLine();
         if (data.size() < 4)
             continue;
-        QDate dob;
-        if (data[3].type() == QVariant::Date)
-        {
-            dob = data[3].toDate();
-        }
-        else
+        QDate dob = data.toDate(3);
+        if (!dob.isValid())
         {
-            QString dateString = data[3].toString();
+            QString dateString = data.toString(3);
             if (dateString.contains('-'))
             {
-                dob = QDate::fromString(data[3].toString(), "yyyy-MM-dd");
+                dob = QDate::fromString(dateString, "yyyy-MM-dd");
             }
             else if (dateString.contains('/'))
             {
-                dob = QDate::fromString(data[3].toString(), "M/d/yyyy");
+                dob = QDate::fromString(dateString, "M/d/yyyy");
             }
         }
         if (!dob.isValid())
         {
-            qDebug() << "Failed to parse d o b" << data[3] << data[1].toString();
+            qDebug() << "Failed to parse d o b" << data.toString(3) << data.toString(1);
             continue;
         }
-        QString surname = data[1].toString();
+        QString surname = data.toString(1);
         // special cases in HER2 file
         if (surname == "Muenchow") surname = "Münchow";
         if (surname == "Huettmann") surname = "Hüttmann";
-        QList<Patient::Ptr> candidates = PatientManager::instance()->findPatients(surname, data[2].toString(), dob);
+        QList<Patient::Ptr> candidates = PatientManager::instance()->findPatients(surname, data.toString(2), dob);
         if (candidates.isEmpty())
         {
-            qDebug() << "Did not identify" << data[1];
+            qDebug() << "Did not identify" << surname;
             continue;
         }
         else if (candidates.size() > 1)
         {
-            qDebug() << "Multiple pts for" << data[1];
+            qDebug() << "Multiple pts for" << surname;
         }
-        if (!data[0].toString().isEmpty() && candidates.first()->id != data[0].toInt())
+        if (!data.field(0).trimmed().isEmpty() && candidates.first()->id != data.toInt(0))
         {
-            qDebug() << "Id mismatch" << data[1].toString() << data[2].toString() << data[0].toInt() << candidates.first()->id;
+            qDebug() << "Id mismatch" << surname << data.toString(2) << data.toInt(0) << candidates.first()->id;
         }
         patients << candidates.first();
     }
@@ -1276,24 +1272,13 @@ void AnalysisGenerator::nsclcSCNE21PathologyDates()
 
 void AnalysisGenerator::writeActionableCombinations(const QList<Patient::Ptr>& patients)
 {
-    QMap< QList<PathologyPropertyInfo>, DataAggregator* > actionableCombinations = ActionableResultChecker::actionableCombinations(patients, ActionableResultChecker::IncludeRAS);
-    QMap< QList<PathologyPropertyInfo>,  DataAggregator* >::const_iterator it;
-    for (it = actionableCombinations.begin(); it != actionableCombinations.end(); ++it)
+    ActionableCombinations actionableCombinations = ActionableResultChecker::actionableCombinations(patients, ActionableResultChecker::IncludeRAS);
+    for (int i=0; i<actionableCombinations.size(); i++)
     {
-        QStringList titles;
-        foreach (const PathologyPropertyInfo& info, it.key())
-        {
-            titles << info.plainTextLabel();
-        }
-        if (titles.isEmpty())
-        {
-            titles << "Kein relevanter Befund";
-        }
-        m_file << titles.join(", ");
-        m_file << it.value()->values().value(AggregatedDatumInfo(AggregatedDatumInfo::Positive, AggregatedDatumInfo::AbsoluteValue));
+        m_file << actionableCombinations.label(i);
+        m_file << actionableCombinations.values(i).value(AggregatedDatumInfo(AggregatedDatumInfo::Positive, AggregatedDatumInfo::AbsoluteValue));
         m_file.newLine();
     }
-    qDeleteAll(actionableCombinations);
 }
 
 void AnalysisGenerator::nsclcSCNE21ActionableResults()
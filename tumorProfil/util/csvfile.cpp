@@ -24,231 +24,486 @@
 
 #include <QDate>
 #include <QDebug>
+#include <QTextCodec>
+
+// Output is handed to the file in chunks of this size
+static const int writeChunkSize = 64 * 1024;
+
+/**
+  Parses d.M.yy, dd.MM.yy, d.M.yyyy, dd.MM.yyyy and MM/dd/yyyy in one pass.
+  Two-digit years are in the 20th century, as with QDate::fromString.
+  */
+static QDate parseDate(const QStringRef& s)
+{
+    const int length = s.length();
+    if (length < 6 || length > 10)
+    {
+        return QDate();
+    }
+
+    QChar separator;
+    int numbers[3] = { 0, 0, 0 };
+    int digits[3]  = { 0, 0, 0 };
+    int part = 0;
+    for (int i=0; i<length; i++)
+    {
+        const QChar c = s.at(i);
+        if (c.isDigit())
+        {
+            numbers[part] = numbers[part] * 10 + c.digitValue();
+            digits[part]++;
+        }
+        else if ((c == '.' || c == '/') && (separator.isNull() || c == separator) && part < 2)
+        {
+            separator = c;
+            part++;
+        }
+        else
+        {
+            return QDate();
+        }
+    }
+
+    if (part != 2)
+    {
+        return QDate();
+    }
+
+    int day, month, year;
+    if (separator == '.')
+    {
+        if (digits[0] < 1 || digits[0] > 2 || digits[1] < 1 || digits[1] > 2)
+        {
+            return QDate();
+        }
+        day   = numbers[0];
+        month = numbers[1];
+    }
+    else
+    {
+        if (digits[0] != 2 || digits[1] != 2 || digits[2] != 4)
+        {
+            return QDate();
+        }
+        month = numbers[0];
+        day   = numbers[1];
+    }
+
+    if (digits[2] == 4)
+    {
+        year = numbers[2];
+    }
+    else if (digits[2] == 2)
+    {
+        year = 1900 + numbers[2];
+    }
+    else
+    {
+        return QDate();
+    }
+
+    return QDate(year, month, day);
+}
+
+static QVariant toVariant(const QStringRef& s, bool wasQuoted)
+{
+    QDate date = parseDate(s);
+    if (date.isValid())
+    {
+        return date;
+    }
+
+    if (!wasQuoted)
+    {
+        bool ok;
+        int i = s.toInt(&ok);
+        if (ok)
+        {
+            return i;
+        }
+    }
+
+    return s.trimmed().toString();
+}
+
+QStringRef CSVRow::field(int i) const
+{
+    if (i < 0 || i >= m_fields.size())
+    {
+        return QStringRef();
+    }
+    const Field& f = m_fields.at(i);
+    return QStringRef(&m_line, f.offset, f.length);
+}
+
+bool CSVRow::wasQuoted(int i) const
+{
+    return i >= 0 && i < m_fields.size() && m_fields.at(i).quoted;
+}
+
+QVariant CSVRow::value(int i) const
+{
+    if (i < 0 || i >= m_fields.size())
+    {
+        return QVariant();
+    }
+    return toVariant(field(i), wasQuoted(i));
+}
+
+int CSVRow::toInt(int i, bool* ok) const
+{
+    return field(i).trimmed().toInt(ok);
+}
+
+QDate CSVRow::toDate(int i) const
+{
+    return parseDate(field(i).trimmed());
+}
+
+QString CSVRow::toString(int i) const
+{
+    return field(i).trimmed().toString();
+}
+
+QList<QVariant> CSVRow::toVariantList() const
+{
+    QList<QVariant> records;
+    records.reserve(m_fields.size());
+    for (int i=0; i<m_fields.size(); i++)
+    {
+        records << value(i);
+    }
+    return records;
+}
 
 CSVFile::CSVFile(const QChar& delimiter)
-    : m_delimiter(delimiter)
+    : m_delimiter(delimiter),
+      m_delimiterByte(delimiter.toLatin1()),
+      m_data(0),
+      m_size(0),
+      m_readPos(0),
+      m_codec(QTextCodec::codecForName("UTF-8")),
+      m_string(0),
+      m_fieldsInLine(0)
 {
 }
 
+CSVFile::~CSVFile()
+{
+    flushWriteBuffer();
+}
+
 bool CSVFile::read(const QString& filePath)
 {
     m_file.setFileName(filePath);
-    if (!m_file.open(QIODevice::ReadOnly | QIODevice::Text))
+    if (!m_file.open(QIODevice::ReadOnly))
     {
         qDebug() << m_file.errorString();
         return false;
     }
-    m_stream.setDevice(&m_file);
+
+    m_size = m_file.size();
+    m_data = m_size ? reinterpret_cast<const char*>(m_file.map(0, m_size)) : 0;
+    if (!m_data)
+    {
+        m_readBuffer = m_file.readAll();
+        m_data = m_readBuffer.constData();
+        m_size = m_readBuffer.size();
+    }
+
+    // skip a UTF-8 byte order mark
+    m_readPos = 0;
+    if (m_size >= 3 && m_data[0] == '\xEF' && m_data[1] == '\xBB' && m_data[2] == '\xBF')
+    {
+        m_readPos = 3;
+    }
     return true;
 }
 
 bool CSVFile::openForWriting(const QString& filePath)
 {
     m_file.setFileName(filePath);
-    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Text))
+    // No text mode: the bytes, also line breaks inside quoted fields, are written as given
+    if (!m_file.open(QIODevice::WriteOnly))
     {
         qDebug() << m_file.errorString();
         return false;
     }
-    m_stream.setDevice(&m_file);
+    m_string = 0;
+    m_writeBuffer.reserve(writeChunkSize * 2);
+    // a UTF-8 byte order mark, for Excel. read() skips it.
+    m_writeBuffer += "\xEF\xBB\xBF";
     return true;
 }
 
 void CSVFile::finishWriting()
 {
-    m_stream.flush();
+    flushWriteBuffer();
     m_file.close();
-    m_stream.setDevice(0);
+    m_string = 0;
 }
 
 void CSVFile::writeToString(QString *string)
 {
-    m_stream.setString(string);
+    flushWriteBuffer();
+    m_string = string;
+    m_writeBuffer.reserve(writeChunkSize);
 }
 
 bool CSVFile::atEnd() const
 {
-    return m_stream.atEnd();
-}
-
-CSVFile& CSVFile::operator<<(const QVariant& record)
-{
-    m_buffer << record;
-    return *this;
-}
-
-void CSVFile::newLine()
-{
-    writeNextLine(m_buffer);
-    m_buffer.clear();
+    return m_readPos >= m_size;
 }
 
-void CSVFile::writeNextLine(const QList<QVariant>& records)
+bool CSVFile::readNextRow(CSVRow& row)
 {
-    //qDebug() << "Writing line with" << records.size();
-    if (records.isEmpty())
+    row.m_fields.clear();
+    if (atEnd())
     {
-        return;
+        row.m_line.clear();
+        return false;
     }
 
-    bool first = true;
-    foreach (const QVariant& v, records)
+    // Find the end of the record. Quotes, delimiter and newline are ASCII and cannot occur inside a UTF-8 sequence.
+    // A quote opens a quoted field only at the start of the field, as when splitting below.
+    const qint64 begin = m_readPos;
+    qint64 end = begin;
+    bool inQuotes = false, fieldEmpty = true;
+    for (; end < m_size; ++end)
     {
-        if (!first)
-            m_stream << m_delimiter;
-        first = false;
-
-        switch (v.type())
+        const char c = m_data[end];
+        if (!inQuotes && fieldEmpty && c == '"')
         {
-        case QVariant::Date:
-            m_stream << v.toDate().toString("dd.MM.yyyy");
-            break;
-        case QVariant::Bool:
-            m_stream << v.toInt();
-            break;
-        case QVariant::String:
-        default:
+            inQuotes = true;
+        }
+        else if (inQuotes && c == '"')
         {
-            QString s = v.toString();
-            if (s.contains(m_delimiter))
+            if (end + 1 < m_size && m_data[end+1] == '"')
             {
-                m_stream << '"' << v.toString() << '"';
+                // two double quotes resolve to one
+                end++;
+                fieldEmpty = false;
             }
             else
             {
-                m_stream << v.toString();
+                inQuotes = false;
             }
+        }
+        else if (!inQuotes && c == m_delimiterByte)
+        {
+            fieldEmpty = true;
+        }
+        else if (!inQuotes && c == '\n')
+        {
             break;
         }
+        else
+        {
+            fieldEmpty = false;
         }
     }
+    m_readPos = (end < m_size) ? end + 1 : m_size;
 
-    m_stream << '\n';
-}
-
-QList<QVariant> CSVFile::parseNextLine()
-{
-    QString line = m_stream.readLine();
-    QList<QVariant> records;
-
-    if (line.isNull())
+    int length = int(end - begin);
+    if (length && m_data[begin + length - 1] == '\r')
     {
-        return records;
+        length--;
     }
 
-    // code from http://www.zedwood.com/article/112/cpp-csv-parser
-    int linepos = 0;
-    bool inquotes = false;
-    bool hadquotes = false;
-    QChar c;
-    const int linemax = line.length();
-    QString curstring;
-
-    while (linepos < linemax)
+    QTextCodec::ConverterState state;
+    row.m_line = m_codec->toUnicode(m_data + begin, length, &state);
+    if (state.invalidChars)
     {
+        // legacy files written in the local encoding
+        row.m_line = QString::fromLocal8Bit(m_data + begin, length);
+    }
 
-        c = line.at(linepos);
-
-        if (!inquotes && curstring.length()==0 && c=='"')
+    // Split in place: unescaped content is never longer than the escaped input
+    QChar* buffer = row.m_line.data();
+    const int size = row.m_line.size();
+    int readPos = 0, writePos = 0, fieldBegin = 0;
+    bool quoted = false, hadQuotes = false;
+    while (readPos < size)
+    {
+        const QChar c = buffer[readPos];
+        if (!quoted && writePos == fieldBegin && c == '"')
         {
-            //beginquotechar
-            inquotes = true;
-            hadquotes = true;
+            quoted    = true;
+            hadQuotes = true;
         }
-        else if (inquotes && c == '"')
+        else if (quoted && c == '"')
         {
-            //quotechar
-            if ( (linepos+1 <linemax) && (line[linepos+1]=='"') )
+            if (readPos + 1 < size && buffer[readPos+1] == '"')
             {
-                //encountered 2 double quotes in a row (resolves to 1 double quote)
-                curstring.push_back(c);
-                linepos++;
+                // two double quotes resolve to one
+                buffer[writePos++] = c;
+                readPos++;
             }
             else
             {
-                //endquotechar
-                inquotes=false;
+                quoted = false;
             }
         }
-        else if (!inquotes && c == m_delimiter)
-        {
-            //end of field
-            records << toVariant(curstring, hadquotes);
-            curstring.clear();
-            hadquotes = false;
-        }
-        else if (!inquotes && (c=='\r' || c=='\n') )
+        else if (!quoted && c == m_delimiter)
         {
-            records << toVariant(curstring, hadquotes);
-            return records;
+            CSVRow::Field field = { fieldBegin, writePos - fieldBegin, hadQuotes };
+            row.m_fields << field;
+            fieldBegin = writePos;
+            hadQuotes  = false;
         }
         else
         {
-            curstring.append(c);
+            buffer[writePos++] = c;
         }
-        linepos++;
+        readPos++;
     }
-    records << toVariant(curstring, hadquotes);
+    CSVRow::Field field = { fieldBegin, writePos - fieldBegin, hadQuotes };
+    row.m_fields << field;
 
-    return records;
+    return true;
 }
 
-QVariant CSVFile::toVariant(const QString& s, bool wasQuoted)
+QList<QVariant> CSVFile::parseNextLine()
 {
-    if (s.count('.') == 2)
+    if (!readNextRow(m_row))
     {
-        if (s.length() == 10)
-        {
-            QDate date = QDate::fromString(s, "dd.MM.yyyy");
-            if (date.isValid())
-            {
-                return date;
-            }
-        }
-        else if (s.length() == 8)
-        {
-            QDate date = QDate::fromString(s, "dd.MM.yy");
-            if (!date.isValid())
-            {
-                date = QDate::fromString(s, "d.M.yyyy");
-            }
-            if (date.isValid())
-            {
-                return date;
-            }
-        }
-        else
-        {
-            QDate date = QDate::fromString(s, "d.M.yy");
-            if (date.isValid())
-            {
-                return date;
-            }
-        }
+        return QList<QVariant>();
     }
-    else if (s.count('/') == 2)
+    return m_row.toVariantList();
+}
+
+CSVFile& CSVFile::operator<<(const QVariant& record)
+{
+    if (m_fieldsInLine++)
     {
-        QDate date = QDate::fromString(s, "MM/dd/yyyy");
-        if (date.isValid())
-        {
-            return date;
-        }
+        m_writeBuffer += m_delimiterByte;
     }
+    appendField(record);
+    return *this;
+}
 
-    if (wasQuoted)
+void CSVFile::newLine()
+{
+    if (!m_fieldsInLine)
+    {
+        return;
+    }
+    m_fieldsInLine = 0;
+    // records in files are separated by CRLF (RFC 4180)
+    if (m_string)
     {
-        return s.trimmed();
+        m_writeBuffer += '\n';
     }
     else
     {
-        bool ok;
-        int i;
-        i = s.toInt(&ok);
-        if (ok)
+        m_writeBuffer += "\r\n";
+    }
+
+    // a string target is expected to be complete after each line
+    if (m_string || m_writeBuffer.size() >= writeChunkSize)
+    {
+        flushWriteBuffer();
+    }
+}
+
+void CSVFile::writeNextLine(const QList<QVariant>& records)
+{
+    foreach (const QVariant& v, records)
+    {
+        *this << v;
+    }
+    newLine();
+}
+
+void CSVFile::appendField(const QVariant& v)
+{
+    switch (v.userType())
+    {
+    case QMetaType::UnknownType:
+        break;
+    case QMetaType::Int:
+        m_writeBuffer += QByteArray::number(v.toInt());
+        break;
+    case QMetaType::UInt:
+        m_writeBuffer += QByteArray::number(v.toUInt());
+        break;
+    case QMetaType::LongLong:
+        m_writeBuffer += QByteArray::number(v.toLongLong());
+        break;
+    case QMetaType::ULongLong:
+        m_writeBuffer += QByteArray::number(v.toULongLong());
+        break;
+    case QMetaType::Double:
+        m_writeBuffer += QByteArray::number(v.toDouble(), 'g', 15);
+        break;
+    case QMetaType::Float:
+        m_writeBuffer += QByteArray::number(double(v.toFloat()), 'g', 6);
+        break;
+    case QMetaType::Bool:
+        m_writeBuffer += v.toBool() ? '1' : '0';
+        break;
+    case QMetaType::QDate:
+    {
+        const QDate date = v.toDate();
+        if (date.isValid())
         {
-            return i;
+            char buffer[16];
+            qsnprintf(buffer, sizeof(buffer), "%02d.%02d.%04d", date.day(), date.month(), date.year());
+            m_writeBuffer += buffer;
         }
+        break;
+    }
+    case QMetaType::QString:
+        appendString(*reinterpret_cast<const QString*>(v.constData()));
+        break;
+    default:
+        appendString(v.toString());
+        break;
+    }
+}
 
-        return s.trimmed();
+void CSVFile::appendString(const QString& s)
+{
+    bool needsQuotes = false;
+    const QChar* data = s.constData();
+    const int size = s.size();
+    for (int i=0; i<size; i++)
+    {
+        const QChar c = data[i];
+        if (c == m_delimiter || c == '"' || c == '\n' || c == '\r')
+        {
+            needsQuotes = true;
+            break;
+        }
+    }
+
+    if (!needsQuotes)
+    {
+        m_writeBuffer += s.toUtf8();
+        return;
+    }
+
+    QString escaped = s;
+    escaped.replace('"', "\"\"");
+    m_writeBuffer += '"';
+    m_writeBuffer += escaped.toUtf8();
+    m_writeBuffer += '"';
+}
+
+void CSVFile::flushWriteBuffer()
+{
+    if (m_writeBuffer.isEmpty())
+    {
+        return;
+    }
+    if (m_string)
+    {
+        m_string->append(QString::fromUtf8(m_writeBuffer));
+    }
+    else if (m_file.isOpen() && m_file.isWritable())
+    {
+        m_file.write(m_writeBuffer);
     }
+    // keeps the reserved capacity
+    m_writeBuffer.resize(0);
 }
@@ -23,23 +23,72 @@
 #define CSVFILE_H
 
 
+#include <QByteArray>
+#include <QDate>
 #include <QFile>
 #include <QString>
-#include <QTextStream>
+#include <QStringRef>
 #include <QVariant>
+#include <QVector>
+
+class QTextCodec;
+
+/**
+  One row as read by CSVFile::readNextRow.
+  Fields are views into the row's decoded line, quotes already resolved.
+  They stay valid until the row is reused for the next read.
+  Typed conversion happens only when a field is requested.
+  */
+class CSVRow
+{
+public:
+
+    int size() const { return m_fields.size(); }
+    bool isEmpty() const { return m_fields.isEmpty(); }
+
+    QStringRef field(int i) const;
+    bool wasQuoted(int i) const;
+
+    /// Same heuristics as CSVFile::parseNextLine: date, then int, else trimmed string
+    QVariant value(int i) const;
+    int toInt(int i, bool* ok = 0) const;
+    QDate toDate(int i) const;
+    QString toString(int i) const;
+
+    QList<QVariant> toVariantList() const;
+
+private:
+
+    friend class CSVFile;
+
+    struct Field
+    {
+        int  offset;
+        int  length;
+        bool quoted;
+    };
+
+    QString        m_line;
+    QVector<Field> m_fields;
+};
 
 class CSVFile
 {
 public:
 
     CSVFile(const QChar& delimiter = ';');
+    ~CSVFile();
 
+    /// Maps the file into memory. Input is decoded as UTF-8, with fallback to the local 8 bit codec per row.
     bool read(const QString& filePath);
+    /// Output is UTF-8 with a byte order mark and CRLF record separators, buffered and written in chunks.
     bool openForWriting(const QString& filePath);
     void finishWriting();
     void writeToString(QString *string);
 
     // Reading
+    /// Reads the next record according to RFC 4180 (quoted fields may contain delimiters, quotes and newlines)
+    bool readNextRow(CSVRow& row);
     QList<QVariant> parseNextLine();
     bool atEnd() const;
 
@@ -53,12 +102,26 @@ public:
 
 private:
 
-    QVariant toVariant(const QString& s, bool wasQuoted);
+    void appendField(const QVariant& v);
+    void appendString(const QString& s);
+    void flushWriteBuffer();
 
-    QChar m_delimiter;
-    QFile m_file;
-    QTextStream m_stream;
-    QList<QVariant> m_buffer;
+    QChar       m_delimiter;
+    char        m_delimiterByte;
+    QFile       m_file;
+
+    // Reading
+    const char* m_data;
+    qint64      m_size;
+    qint64      m_readPos;
+    QByteArray  m_readBuffer; // used if the file cannot be mapped
+    QTextCodec* m_codec;
+    CSVRow      m_row;
+
+    // Writing
+    QByteArray  m_writeBuffer;
+    QString*    m_string;
+    int         m_fieldsInLine;
 };
 
 
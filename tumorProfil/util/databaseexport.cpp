@@ -0,0 +1,617 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#include "databaseexport.h"
+
+// Qt includes
+
+#include <QDataStream>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFuture>
+#include <QHash>
+#include <QScopedPointer>
+#include <QtConcurrent/QtConcurrent>
+#include <QVector>
+
+// Local includes
+
+#include "csvfile.h"
+#include "databaseaccess.h"
+#include "databasecorebackend.h"
+#include "patient.h"
+#include "patientdb.h"
+#include "tracing.h"
+
+namespace
+{
+
+enum ColumnType
+{
+    // property columns: integer or date per row group if possible
+    InferredType = 0,
+    IntType      = 1,
+    DateType     = 2,
+    StringType   = 3
+};
+
+enum FixedColumn
+{
+    PatientIdColumn,
+    SurnameColumn,
+    FirstNameColumn,
+    DateOfBirthColumn,
+    GenderColumn,
+    DiseaseIdColumn,
+    InitialDiagnosisColumn,
+    CTNMColumn,
+    PTNMColumn,
+    EntityColumn,
+    SampleOriginColumn,
+    ContextColumn,
+    PathologyDateColumn
+};
+
+/// The values of one column for the rows of a batch, null if missing
+typedef QVector<QString> ColumnValues;
+
+class ExportBatch
+{
+public:
+
+    ExportBatch() : failed(false) {}
+
+    bool isEmpty() const { return patients.isEmpty(); }
+
+    /// A query failed: the batch is incomplete, and an empty batch is not the end
+    bool                          failed;
+    QList<Patient::Ptr>           patients;
+    QHash<int, QList<Disease> >   diseases;
+    QHash<int, QList<Pathology> > pathologies;
+    QHash<int, QList<Property> >  patientProperties;
+    QHash<int, QList<Property> >  diseaseProperties;
+    QHash<int, QList<Property> >  pathologyProperties;
+};
+
+ExportBatch readBatch(int afterId, int limit)
+{
+    TRACE_SPAN("DatabaseExport::readBatch");
+    ExportBatch batch;
+    DatabaseAccess access;
+    const int failuresBefore = access.backend()->failedStatementCount();
+    batch.patients = access.db()->findPatientsAfter(afterId, limit);
+    if (!batch.patients.isEmpty())
+    {
+        const int first = batch.patients.first()->id;
+        const int last  = batch.patients.last()->id;
+        batch.diseases            = access.db()->findDiseasesOfPatients(first, last);
+        batch.pathologies         = access.db()->findPathologiesOfPatients(first, last);
+        batch.patientProperties   = access.db()->propertiesOfPatients(PatientDB::PatientProperties, first, last);
+        batch.diseaseProperties   = access.db()->propertiesOfPatients(PatientDB::DiseaseProperties, first, last);
+        batch.pathologyProperties = access.db()->propertiesOfPatients(PatientDB::PathologyProperties, first, last);
+    }
+    batch.failed = access.backend()->failedStatementCount() != failuresBefore;
+    return batch;
+}
+
+void decryptPatient(const Patient::Ptr& p)
+{
+    p->decrypt();
+}
+
+/**
+  Sets the columns of the given properties which are not yet set in this row.
+  If detailColumns is given, the detail is set together with the value.
+  */
+void fillProperties(QVector<ColumnValues>& columns, int row, const QList<Property>& properties,
+                    const QHash<QString, int>& valueColumns, const QHash<QString, int>* detailColumns = 0)
+{
+    foreach (const Property& prop, properties)
+    {
+        const int column = valueColumns.value(prop.property, -1);
+        if (column == -1 || !columns[column][row].isNull())
+        {
+            continue;
+        }
+        // an empty value still marks the property as present
+        columns[column][row] = prop.value.isNull() ? QString("") : prop.value;
+        const int detailColumn = detailColumns ? detailColumns->value(prop.property, -1) : -1;
+        if (detailColumn != -1 && !prop.detail.isEmpty())
+        {
+            columns[detailColumn][row] = prop.detail;
+        }
+    }
+}
+
+bool isCanonicalInt(const QString& s)
+{
+    bool ok;
+    const int value = s.toInt(&ok);
+    return ok && QString::number(value) == s;
+}
+
+bool isIsoDate(const QString& s)
+{
+    return s.size() == 10 && QDate::fromString(s, Qt::ISODate).isValid();
+}
+
+ColumnType inferType(const ColumnValues& values)
+{
+    bool allInt = true, allDate = true, any = false;
+    foreach (const QString& value, values)
+    {
+        if (value.isNull())
+        {
+            continue;
+        }
+        any = true;
+        allInt  = allInt && isCanonicalInt(value);
+        allDate = allDate && isIsoDate(value);
+        if (!allInt && !allDate)
+        {
+            return StringType;
+        }
+    }
+    if (!any)
+    {
+        return StringType;
+    }
+    return allInt ? IntType : (allDate ? DateType : StringType);
+}
+
+class ColumnChunk
+{
+public:
+
+    const ColumnValues* values;
+    ColumnType          type;
+    QByteArray          data;
+};
+
+void encodeColumn(ColumnChunk& chunk)
+{
+    const ColumnValues& values = *chunk.values;
+    const int rows = values.size();
+    if (chunk.type == InferredType)
+    {
+        chunk.type = inferType(values);
+    }
+
+    QByteArray present((rows + 7) / 8, 0);
+    for (int i=0; i<rows; i++)
+    {
+        if (!values[i].isNull())
+        {
+            present[i/8] = char(present.at(i/8) | (1 << (i%8)));
+        }
+    }
+
+    QDataStream out(&chunk.data, QIODevice::WriteOnly);
+    out.writeRawData(present.constData(), present.size());
+    switch (chunk.type)
+    {
+    case IntType:
+        foreach (const QString& value, values)
+        {
+            out << qint32(value.toInt());
+        }
+        break;
+    case DateType:
+    {
+        const QDate epoch(1970, 1, 1);
+        foreach (const QString& value, values)
+        {
+            const QDate date = QDate::fromString(value, Qt::ISODate);
+            out << qint32(date.isValid() ? epoch.daysTo(date) : 0);
+        }
+        break;
+    }
+    case StringType:
+    case InferredType:
+    {
+        QByteArray utf8;
+        out << quint32(0);
+        foreach (const QString& value, values)
+        {
+            utf8 += value.toUtf8();
+            out << quint32(utf8.size());
+        }
+        out.writeRawData(utf8.constData(), utf8.size());
+        break;
+    }
+    }
+}
+
+void writeString(QDataStream& out, const QString& s)
+{
+    const QByteArray utf8 = s.toUtf8();
+    out << quint32(utf8.size());
+    out.writeRawData(utf8.constData(), utf8.size());
+}
+
+class ExportWriter
+{
+public:
+
+    virtual ~ExportWriter() {}
+
+    virtual bool open(const QString& filePath, const QStringList& headers) = 0;
+    virtual void writeRows(const QVector<ColumnValues>& columns, const QVector<ColumnType>& types) = 0;
+    virtual bool finish() = 0;
+};
+
+class CSVExportWriter : public ExportWriter
+{
+public:
+
+    virtual bool open(const QString& filePath, const QStringList& headers)
+    {
+        if (!m_file.openForWriting(filePath))
+        {
+            return false;
+        }
+        foreach (const QString& header, headers)
+        {
+            m_file << header;
+        }
+        m_file.newLine();
+        return true;
+    }
+
+    virtual void writeRows(const QVector<ColumnValues>& columns, const QVector<ColumnType>&)
+    {
+        const int rows = columns.first().size();
+        for (int row=0; row<rows; row++)
+        {
+            for (int column=0; column<columns.size(); column++)
+            {
+                m_file << columns[column][row];
+            }
+            m_file.newLine();
+        }
+    }
+
+    virtual bool finish()
+    {
+        m_file.finishWriting();
+        return true;
+    }
+
+private:
+
+    CSVFile m_file;
+};
+
+class ColumnarExportWriter : public ExportWriter
+{
+public:
+
+    ColumnarExportWriter()
+        : m_rows(0), m_failed(false)
+    {
+    }
+
+    virtual bool open(const QString& filePath, const QStringList& headers)
+    {
+        m_file.setFileName(filePath);
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            return false;
+        }
+        QByteArray header;
+        QDataStream out(&header, QIODevice::WriteOnly);
+        out.writeRawData("TPCF", 4);
+        out << quint32(1) << quint32(headers.size());
+        foreach (const QString& name, headers)
+        {
+            writeString(out, name);
+        }
+        write(header);
+        return !m_failed;
+    }
+
+    virtual void writeRows(const QVector<ColumnValues>& columns, const QVector<ColumnType>& types)
+    {
+        const int rows = columns.first().size();
+        QVector<ColumnChunk> chunks(columns.size());
+        for (int i=0; i<columns.size(); i++)
+        {
+            chunks[i].values = &columns[i];
+            chunks[i].type   = types[i];
+        }
+        QtConcurrent::blockingMap(chunks, encodeColumn);
+
+        m_rowGroupOffsets << m_file.pos();
+        QByteArray group;
+        QDataStream out(&group, QIODevice::WriteOnly);
+        out << quint32(rows);
+        foreach (const ColumnChunk& chunk, chunks)
+        {
+            out << quint8(chunk.type) << quint32(chunk.data.size());
+            out.writeRawData(chunk.data.constData(), chunk.data.size());
+        }
+        write(group);
+        m_rows += rows;
+    }
+
+    virtual bool finish()
+    {
+        QByteArray footer;
+        QDataStream out(&footer, QIODevice::WriteOnly);
+        foreach (qint64 offset, m_rowGroupOffsets)
+        {
+            out << quint64(offset);
+        }
+        out << quint32(m_rowGroupOffsets.size()) << quint64(m_rows);
+        out.writeRawData("TPCF", 4);
+        write(footer);
+        m_file.close();
+        return !m_failed;
+    }
+
+private:
+
+    void write(const QByteArray& data)
+    {
+        if (!m_failed && m_file.write(data) != data.size())
+        {
+            qWarning() << "Failed to write" << m_file.fileName() << m_file.errorString();
+            m_failed = true;
+        }
+    }
+
+    QFile          m_file;
+    QList<qint64>  m_rowGroupOffsets;
+    quint64        m_rows;
+    bool           m_failed;
+};
+
+}
+
+class DatabaseExport::DatabaseExportPriv
+{
+public:
+
+    DatabaseExportPriv()
+        : batchSize(1000),
+          rowCount(0)
+    {
+    }
+
+    int addColumn(const QString& name, ColumnType type = InferredType)
+    {
+        headers << name;
+        types   << type;
+        return headers.size() - 1;
+    }
+
+    void setupColumns(PatientDB* db)
+    {
+        headers.clear();
+        types.clear();
+        patientPropertyColumns.clear();
+        diseasePropertyColumns.clear();
+        pathologyPropertyColumns.clear();
+        pathologyDetailColumns.clear();
+
+        // in the order of FixedColumn
+        addColumn("patientid", IntType);
+        addColumn("surname", StringType);
+        addColumn("firstname", StringType);
+        addColumn("dateofbirth", DateType);
+        addColumn("gender", IntType);
+        addColumn("diseaseid", IntType);
+        addColumn("initialdiagnosis", DateType);
+        addColumn("ctnm", StringType);
+        addColumn("ptnm", StringType);
+        addColumn("entity", IntType);
+        addColumn("sampleorigin", IntType);
+        addColumn("context", StringType);
+        addColumn("pathologydate", DateType);
+
+        foreach (const QString& name, db->propertyNames(PatientDB::PatientProperties))
+        {
+            patientPropertyColumns[name] = addColumn("patient:" + name);
+        }
+        foreach (const QString& name, db->propertyNames(PatientDB::DiseaseProperties))
+        {
+            diseasePropertyColumns[name] = addColumn("disease:" + name);
+        }
+        foreach (const QString& name, db->propertyNames(PatientDB::PathologyProperties))
+        {
+            pathologyPropertyColumns[name] = addColumn(name);
+        }
+        foreach (const QString& name, db->propertyNames(PatientDB::PathologyProperties, true))
+        {
+            pathologyDetailColumns[name] = addColumn(name + ":detail");
+        }
+    }
+
+    QVector<ColumnValues> buildRows(const ExportBatch& batch)
+    {
+        TRACE_SPAN("DatabaseExport::buildRows");
+        int rows = 0;
+        foreach (const Patient::Ptr& p, batch.patients)
+        {
+            rows += qMax(1, batch.diseases.value(p->id).size());
+        }
+        QVector<ColumnValues> columns(headers.size(), ColumnValues(rows));
+
+        int row = 0;
+        foreach (const Patient::Ptr& p, batch.patients)
+        {
+            const QList<Disease> diseases = batch.diseases.value(p->id);
+            const int diseaseRows = qMax(1, diseases.size());
+            for (int i=0; i<diseaseRows; i++, row++)
+            {
+                columns[PatientIdColumn][row] = QString::number(p->id);
+                columns[SurnameColumn][row]   = p->surname;
+                columns[FirstNameColumn][row] = p->firstName;
+                if (p->dateOfBirth.isValid())
+                {
+                    columns[DateOfBirthColumn][row] = p->dateOfBirth.toString(Qt::ISODate);
+                }
+                columns[GenderColumn][row]    = QString::number(p->gender);
+                fillProperties(columns, row, batch.patientProperties.value(p->id), patientPropertyColumns);
+
+                if (i >= diseases.size())
+                {
+                    continue;
+                }
+                const Disease& disease = diseases[i];
+                columns[DiseaseIdColumn][row] = QString::number(disease.id);
+                if (disease.initialDiagnosis.isValid())
+                {
+                    columns[InitialDiagnosisColumn][row] = disease.initialDiagnosis.toString(Qt::ISODate);
+                }
+                columns[CTNMColumn][row] = disease.initialTNM.cTNM();
+                columns[PTNMColumn][row] = disease.initialTNM.pTNM();
+                fillProperties(columns, row, batch.diseaseProperties.value(disease.id), diseasePropertyColumns);
+
+                const QList<Pathology> pathologies = batch.pathologies.value(disease.id);
+                if (!pathologies.isEmpty())
+                {
+                    const Pathology& first = pathologies.first();
+                    columns[EntityColumn][row]       = QString::number(first.entity);
+                    columns[SampleOriginColumn][row] = QString::number(first.sampleOrigin);
+                    columns[ContextColumn][row]      = first.context;
+                    if (first.date.isValid())
+                    {
+                        columns[PathologyDateColumn][row] = first.date.toString(Qt::ISODate);
+                    }
+                }
+                foreach (const Pathology& pathology, pathologies)
+                {
+                    fillProperties(columns, row, batch.pathologyProperties.value(pathology.id),
+                                   pathologyPropertyColumns, &pathologyDetailColumns);
+                }
+            }
+        }
+        return columns;
+    }
+
+    int                 batchSize;
+    int                 rowCount;
+    QStringList         headers;
+    QVector<ColumnType> types;
+    QHash<QString, int> patientPropertyColumns;
+    QHash<QString, int> diseasePropertyColumns;
+    QHash<QString, int> pathologyPropertyColumns;
+    QHash<QString, int> pathologyDetailColumns;
+};
+
+DatabaseExport::DatabaseExport()
+    : d(new DatabaseExportPriv)
+{
+}
+
+DatabaseExport::~DatabaseExport()
+{
+    delete d;
+}
+
+void DatabaseExport::setBatchSize(int patients)
+{
+    d->batchSize = qMax(1, patients);
+}
+
+DatabaseExport::Format DatabaseExport::formatForFile(const QString& filePath)
+{
+    return filePath.endsWith(".csv", Qt::CaseInsensitive) ? CSV : Columnar;
+}
+
+QStringList DatabaseExport::headers() const
+{
+    return d->headers;
+}
+
+int DatabaseExport::rowCount() const
+{
+    return d->rowCount;
+}
+
+bool DatabaseExport::run(const QString& filePath, Format format)
+{
+    TRACE_SPAN("DatabaseExport::run");
+    QElapsedTimer timer;
+    timer.start();
+
+    d->rowCount = 0;
+    {
+        DatabaseAccess access;
+        const int failuresBefore = access.backend()->failedStatementCount();
+        d->setupColumns(access.db());
+        if (access.backend()->failedStatementCount() != failuresBefore)
+        {
+            qWarning() << "Database export: failed to read the property names";
+            return false;
+        }
+    }
+
+    QScopedPointer<ExportWriter> writer;
+    if (format == CSV)
+    {
+        writer.reset(new CSVExportWriter);
+    }
+    else
+    {
+        writer.reset(new ColumnarExportWriter);
+    }
+    if (!writer->open(filePath, d->headers))
+    {
+        qWarning() << "Database export: cannot write" << filePath;
+        return false;
+    }
+
+    // Reading the next batch overlaps with decrypting and writing the current one
+    QFuture<ExportBatch> next = QtConcurrent::run(readBatch, 0, d->batchSize);
+    int patients = 0;
+    forever
+    {
+        ExportBatch batch = next.result();
+        if (batch.failed)
+        {
+            // do not leave a file which looks complete
+            qWarning() << "Database export: failed to read from the database after" << patients << "patients";
+            writer->finish();
+            QFile::remove(filePath);
+            return false;
+        }
+        if (batch.isEmpty())
+        {
+            break;
+        }
+        next = QtConcurrent::run(readBatch, batch.patients.last()->id, d->batchSize);
+
+        QtConcurrent::blockingMap(batch.patients, decryptPatient);
+        const QVector<ColumnValues> columns = d->buildRows(batch);
+        writer->writeRows(columns, d->types);
+        d->rowCount += columns.first().size();
+        patients    += batch.patients.size();
+    }
+
+    const bool success = writer->finish();
+    qDebug() << "Database export:" << patients << "patients," << d->rowCount << "rows,"
+             << d->headers.size() << "columns written to" << filePath << "in" << timer.elapsed() << "ms";
+    return success;
+}
@@ -0,0 +1,98 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+
+#ifndef DATABASEEXPORT_H
+#define DATABASEEXPORT_H
+
+// Qt includes
+
+#include <QString>
+#include <QStringList>
+
+/**
+  Exports the whole database for external statistics, one row per disease
+  (one row with empty disease columns for a patient without disease).
+
+  Columns: patientid, surname, firstname, dateofbirth, gender, diseaseid,
+  initialdiagnosis, ctnm, ptnm; entity, sampleorigin, context, pathologydate of the first pathology;
+  then one column per property id: "patient:<id>", "disease:<id>", "<id>" for pathology properties
+  and "<id>:detail" for pathology properties having a detail.
+  As with Disease::pathologyProperty, the first pathology with a property gives its value.
+
+  Patients are read from PatientDB in batches of ids, with forward-only queries,
+  without loading PatientManager. The next batch is read while the current one
+  is decrypted in parallel and written, so memory is bounded by two batches.
+
+  Formats:
+  - CSV: written with CSVFile, a header line with the column names.
+  - Columnar: a binary file of row groups, one per batch, each column stored contiguously
+    with its own type. All integers big-endian.
+
+      file      = "TPCF" | quint32 version (1) | quint32 column count | column count × string
+                  | row group ... | footer
+      row group = quint32 row count | per column: quint8 type | quint32 byte size | column data
+      footer    = row group count × quint64 file offset | quint32 row group count
+                  | quint64 row count | "TPCF"
+      string    = quint32 byte size | UTF-8
+
+    Column data holds a bitmap of present values (one bit per row, least significant bit first,
+    padded to whole bytes), then for type 1 (integer) one qint32 per row,
+    for type 2 (date) one qint32 per row, days since 1970-01-01,
+    for type 3 (string) row count + 1 quint32 offsets into the following UTF-8 data.
+    Missing values are 0 or empty. Fixed columns have a fixed type; property columns
+    are integer or date in a row group if all their values there are, else string.
+  */
+class DatabaseExport
+{
+public:
+
+    enum Format
+    {
+        CSV,
+        Columnar
+    };
+
+    DatabaseExport();
+    ~DatabaseExport();
+
+    /// The number of patients read per batch
+    void setBatchSize(int patients);
+
+    /// Writes the export. Requires an initialized database. Returns false, and removes the file, if a query fails.
+    bool run(const QString& filePath, Format format);
+
+    /// CSV for files ending in .csv, else Columnar
+    static Format formatForFile(const QString& filePath);
+
+    /// The column names of the last run
+    QStringList headers() const;
+    int rowCount() const;
+
+private:
+
+    Q_DISABLE_COPY(DatabaseExport)
+
+    class DatabaseExportPriv;
+    DatabaseExportPriv* const d;
+};
+
+#endif // DATABASEEXPORT_H
@@ -0,0 +1,715 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "exportspec.h"
+
+// Qt includes
+
+#include <QDebug>
+#include <QFile>
+#include <QTextStream>
+
+// Local includes
+
+#include "combinedvalue.h"
+#include "ihcscore.h"
+#include "pathologypropertyinfo.h"
+#include "xmlstreamutils.h"
+
+ExportPatientContext::ExportPatientContext(const Patient::Ptr& patient, HistoryProofreader* proofreader)
+    : patient(patient),
+      disease(patient->firstDisease()),
+      m_proofreader(proofreader),
+      m_osIterator(0),
+      m_hasLineDates(false)
+{
+}
+
+ExportPatientContext::~ExportPatientContext()
+{
+    delete m_osIterator;
+}
+
+const OSIterator& ExportPatientContext::osIterator()
+{
+    if (!m_osIterator)
+    {
+        m_osIterator = new OSIterator(disease);
+        m_osIterator->setProofreader(m_proofreader);
+    }
+    return *m_osIterator;
+}
+
+const QList<QDate>& ExportPatientContext::ctxLineDates()
+{
+    if (!m_hasLineDates)
+    {
+        NewTreatmentLineIterator treatmentLinesIterator;
+        treatmentLinesIterator.setProofreader(m_proofreader);
+        treatmentLinesIterator.set(disease.history);
+        treatmentLinesIterator.iterateToEnd();
+        foreach (const TherapyGroup& group, treatmentLinesIterator.therapies())
+        {
+            if (group.hasChemotherapy())
+            {
+                m_ctxLineDates << group.beginDate();
+            }
+        }
+        m_hasLineDates = true;
+    }
+    return m_ctxLineDates;
+}
+
+namespace
+{
+
+// Column types
+
+class SingleHeaderColumn : public ExportColumn
+{
+public:
+    SingleHeaderColumn(const QString& header) : header(header) {}
+    virtual QStringList headers() const { return QStringList() << header; }
+    const QString header;
+};
+
+class PatientMetadataColumn : public SingleHeaderColumn
+{
+public:
+    enum Field
+    {
+        Surname,
+        FirstName,
+        DateOfBirth,
+        Gender,
+        PatientId
+    };
+
+    PatientMetadataColumn(Field field, const QString& header)
+        : SingleHeaderColumn(header), field(field) {}
+
+    virtual void write(ExportPatientContext& context, CSVFile& file) const
+    {
+        const Patient::Ptr& p = context.patient;
+        switch (field)
+        {
+        case Surname:
+            file << p->surname;
+            break;
+        case FirstName:
+            file << p->firstName;
+            break;
+        case DateOfBirth:
+            file << p->dateOfBirth;
+            break;
+        case Gender:
+            file << p->gender;
+            break;
+        case PatientId:
+            file << p->id;
+            break;
+        }
+    }
+
+    const Field field;
+};
+
+class DiseaseMetadataColumn : public SingleHeaderColumn
+{
+public:
+    enum Field
+    {
+        T,
+        N,
+        M,
+        R,
+        G,
+        TNMText,
+        AgeAtDiagnosis,
+        Entity
+    };
+
+    DiseaseMetadataColumn(Field field, const QString& header)
+        : SingleHeaderColumn(header), field(field) {}
+
+    virtual void write(ExportPatientContext& context, CSVFile& file) const
+    {
+        const Disease& disease = context.disease;
+        switch (field)
+        {
+        case T:
+            file << disease.initialTNM.Tnumber();
+            break;
+        case N:
+            file << disease.initialTNM.Nnumber();
+            break;
+        case M:
+        {
+            TNM::MStatus m = disease.initialTNM.mstatus();
+            file << (m == TNM::Mx ? QVariant() : QVariant(int(m)));
+            break;
+        }
+        case R:
+            file << (disease.initialTNM.m_pTNM.R == 'x' ? QVariant() : QVariant(QString(disease.initialTNM.m_pTNM.R)));
+            break;
+        case G:
+            file << (disease.initialTNM.m_pTNM.G == 'x' ? QVariant() : QVariant(QString(disease.initialTNM.m_pTNM.G)));
+            break;
+        case TNMText:
+            file << disease.initialTNM.toText();
+            break;
+        case AgeAtDiagnosis:
+            file << (context.patient->dateOfBirth.daysTo(disease.initialDiagnosis) / 365.0);
+            break;
+        case Entity:
+            file << int(disease.entity());
+            break;
+        }
+    }
+
+    const Field field;
+};
+
+class PathologyColumn : public ExportColumn
+{
+public:
+    enum Kind
+    {
+        Value,
+        Detail,
+        MutationAsDetail,
+        IHCSplit,
+        IHCIsPositive
+    };
+
+    PathologyColumn(Kind kind, const PathologyPropertyInfo& info, const QString& header)
+        : kind(kind), info(info), typeInfo(info.valueType), header(header)
+    {
+    }
+
+    virtual QStringList headers() const
+    {
+        if (kind == IHCSplit)
+        {
+            return QStringList() << header + "_intens" << header + "_zahl";
+        }
+        return QStringList() << header;
+    }
+
+    virtual void write(ExportPatientContext& context, CSVFile& file) const
+    {
+        Property prop = context.disease.pathologyProperty(info.id);
+        switch (kind)
+        {
+        case Value:
+            file << (prop.isNull() ? QVariant(QString()) : typeInfo.toVariantData(prop));
+            break;
+        case Detail:
+            file << (prop.isNull() ? QString() : prop.detail);
+            break;
+        case MutationAsDetail:
+            if (prop.isNull())
+            {
+                file << QString();
+            }
+            else if (typeInfo.toVariantData(prop).toBool())
+            {
+                file << (prop.detail.isEmpty() ? QString("Mutation") : prop.detail);
+            }
+            else
+            {
+                file << "WT";
+            }
+            break;
+        case IHCSplit:
+        {
+            IHCScore score = typeInfo.toIHCScore(prop);
+            if (prop.isNull() || !score.isValid())
+            {
+                file << QVariant() << QVariant();
+            }
+            else
+            {
+                file << score.colorIntensity << score.positiveRatio();
+            }
+            break;
+        }
+        case IHCIsPositive:
+        {
+            IHCScore score = typeInfo.toIHCScore(prop);
+            if (prop.isNull() || !score.isValid())
+            {
+                file << QVariant();
+            }
+            else
+            {
+                file << score.isPositive(info.property);
+            }
+            break;
+        }
+        }
+    }
+
+    const Kind                  kind;
+    const PathologyPropertyInfo info;
+    const ValueTypeCategoryInfo typeInfo;
+    const QString               header;
+};
+
+class CombinedColumn : public SingleHeaderColumn
+{
+public:
+    CombinedColumn(const PathologyPropertyInfo& info, CombinedValue::MissingValueBehavior behavior,
+                   bool fishResult, const QString& header)
+        : SingleHeaderColumn(header), info(info), behavior(behavior), fishResult(fishResult)
+    {
+    }
+
+    virtual void write(ExportPatientContext& context, CSVFile& file) const
+    {
+        CombinedValue combinedValue(info);
+        combinedValue.setMissingValueBehavior(behavior);
+        if (fishResult)
+        {
+            file << combinedValue.fishResult(context.disease);
+            return;
+        }
+        combinedValue.combine(context.disease);
+        file << combinedValue.toValue();
+    }
+
+    const PathologyPropertyInfo               info;
+    const CombinedValue::MissingValueBehavior behavior;
+    const bool                                fishResult;
+};
+
+class OSColumn : public ExportColumn
+{
+public:
+    OSColumn(OSIterator::Definition definition, const QString& header)
+        : definition(definition), header(header) {}
+
+    virtual QStringList headers() const { return QStringList() << header << header + "erreicht"; }
+
+    virtual void write(ExportPatientContext& context, CSVFile& file) const
+    {
+        if (context.disease.history.isEmpty())
+        {
+            file << QVariant() << QVariant();
+            return;
+        }
+        const OSIterator& it = context.osIterator();
+        file << it.days(definition);
+        file << (int)it.endpointReached();
+    }
+
+    const OSIterator::Definition definition;
+    const QString                header;
+};
+
+class LineCountColumn : public SingleHeaderColumn
+{
+public:
+    LineCountColumn(const QString& header) : SingleHeaderColumn(header) {}
+
+    virtual void write(ExportPatientContext& context, CSVFile& file) const
+    {
+        file << context.ctxLineDates().size();
+    }
+};
+
+class TTFColumn : public ExportColumn
+{
+public:
+    TTFColumn(int reportedLines, const QString& header)
+        : reportedLines(reportedLines), header(header) {}
+
+    virtual QStringList headers() const
+    {
+        QStringList headers;
+        for (int i=0; i<reportedLines; i++)
+        {
+            headers << header + QString::number(i+1);
+            headers << header + QString::number(i+1) + "erreicht";
+        }
+        return headers;
+    }
+
+    // See AnalysisGenerator::reportTTF
+    virtual void write(ExportPatientContext& context, CSVFile& file) const
+    {
+        const QList<QDate>& ctxLineDates = context.ctxLineDates();
+        int line = 0;
+        if (!context.disease.history.isEmpty())
+        {
+            const OSIterator& osIterator = context.osIterator();
+            for (; line<qMin(reportedLines, ctxLineDates.size()); line++)
+            {
+                QDate begin = ctxLineDates[line];
+                QDate end;
+                int reachedEndpoint = 0;
+                // If there is a following line of treatment, TTF is reached per definition
+                if (ctxLineDates.size() > line+1)
+                {
+                    end = ctxLineDates[line+1];
+                    reachedEndpoint = 1;
+                }
+                else
+                {
+                    end = osIterator.endDate();
+                    reachedEndpoint = osIterator.endpointReached() ? 1 : 0;
+                }
+                file << begin.daysTo(end);
+                file << reachedEndpoint;
+            }
+        }
+        for (; line < reportedLines; line++)
+        {
+            file << QVariant() << QVariant();
+        }
+    }
+
+    const int     reportedLines;
+    const QString header;
+};
+
+ExportColumn* createColumn(const QXmlStreamAttributes& attributes)
+{
+    const QString type   = attributes.value("type").toString();
+    QString header       = attributes.value("header").toString();
+    const QString propId = attributes.value("property").toString();
+
+    if (header.isEmpty())
+    {
+        header = propId.isEmpty() ? type : propId;
+    }
+
+    // Patient metadata
+    if (type == "surname")
+    {
+        return new PatientMetadataColumn(PatientMetadataColumn::Surname, header);
+    }
+    if (type == "firstname")
+    {
+        return new PatientMetadataColumn(PatientMetadataColumn::FirstName, header);
+    }
+    if (type == "dateofbirth")
+    {
+        return new PatientMetadataColumn(PatientMetadataColumn::DateOfBirth, header);
+    }
+    if (type == "gender")
+    {
+        return new PatientMetadataColumn(PatientMetadataColumn::Gender, header);
+    }
+    if (type == "patientid")
+    {
+        return new PatientMetadataColumn(PatientMetadataColumn::PatientId, header);
+    }
+
+    // Disease metadata
+    if (type == "t")
+    {
+        return new DiseaseMetadataColumn(DiseaseMetadataColumn::T, header);
+    }
+    if (type == "n")
+    {
+        return new DiseaseMetadataColumn(DiseaseMetadataColumn::N, header);
+    }
+    if (type == "m")
+    {
+        return new DiseaseMetadataColumn(DiseaseMetadataColumn::M, header);
+    }
+    if (type == "r")
+    {
+        return new DiseaseMetadataColumn(DiseaseMetadataColumn::R, header);
+    }
+    if (type == "g")
+    {
+        return new DiseaseMetadataColumn(DiseaseMetadataColumn::G, header);
+    }
+    if (type == "tnm")
+    {
+        return new DiseaseMetadataColumn(DiseaseMetadataColumn::TNMText, header);
+    }
+    if (type == "ageatdiagnosis")
+    {
+        return new DiseaseMetadataColumn(DiseaseMetadataColumn::AgeAtDiagnosis, header);
+    }
+    if (type == "entity")
+    {
+        return new DiseaseMetadataColumn(DiseaseMetadataColumn::Entity, header);
+    }
+
+    // History
+    if (type == "os")
+    {
+        OSIterator::Definition definition = attributes.value("definition") == "firsttherapy" ?
+                    OSIterator::FromFirstTherapy : OSIterator::FromInitialDiagnosis;
+        return new OSColumn(definition, header);
+    }
+    if (type == "linecount")
+    {
+        return new LineCountColumn(header);
+    }
+    if (type == "ttf")
+    {
+        bool ok;
+        int lines = attributes.value("lines").toString().toInt(&ok);
+        return new TTFColumn(ok ? lines : 5, header);
+    }
+
+    // Pathology, all require a property
+    PathologyPropertyInfo info = PathologyPropertyInfo::info(propId);
+    if (!info.isValid())
+    {
+        qDebug() << "Export spec: unknown property" << propId << "for column type" << type;
+        return 0;
+    }
+
+    if (type == "combined" || type == "fishresult")
+    {
+        CombinedValue::MissingValueBehavior behavior = attributes.value("missing") == "pragmatic" ?
+                    CombinedValue::PragmaticMissingValueBehavior : CombinedValue::StrictMissingValueBehavior;
+        return new CombinedColumn(info, behavior, type == "fishresult", header);
+    }
+    if (type == "property")
+    {
+        return new PathologyColumn(PathologyColumn::Value, info, header);
+    }
+    if (type == "detail")
+    {
+        return new PathologyColumn(PathologyColumn::Detail, info, header);
+    }
+    if (type == "mutationdetail")
+    {
+        return new PathologyColumn(PathologyColumn::MutationAsDetail, info, header);
+    }
+    if (type == "ihcsplit")
+    {
+        return new PathologyColumn(PathologyColumn::IHCSplit, info, header);
+    }
+    if (type == "ihcpositive")
+    {
+        return new PathologyColumn(PathologyColumn::IHCIsPositive, info, header);
+    }
+
+    qDebug() << "Export spec: unknown column type" << type;
+    return 0;
+}
+
+void readFilter(const QXmlStreamAttributes& attributes, PatientPropertyFilterSettings& filter)
+{
+    foreach (const QString& entity, attributes.value("entities").toString().split(',', QString::SkipEmptyParts))
+    {
+        bool ok;
+        int e = entity.trimmed().toInt(&ok);
+        if (ok)
+        {
+            filter.entities << Pathology::Entity(e);
+        }
+    }
+    foreach (const QString& context, attributes.value("contexts").toString().split(',', QString::SkipEmptyParts))
+    {
+        filter.pathologyContexts[context.trimmed()] = true;
+    }
+    if (attributes.hasAttribute("localcenter"))
+    {
+        filter.criteria[PatientPropertyFilterSettings::LocalCenterOrigin] = (attributes.value("localcenter") == "true");
+    }
+}
+
+}
+
+ExportSpec::ExportSpec()
+    : requireHistory(false)
+{
+}
+
+bool ExportSpec::isValid() const
+{
+    return !outputFile.isEmpty() && !columns.isEmpty();
+}
+
+QStringList ExportSpec::headers() const
+{
+    QStringList headers;
+    foreach (const ExportColumn::Ptr& column, columns)
+    {
+        headers << column->headers();
+    }
+    return headers;
+}
+
+bool ExportSpec::accepts(const Patient::Ptr& p) const
+{
+    if (!p->hasDisease())
+    {
+        return false;
+    }
+    if (requireHistory && p->firstDisease().history.isEmpty())
+    {
+        return false;
+    }
+    return filter.matches(p);
+}
+
+void ExportSpec::writeRow(ExportPatientContext& context, CSVFile& file) const
+{
+    foreach (const ExportColumn::Ptr& column, columns)
+    {
+        column->write(context, file);
+    }
+    file.newLine();
+}
+
+QList<ExportSpec> ExportSpec::load(const QString& filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qDebug() << "Failed to open export spec" << filePath << file.errorString();
+        return QList<ExportSpec>();
+    }
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    return fromXml(stream.readAll());
+}
+
+QList<ExportSpec> ExportSpec::fromXml(const QString& xml)
+{
+    QList<ExportSpec> specs;
+    XmlStreamReader reader(xml);
+    ExportSpec spec;
+    bool inSpec = false;
+
+    while (!reader.atEnd())
+    {
+        switch (reader.readNext())
+        {
+        case QXmlStreamReader::StartElement:
+            if (reader.name() == "exportspec")
+            {
+                spec = ExportSpec();
+                reader.readAttributeChecked("name", spec.name);
+                reader.readAttributeChecked("output", spec.outputFile);
+                spec.requireHistory = (reader.attributes().value("requirehistory") == "true");
+                inSpec = true;
+            }
+            else if (inSpec && reader.name() == "filter")
+            {
+                readFilter(reader.attributes(), spec.filter);
+            }
+            else if (inSpec && reader.name() == "column")
+            {
+                ExportColumn* column = createColumn(reader.attributes());
+                if (column)
+                {
+                    spec.columns << ExportColumn::Ptr(column);
+                }
+            }
+            break;
+        case QXmlStreamReader::EndElement:
+            if (reader.name() == "exportspec")
+            {
+                if (spec.isValid())
+                {
+                    specs << spec;
+                }
+                else
+                {
+                    qDebug() << "Export spec" << spec.name << "has no output file or no columns, skipping";
+                }
+                inSpec = false;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (reader.hasError())
+    {
+        qDebug() << "Error parsing export spec:" << reader.errorString() << "line" << reader.lineNumber();
+    }
+
+    return specs;
+}
+
+ExportSpecRunner::ExportSpecRunner()
+{
+}
+
+bool ExportSpecRunner::run(const QList<ExportSpec>& specs, const QList<Patient::Ptr>& patients)
+{
+    if (specs.isEmpty())
+    {
+        qWarning() << "No export specs given";
+        return false;
+    }
+
+    QList<CSVFile*> files;
+    foreach (const ExportSpec& spec, specs)
+    {
+        CSVFile* file = new CSVFile;
+        if (!file->openForWriting(spec.outputFile))
+        {
+            qWarning() << "Export spec" << spec.name << ": cannot write" << spec.outputFile;
+            delete file;
+            qDeleteAll(files);
+            return false;
+        }
+        foreach (const QString& header, spec.headers())
+        {
+            *file << header;
+        }
+        file->newLine();
+        files << file;
+    }
+
+    // One traversal of the cohort for all specs; per-patient history metrics are shared via the context
+    foreach (const Patient::Ptr& p, patients)
+    {
+        if (!p->hasDisease())
+        {
+            continue;
+        }
+        ExportPatientContext context(p, this);
+        for (int i=0; i<specs.size(); i++)
+        {
+            if (specs[i].accepts(p))
+            {
+                specs[i].writeRow(context, *files[i]);
+            }
+        }
+    }
+
+    foreach (CSVFile* file, files)
+    {
+        file->finishWriting();
+    }
+    qDeleteAll(files);
+    return true;
+}
+
+void ExportSpecRunner::problem(const HistoryElement*, const QString&)
+{
+    // be silent, as AnalysisGenerator
+}
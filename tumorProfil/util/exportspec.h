@@ -0,0 +1,150 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef EXPORTSPEC_H
+#define EXPORTSPEC_H
+
+// Qt includes
+
+#include <QDate>
+#include <QList>
+#include <QSharedPointer>
+#include <QStringList>
+
+// Local includes
+
+#include "csvfile.h"
+#include "patient.h"
+#include "patientpropertyfiltermodel.h"
+#include "history/historyiterator.h"
+
+/**
+  Declarative description of a CSV export, loaded at runtime from an XML file.
+
+  <exportspecs>
+    <exportspec name="HER2" output="/path/to/HER2.csv" requirehistory="true">
+      <filter entities="1,4,5" contexts="tumorprofil"/>
+      <column type="surname" header="Nachname"/>
+      <column type="property" property="ihc/her2" header="HER2 DAKO"/>
+      <column type="combined" property="combination/ras-mutation" missing="pragmatic" header="RAS"/>
+      <column type="ihcsplit" property="ihc/p-erk" header="pERK"/>
+      <column type="os" definition="firsttherapy" header="OS"/>
+      <column type="ttf" lines="5" header="TTF"/>
+    </exportspec>
+  </exportspecs>
+
+  Column types:
+  Patient:    surname, firstname, dateofbirth, gender, patientid
+  Disease:    t, n, m, r, g, tnm, ageatdiagnosis, entity
+  Pathology:  property, detail, mutationdetail, ihcsplit (2 columns), ihcpositive,
+              combined (missing="strict|pragmatic"), fishresult
+  History:    os (definition="diagnosis|firsttherapy", 2 columns), linecount,
+              ttf (lines=N, 2*N columns)
+
+  Entities are the database constants of Pathology::Entity.
+  */
+
+class ExportPatientContext
+{
+public:
+
+    /**
+      Per-patient state shared by all columns of all specs evaluated on this patient.
+      History metrics are computed lazily, at most once per patient.
+      */
+    ExportPatientContext(const Patient::Ptr& patient, HistoryProofreader* proofreader = 0);
+    ~ExportPatientContext();
+
+    const Patient::Ptr patient;
+    const Disease&     disease;
+
+    const OSIterator& osIterator();
+    // Begin dates of therapy groups containing a chemotherapy
+    const QList<QDate>& ctxLineDates();
+
+private:
+
+    Q_DISABLE_COPY(ExportPatientContext)
+
+    HistoryProofreader* m_proofreader;
+    OSIterator*         m_osIterator;
+    bool                m_hasLineDates;
+    QList<QDate>        m_ctxLineDates;
+};
+
+class ExportColumn
+{
+public:
+
+    virtual ~ExportColumn() {}
+
+    /// The header labels, one per written field
+    virtual QStringList headers() const = 0;
+    /// Writes exactly headers().size() fields
+    virtual void write(ExportPatientContext& context, CSVFile& file) const = 0;
+
+    typedef QSharedPointer<ExportColumn> Ptr;
+};
+
+class ExportSpec
+{
+public:
+
+    ExportSpec();
+
+    bool isValid() const;
+
+    QString name;
+    QString outputFile;
+    bool    requireHistory;
+    PatientPropertyFilterSettings filter;
+    QList<ExportColumn::Ptr> columns;
+
+    QStringList headers() const;
+    bool accepts(const Patient::Ptr& p) const;
+    void writeRow(ExportPatientContext& context, CSVFile& file) const;
+
+    /**
+      Reads all specs from the given XML file or string.
+      Property ids and column types are resolved here, once; unknown entries are reported and skipped.
+      */
+    static QList<ExportSpec> load(const QString& filePath);
+    static QList<ExportSpec> fromXml(const QString& xml);
+};
+
+class ExportSpecRunner : public HistoryProofreader
+{
+public:
+
+    ExportSpecRunner();
+
+    /**
+      Evaluates all given specs in a single pass over the patients,
+      writing each spec to its outputFile.
+      Returns false if there are no specs or an output file cannot be opened; nothing is exported then.
+      */
+    bool run(const QList<ExportSpec>& specs, const QList<Patient::Ptr>& patients);
+
+    // HistoryProofreader
+    virtual void problem(const HistoryElement* element, const QString& problem);
+};
+
+#endif // EXPORTSPEC_H
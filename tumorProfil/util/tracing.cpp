@@ -0,0 +1,242 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "tracing.h"
+
+// C++ includes
+
+#include <cstring>
+
+// Qt includes
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+
+bool Tracing::enabled = false;
+
+namespace
+{
+
+class TraceEvent
+{
+public:
+    const char* name;
+    qint64      begin;
+    qint64      end;
+};
+
+/**
+  The events of one thread. Only the owning thread appends;
+  the writer reads up to the published count. Chunks are never moved or freed.
+  */
+class TraceBuffer
+{
+public:
+
+    enum
+    {
+        ChunkSize = 4096,
+        MaxChunks = 4096
+    };
+
+    TraceBuffer(int threadId)
+        : threadId(threadId)
+    {
+        memset(chunks, 0, sizeof(chunks));
+    }
+
+    void append(const TraceEvent& event)
+    {
+        const int n = count.load();
+        const int chunk = n / ChunkSize;
+        if (chunk >= MaxChunks)
+        {
+            // full, drop
+            return;
+        }
+        if (!chunks[chunk])
+        {
+            chunks[chunk] = new TraceEvent[ChunkSize];
+        }
+        chunks[chunk][n % ChunkSize] = event;
+        count.storeRelease(n + 1);
+    }
+
+    const TraceEvent& at(int i) const
+    {
+        return chunks[i / ChunkSize][i % ChunkSize];
+    }
+
+    const int   threadId;
+    TraceEvent* chunks[MaxChunks];
+    QAtomicInt  count;
+};
+
+class TraceRegistry
+{
+public:
+
+    TraceRegistry()
+    {
+        clock.start();
+    }
+
+    TraceBuffer* createBuffer()
+    {
+        QMutexLocker lock(&mutex);
+        TraceBuffer* buffer = new TraceBuffer(buffers.size() + 1);
+        buffers << buffer;
+        return buffer;
+    }
+
+    QMutex              mutex;
+    QList<TraceBuffer*> buffers;
+    QElapsedTimer       clock;
+    QString             filePath;
+};
+
+Q_GLOBAL_STATIC(TraceRegistry, registry)
+
+// The buffer is owned by the registry, it outlives the thread
+thread_local TraceBuffer* threadBuffer = 0;
+
+void writeAtExit()
+{
+    Tracing::write(registry()->filePath);
+}
+
+}
+
+void Tracing::enable(const QString& filePath)
+{
+    if (filePath.isEmpty())
+    {
+        return;
+    }
+    TraceRegistry* r = registry();
+    {
+        QMutexLocker lock(&r->mutex);
+        if (r->filePath.isEmpty())
+        {
+            qAddPostRoutine(writeAtExit);
+        }
+        r->filePath = filePath;
+    }
+    enabled = true;
+}
+
+void Tracing::enableFromEnvironment()
+{
+    const QString filePath = QString::fromLocal8Bit(qgetenv("TUMORPROFIL_TRACE"));
+    if (!filePath.isEmpty())
+    {
+        enable(filePath);
+    }
+}
+
+qint64 Tracing::now()
+{
+    return registry()->clock.nsecsElapsed();
+}
+
+void Tracing::record(const char* name, qint64 begin, qint64 end)
+{
+    if (!threadBuffer)
+    {
+        threadBuffer = registry()->createBuffer();
+    }
+    TraceEvent event = { name, begin, end };
+    threadBuffer->append(event);
+}
+
+static void appendJsonString(QByteArray& out, const char* s)
+{
+    out += '"';
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+        {
+            out += '\\';
+        }
+        out += *s;
+    }
+    out += '"';
+}
+
+bool Tracing::write(const QString& filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "Failed to write trace to" << filePath << file.errorString();
+        return false;
+    }
+
+    TraceRegistry* r = registry();
+    QList<TraceBuffer*> buffers;
+    {
+        QMutexLocker lock(&r->mutex);
+        buffers = r->buffers;
+    }
+
+    QByteArray out;
+    out.reserve(1024 * 1024);
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    foreach (TraceBuffer* buffer, buffers)
+    {
+        const int count = buffer->count.loadAcquire();
+        for (int i=0; i<count; i++)
+        {
+            const TraceEvent& event = buffer->at(i);
+            if (!first)
+            {
+                out += ",\n";
+            }
+            first = false;
+            // complete events, times in microseconds
+            out += "{\"ph\":\"X\",\"pid\":1,\"tid\":";
+            out += QByteArray::number(buffer->threadId);
+            out += ",\"name\":";
+            appendJsonString(out, event.name);
+            out += ",\"ts\":";
+            out += QByteArray::number(event.begin / 1000.0, 'f', 3);
+            out += ",\"dur\":";
+            out += QByteArray::number((event.end - event.begin) / 1000.0, 'f', 3);
+            out += '}';
+
+            if (out.size() > 1024 * 1024)
+            {
+                file.write(out);
+                out.resize(0);
+            }
+        }
+    }
+    out += "]}\n";
+    file.write(out);
+    return true;
+}
@@ -0,0 +1,98 @@
+/* ============================================================
+ *
+ * This file is a part of Tumorprofil
+ *
+ * Date        : 19.10.2026
+ *
+ * Copyright (C) 2026 by Marcel Wiesweg <marcel dot wiesweg at uk-essen dot de>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef TRACING_H
+#define TRACING_H
+
+// Qt includes
+
+#include <QString>
+
+/**
+  Lightweight tracing of time spent in scopes, written as Chrome trace-event JSON
+  (open with Perfetto or chrome://tracing).
+
+  Tracing is compiled in and enabled at runtime, by setting the environment variable
+  TUMORPROFIL_TRACE or the command line option --trace to the output file.
+  The file is written when the application exits.
+
+  Each thread records into its own buffer without locking.
+  When tracing is disabled, a span costs one branch.
+  */
+class Tracing
+{
+public:
+
+    static bool isEnabled() { return enabled; }
+
+    /// Enables tracing. The trace is written to filePath at exit.
+    static void enable(const QString& filePath);
+    /// Enables tracing if the environment variable is set
+    static void enableFromEnvironment();
+
+    /// Writes all spans recorded so far
+    static bool write(const QString& filePath);
+
+    // Used by TraceSpan
+    static qint64 now();
+    static void record(const char* name, qint64 begin, qint64 end);
+
+private:
+
+    static bool enabled;
+};
+
+class TraceSpan
+{
+public:
+
+    /// name must be a string literal, or otherwise live until the trace is written
+    explicit TraceSpan(const char* name)
+        : m_name(0), m_begin(0)
+    {
+        if (Tracing::isEnabled())
+        {
+            m_name  = name;
+            m_begin = Tracing::now();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (m_name)
+        {
+            Tracing::record(m_name, m_begin, Tracing::now());
+        }
+    }
+
+private:
+
+    Q_DISABLE_COPY(TraceSpan)
+
+    const char* m_name;
+    qint64      m_begin;
+};
+
+#define TRACE_SPAN_CONCAT_(a, b) a##b
+#define TRACE_SPAN_CONCAT(a, b) TRACE_SPAN_CONCAT_(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_SPAN_CONCAT(traceSpan_, __LINE__)(name)
+
+#endif // TRACING_H